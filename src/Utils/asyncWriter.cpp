@@ -0,0 +1,185 @@
+#include "asyncWriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+#ifdef __unix__
+# include <fcntl.h>
+# include <unistd.h>
+#elif defined _WIN32
+# include <io.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Tonton {
+namespace Utils {
+
+namespace {
+    // the rename itself is durable once the directory is synced
+    void syncDirectory(const std::string& path)
+    {
+#ifdef __unix__
+        std::string directoryPath = fs::path(path).parent_path().string();
+        int directory = open(directoryPath.empty() ? "." : directoryPath.c_str(), O_RDONLY);
+        if (directory >= 0)
+        {
+            fsync(directory);
+            close(directory);
+        }
+#endif
+    }
+} // unnamed namespace
+
+bool writeFileSynced(const std::string& path, const std::string& content, bool append)
+{
+    FILE* file = fopen(path.c_str(), append ? "ab" : "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    bool success = fwrite(content.data(), 1, content.size(), file) == content.size() && fflush(file) == 0;
+#ifdef __unix__
+    success = success && fsync(fileno(file)) == 0;
+#elif defined _WIN32
+    success = success && _commit(_fileno(file)) == 0;
+#endif
+    return fclose(file) == 0 && success;
+}
+
+bool replaceFile(const std::string& path, const std::string& content)
+{
+    std::string tempPath = path + ".tmp";
+    if (!writeFileSynced(tempPath, content))
+    {
+        return false;
+    }
+    std::error_code error;
+    fs::rename(tempPath, path, error);
+    if (error)
+    {
+        fs::remove(tempPath, error);
+        return false;
+    }
+    syncDirectory(path);
+    return true;
+}
+
+AsyncWriter::AsyncWriter()
+{
+    m_thread = std::thread(&AsyncWriter::run, this);
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    stop();
+}
+
+void AsyncWriter::write(const std::string& path, std::string content)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_stop)
+    {
+        lock.unlock();
+        bool written = replaceFile(path, content);
+        lock.lock();
+        if (!written)
+        {
+            m_failedPaths.push_back(path);
+        }
+        return;
+    }
+    auto queued = std::find_if(m_queue.begin(), m_queue.end(), [&path](const std::pair<std::string, std::string>& file) {
+        return file.first == path;
+    });
+    if (queued != m_queue.end())
+    {
+        queued->second = std::move(content);
+        return;
+    }
+    m_queue.emplace_back(path, std::move(content));
+    m_wakeUp.notify_one();
+}
+
+bool AsyncWriter::getPending(const std::string& path, std::string& content)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& file : m_queue)
+    {
+        if (file.first == path)
+        {
+            content = file.second;
+            return true;
+        }
+    }
+    if (m_writing && m_current.first == path)
+    {
+        content = m_current.second;
+        return true;
+    }
+    return false;
+}
+
+std::vector<std::string> AsyncWriter::takeFailedPaths()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> failedPaths;
+    failedPaths.swap(m_failedPaths);
+    return failedPaths;
+}
+
+void AsyncWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_written.wait(lock, [this]() {
+        return m_queue.empty() && !m_writing;
+    });
+}
+
+void AsyncWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeUp.notify_one();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void AsyncWriter::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wakeUp.wait(lock, [this]() {
+            return m_stop || !m_queue.empty();
+        });
+        if (m_queue.empty())
+        {
+            return;
+        }
+        m_current = std::move(m_queue.front());
+        m_queue.erase(m_queue.begin());
+        m_writing = true;
+        lock.unlock();
+
+        // m_current is only changed by this thread
+        bool written = replaceFile(m_current.first, m_current.second);
+
+        lock.lock();
+        if (!written)
+        {
+            m_failedPaths.push_back(m_current.first);
+        }
+        m_current = std::pair<std::string, std::string>();
+        m_writing = false;
+        m_written.notify_all();
+    }
+}
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Tonton {
+namespace Utils {
+
+// written and synced to the disk before returning
+bool writeFileSynced(const std::string& path, const std::string& content, bool append = false);
+// written to <path>.tmp, synced, then renamed over path: a crash leaves either file, never half of one
+bool replaceFile(const std::string& path, const std::string& content);
+
+// Writes files from a background thread, so a slow disk never stalls the thread that saves.
+// Files are replaced with replaceFile. A file queued again before it is written is only
+// written once, with its last content: the queue holds one entry per file and write()
+// never waits.
+class AsyncWriter {
+public:
+    AsyncWriter();
+    virtual ~AsyncWriter();
+
+    void write(const std::string& path, std::string content);
+    // content queued for path and not written yet, so that a read sees the last save
+    bool getPending(const std::string& path, std::string& content);
+    // returns once everything queued so far is on disk
+    void flush();
+    // flushes and stops the thread, write() then writes synchronously
+    void stop();
+    // files that could not be written since the previous call
+    std::vector<std::string> takeFailedPaths();
+
+private:
+    void run();
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_written;
+    // m_mutex locked
+    std::vector<std::pair<std::string, std::string>> m_queue;  // path, content, oldest first
+    std::pair<std::string, std::string> m_current;  // being written
+    std::vector<std::string> m_failedPaths;
+    bool m_writing = false;
+    bool m_stop = false;
+};
+
+} // namespace Utils
+} // namespace Tonton
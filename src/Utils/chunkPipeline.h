@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "spscQueue.h"
+
+namespace Tonton {
+namespace Utils {
+
+// start request: frame, a value of the owner (e.g. a tempo) and the epoch of the request
+struct ChunkRequest {
+    uint64_t frame = 0;
+    uint32_t value = 0;
+    uint32_t epoch = 0;
+};
+
+// Audio computed ahead by a worker thread (streamed stem, stretched song) travels to the
+// audio thread in chunks, the audio thread gives them back once played.
+// The ui and audio threads request a start frame; every request gets a new epoch and
+// chunks computed for an older one are dropped without being played. The request is packed
+// in one atomic word, so its frame and value are always read together.
+// Chunk: any type with a uint32_t epoch member.
+template<typename Chunk>
+struct ChunkPipeline {
+    // request: frame (40 bits), value (12 bits) and epoch (12 bits)
+    static constexpr uint64_t FRAME_BITS = 40;
+    static constexpr uint64_t VALUE_BITS = 12;
+    static constexpr uint64_t FRAME_MASK = (uint64_t(1) << FRAME_BITS) - 1;
+    static constexpr uint32_t VALUE_MASK = (1u << VALUE_BITS) - 1;
+    static constexpr uint32_t EPOCH_MASK = (1u << (64 - FRAME_BITS - VALUE_BITS)) - 1;
+
+    // the owner sizes the chunks, then pushes them to freeChunks
+    explicit ChunkPipeline(size_t chunkCount):chunks(chunkCount), filledChunks(chunkCount), freeChunks(chunkCount) {}
+
+    ChunkPipeline(const ChunkPipeline&) = delete;
+    ChunkPipeline& operator=(const ChunkPipeline&) = delete;
+
+    // ui or audio thread: returns the epoch of the new request
+    uint32_t request(uint64_t frame, uint32_t value = 0)
+    {
+        uint64_t previous = m_request.load(std::memory_order_relaxed);
+        uint64_t next = 0;
+        uint32_t epoch = 0;
+        do
+        {
+            epoch = (unpack(previous).epoch + 1) & EPOCH_MASK;
+            epoch = epoch == 0 ? 1 : epoch;  // 0: nothing requested yet
+            next = (static_cast<uint64_t>(epoch) << (FRAME_BITS + VALUE_BITS))
+                | (static_cast<uint64_t>(value & VALUE_MASK) << FRAME_BITS) | (frame & FRAME_MASK);
+        } while (!m_request.compare_exchange_weak(previous, next, std::memory_order_release, std::memory_order_relaxed));
+        return epoch;
+    }
+
+    // any thread
+    ChunkRequest getRequest() const
+    {
+        return unpack(m_request.load(std::memory_order_acquire));
+    }
+
+    // ui thread: true once the worker has computed enough of the last request
+    bool waitReady(unsigned int timeoutMs) const
+    {
+        uint32_t epoch = getRequest().epoch;
+        auto startTime = std::chrono::steady_clock::now();
+        while (readyEpoch != epoch)
+        {
+            if (std::chrono::steady_clock::now() - startTime > std::chrono::milliseconds(timeoutMs))
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    // audio thread: starts playing from frame, with the prepared chunks if they were
+    // requested for this frame and value and not played yet
+    uint32_t play(uint64_t frame, uint32_t value = 0)
+    {
+        ChunkRequest pending = getRequest();
+        uint32_t epoch = pending.epoch;
+        if (pending.frame != (frame & FRAME_MASK) || pending.value != (value & VALUE_MASK) || epoch == playedEpoch)
+        {
+            epoch = request(frame, value);
+        }
+        playedEpoch = epoch;
+        return epoch;
+    }
+
+    // audio thread: gives the current chunk back once it belongs to neither the pending
+    // request nor, while playing, the played one
+    void dropStale(uint32_t epoch, bool playing)
+    {
+        if (current != nullptr && current->epoch != epoch && (!playing || current->epoch != playedEpoch))
+        {
+            freeChunks.push(current);
+            current = nullptr;
+        }
+    }
+
+    // audio thread, not playing: keeps the first chunk of the pending request and gives the
+    // older ones back. True when it becomes the current chunk
+    bool keepPending(uint32_t epoch)
+    {
+        Chunk* chunk = nullptr;
+        while (current == nullptr && filledChunks.pop(chunk))
+        {
+            if (chunk->epoch == epoch)
+            {
+                current = chunk;
+                return true;
+            }
+            freeChunks.push(chunk);
+        }
+        return false;
+    }
+
+    // audio thread
+    void releaseCurrent()
+    {
+        freeChunks.push(current);
+        current = nullptr;
+    }
+
+    std::vector<Chunk> chunks;
+    SpscQueue<Chunk*> filledChunks;  // worker -> audio thread
+    SpscQueue<Chunk*> freeChunks;  // audio thread -> worker
+    std::atomic<uint32_t> readyEpoch {0};  // written by the worker
+
+    // audio thread only
+    Chunk* current = nullptr;
+    uint32_t playedEpoch = 0;
+
+private:
+    static ChunkRequest unpack(uint64_t packed)
+    {
+        ChunkRequest request;
+        request.frame = packed & FRAME_MASK;
+        request.value = static_cast<uint32_t>(packed >> FRAME_BITS) & VALUE_MASK;
+        request.epoch = static_cast<uint32_t>(packed >> (FRAME_BITS + VALUE_BITS));
+        return request;
+    }
+
+    std::atomic<uint64_t> m_request {0};
+};
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,113 @@
+#include "fileWatcher.h"
+
+#include <filesystem>
+
+#ifdef __linux__
+# include <sys/inotify.h>
+# include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace Tonton {
+namespace Utils {
+
+FileWatcher::FileWatcher()
+{
+
+}
+
+FileWatcher::~FileWatcher()
+{
+    stop();
+}
+
+bool FileWatcher::watch(const std::string& path)
+{
+    stop();
+    m_path = path;
+    fs::path filePath(path);
+    m_fileName = filePath.filename().string();
+    m_modified = getModifiedTime();
+    m_nextCheck = std::chrono::steady_clock::now();
+#ifdef __linux__
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify < 0)
+    {
+        return false;
+    }
+    // written in place, or replaced by a rename
+    if (inotify_add_watch(m_inotify, filePath.parent_path().string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        stop();
+        return false;
+    }
+#endif
+    return true;
+}
+
+void FileWatcher::stop()
+{
+#ifdef __linux__
+    if (m_inotify >= 0)
+    {
+        close(m_inotify);
+        m_inotify = -1;
+    }
+#endif
+    m_path.clear();
+}
+
+bool FileWatcher::poll()
+{
+    if (m_path.empty())
+    {
+        return false;
+    }
+#ifdef __linux__
+    if (m_inotify < 0)
+    {
+        return false;
+    }
+    bool changed = false;
+    alignas(struct inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(m_inotify, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t offset = 0; offset < length;)
+        {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+            if (event->len > 0 && m_fileName == event->name)
+            {
+                changed = true;
+            }
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+#else
+    auto now = std::chrono::steady_clock::now();
+    if (now < m_nextCheck)
+    {
+        return false;
+    }
+    m_nextCheck = now + std::chrono::seconds(1);
+    int64_t modified = getModifiedTime();
+    if (modified == m_modified)
+    {
+        return false;
+    }
+    m_modified = modified;
+    return true;
+#endif
+}
+
+int64_t FileWatcher::getModifiedTime() const
+{
+    std::error_code error;
+    auto modified = fs::last_write_time(fs::path(m_path), error);
+    return error ? 0 : static_cast<int64_t>(modified.time_since_epoch().count());
+}
+
+} // namespace Utils
+} // namespace Tonton
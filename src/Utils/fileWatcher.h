@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace Tonton {
+namespace Utils {
+
+// Tells when a file has been written, polled from the ui thread without blocking.
+// Linux: inotify on the directory of the file, as editors often save by replacing it.
+// Elsewhere the modification time is checked once per second.
+class FileWatcher {
+public:
+    FileWatcher();
+    virtual ~FileWatcher();
+
+    // absolute path, the file does not need to exist yet
+    bool watch(const std::string& path);
+    void stop();
+    // true once per write, or burst of writes, since the previous call
+    bool poll();
+
+private:
+    int64_t getModifiedTime() const;
+
+    std::string m_path;
+    std::string m_fileName;
+#ifdef __linux__
+    int m_inotify = -1;
+#endif
+    int64_t m_modified = 0;
+    std::chrono::steady_clock::time_point m_nextCheck;
+};
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,96 @@
+#include "interleave.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "simd.h"
+
+namespace Tonton {
+namespace Utils {
+
+void mixAdd(float* dst, const float* src, float gain, size_t count)
+{
+    size_t i = 0;
+#if defined(TONTON_SIMD_SSE)
+    const __m128 g = _mm_set1_ps(gain);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 a = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(g, _mm_loadu_ps(src + i)));
+        __m128 b = _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_mul_ps(g, _mm_loadu_ps(src + i + 4)));
+        _mm_storeu_ps(dst + i, a);
+        _mm_storeu_ps(dst + i + 4, b);
+    }
+#elif defined(TONTON_SIMD_NEON)
+    const float32x4_t g = vdupq_n_f32(gain);
+    for (; i + 4 <= count; i += 4)
+    {
+        vst1q_f32(dst + i, vmlaq_f32(vld1q_f32(dst + i), g, vld1q_f32(src + i)));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        dst[i] += gain * src[i];
+    }
+}
+
+void interleaveStereoPairs(const float* const* pairs, unsigned int pairCount, size_t frames, float* output)
+{
+    if (pairCount == 1)
+    {
+        if (pairs[0] != nullptr)
+        {
+            std::memcpy(output, pairs[0], frames * 2 * sizeof(float));
+        }
+        else
+        {
+            std::memset(output, 0, frames * 2 * sizeof(float));
+        }
+        return;
+    }
+
+    size_t f = 0;
+#if defined(TONTON_SIMD_SSE)
+    if (pairCount == 2 && pairs[0] != nullptr && pairs[1] != nullptr)
+    {
+        // a stereo frame is 64 bits: two frames of each pair per register, swapped as doubles
+        for (; f + 2 <= frames; f += 2)
+        {
+            __m128d a = _mm_castps_pd(_mm_loadu_ps(pairs[0] + 2 * f));
+            __m128d b = _mm_castps_pd(_mm_loadu_ps(pairs[1] + 2 * f));
+            _mm_storeu_ps(output + 4 * f, _mm_castpd_ps(_mm_unpacklo_pd(a, b)));
+            _mm_storeu_ps(output + 4 * f + 4, _mm_castpd_ps(_mm_unpackhi_pd(a, b)));
+        }
+    }
+#elif defined(TONTON_SIMD_NEON)
+    if (pairCount == 2 && pairs[0] != nullptr && pairs[1] != nullptr)
+    {
+        for (; f + 2 <= frames; f += 2)
+        {
+            float32x4_t a = vld1q_f32(pairs[0] + 2 * f);
+            float32x4_t b = vld1q_f32(pairs[1] + 2 * f);
+            vst1q_f32(output + 4 * f, vcombine_f32(vget_low_f32(a), vget_low_f32(b)));
+            vst1q_f32(output + 4 * f + 4, vcombine_f32(vget_high_f32(a), vget_high_f32(b)));
+        }
+    }
+#endif
+    // remaining frames, one 64-bit stereo frame at a time
+    for (; f < frames; f++)
+    {
+        for (unsigned int p = 0; p < pairCount; p++)
+        {
+            float* frame = output + (f * pairCount + p) * 2;
+            if (pairs[p] != nullptr)
+            {
+                std::memcpy(frame, pairs[p] + 2 * f, 2 * sizeof(float));
+            }
+            else
+            {
+                frame[0] = 0.0f;
+                frame[1] = 0.0f;
+            }
+        }
+    }
+}
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Tonton {
+namespace Utils {
+
+// dst[i] += gain * src[i] (sse / neon / scalar)
+void mixAdd(float* dst, const float* src, float gain, size_t count);
+
+// Builds a device buffer of 2 * pairCount interleaved channels from interleaved stereo
+// buffers, one per channel pair (channels 1/2, 3/4...). A null pair is written as silence.
+void interleaveStereoPairs(const float* const* pairs, unsigned int pairCount, size_t frames, float* output);
+
+} // namespace Utils
+} // namespace Tonton
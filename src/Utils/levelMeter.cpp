@@ -0,0 +1,133 @@
+#include "levelMeter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simd.h"
+
+namespace Tonton {
+namespace Utils {
+
+void computePeakAndSumSquares(const float* samples, size_t count, float& peak, float& sumSquares)
+{
+    size_t i = 0;
+    float maxValue = 0.0f;
+    float sum = 0.0f;
+#if defined(TONTON_SIMD_SSE)
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 max0 = _mm_setzero_ps();
+    __m128 max1 = _mm_setzero_ps();
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128 a = _mm_loadu_ps(samples + i);
+        __m128 b = _mm_loadu_ps(samples + i + 4);
+        max0 = _mm_max_ps(max0, _mm_and_ps(a, absMask));
+        max1 = _mm_max_ps(max1, _mm_and_ps(b, absMask));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(a, a));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(b, b));
+    }
+    max0 = _mm_max_ps(max0, max1);
+    max0 = _mm_max_ps(max0, _mm_movehl_ps(max0, max0));
+    max0 = _mm_max_ss(max0, _mm_shuffle_ps(max0, max0, 1));
+    maxValue = _mm_cvtss_f32(max0);
+    sum0 = _mm_add_ps(sum0, sum1);
+    sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+    sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+    sum = _mm_cvtss_f32(sum0);
+#elif defined(TONTON_SIMD_NEON)
+    float32x4_t max0 = vdupq_n_f32(0.0f);
+    float32x4_t sum0 = vdupq_n_f32(0.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t a = vld1q_f32(samples + i);
+        max0 = vmaxq_f32(max0, vabsq_f32(a));
+        sum0 = vmlaq_f32(sum0, a, a);
+    }
+    float32x2_t max2 = vpmax_f32(vget_low_f32(max0), vget_high_f32(max0));
+    maxValue = vget_lane_f32(vpmax_f32(max2, max2), 0);
+    float32x2_t sum2 = vadd_f32(vget_low_f32(sum0), vget_high_f32(sum0));
+    sum = vget_lane_f32(vpadd_f32(sum2, sum2), 0);
+#endif
+    for (; i < count; i++)
+    {
+        maxValue = std::max(maxValue, std::abs(samples[i]));
+        sum += samples[i] * samples[i];
+    }
+    peak = maxValue;
+    sumSquares = sum;
+}
+
+void LevelMeter::setup(unsigned int sampleRate, float rmsWindowSeconds)
+{
+    m_rmsWindowFrames = std::max(1.0f, sampleRate * rmsWindowSeconds);
+    reset();
+}
+
+void LevelMeter::analyze(const float* samples, size_t count, unsigned int channels)
+{
+    if (count == 0 || channels == 0)
+    {
+        return;
+    }
+    float peak;
+    float sumSquares;
+    computePeakAndSumSquares(samples, count, peak, sumSquares);
+
+    // keep the max until the ui thread consumes it
+    float previousPeak = m_peak.load(std::memory_order_relaxed);
+    while (peak > previousPeak && !m_peak.compare_exchange_weak(previousPeak, peak, std::memory_order_relaxed))
+    {
+    }
+
+    // one pole smoothing of the mean square, coefficient scaled to the block length
+    float frames = static_cast<float>(count / channels);
+    float coeff = std::min(1.0f, frames / m_rmsWindowFrames);
+    m_meanSquare += coeff * (sumSquares / count - m_meanSquare);
+    m_rms.store(std::sqrt(m_meanSquare), std::memory_order_relaxed);
+}
+
+float LevelMeter::readPeak()
+{
+    return m_peak.exchange(0.0f, std::memory_order_relaxed);
+}
+
+float LevelMeter::getRms() const
+{
+    return m_rms.load(std::memory_order_relaxed);
+}
+
+void LevelMeter::reset()
+{
+    m_peak = 0.0f;
+    m_rms = 0.0f;
+    m_meanSquare = 0.0f;
+}
+
+void MeterDisplayState::update(float newPeak, float newRms, float time, float holdSeconds)
+{
+    peak = newPeak;
+    rms = newRms;
+    if (newPeak >= peakHold || time - peakHoldTime > holdSeconds)
+    {
+        peakHold = newPeak;
+        peakHoldTime = time;
+    }
+    if (newPeak >= 1.0f)
+    {
+        clipped = true;
+    }
+}
+
+float amplitudeToDb(float amplitude)
+{
+    if (amplitude <= 1e-6f)
+    {
+        return -120.0f;
+    }
+    return 20.0f * std::log10(amplitude);
+}
+
+} // namespace Utils
+} // namespace Tonton
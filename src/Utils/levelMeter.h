@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace Tonton {
+namespace Utils {
+
+// peak (max absolute value) and sum of squares of a sample block (sse / neon / scalar)
+void computePeakAndSumSquares(const float* samples, size_t count, float& peak, float& sumSquares);
+
+// Level meter fed by the audio thread and read by the ui thread, without locks.
+// The peak is held until the ui reads it, so short peaks between two frames are not lost.
+class LevelMeter {
+public:
+    void setup(unsigned int sampleRate, float rmsWindowSeconds = 0.3f);
+
+    // audio thread
+    void analyze(const float* samples, size_t count, unsigned int channels);
+    // ui thread: peak since the previous call
+    float readPeak();
+    float getRms() const;
+    void reset();
+
+private:
+    std::atomic<float> m_peak {0.0f};
+    std::atomic<float> m_rms {0.0f};
+    float m_meanSquare = 0.0f;  // audio thread only
+    float m_rmsWindowFrames = 13230.0f;
+};
+
+// peak-hold state of a meter drawn by the ui
+struct MeterDisplayState {
+    float peak = 0.0f;
+    float rms = 0.0f;
+    float peakHold = 0.0f;
+    float peakHoldTime = 0.0f;
+    bool clipped = false;
+
+    void update(float newPeak, float newRms, float time, float holdSeconds = 1.5f);
+};
+
+float amplitudeToDb(float amplitude);
+
+} // namespace Utils
+} // namespace Tonton
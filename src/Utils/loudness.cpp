@@ -0,0 +1,235 @@
+#include "loudness.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "levelMeter.h"
+#include "resampler.h"
+
+namespace Tonton {
+namespace Utils {
+
+namespace {
+    const double PI = 3.14159265358979323846;
+    const size_t BLOCK_FRAMES = 4096;
+    const size_t TRUE_PEAK_TAPS = 16;  // per phase, multiple of 4 for the simd dot product
+    const double ABSOLUTE_GATE_LUFS = -70.0;
+    const double RELATIVE_GATE_LU = -10.0;
+
+    double energyToLoudness(double energy)
+    {
+        return -0.691 + 10.0 * std::log10(energy);
+    }
+
+    double loudnessToEnergy(double loudness)
+    {
+        return std::pow(10.0, (loudness + 0.691) / 10.0);
+    }
+
+    // windowed sinc at fractional distance t of the interpolated point
+    double interpolationKernel(double t)
+    {
+        const double halfLength = TRUE_PEAK_TAPS / 2;
+        if (std::abs(t) >= halfLength)
+        {
+            return 0.0;
+        }
+        double window = 0.5 + 0.5 * std::cos(PI * t / halfLength);
+        double sinc = std::abs(t) < 1e-9 ? 1.0 : std::sin(PI * t) / (PI * t);
+        return window * sinc;
+    }
+} // unnamed namespace
+
+LoudnessMeter::LoudnessMeter(unsigned int sampleRate, unsigned int channels):
+    m_channels(std::max(1u, channels)),
+    m_channelWeight(channels == 1 ? 2.0f : 1.0f)
+{
+    // k-weighting filters of BS.1770 for any sample rate (the spec only lists 48 kHz)
+    double K = std::tan(PI * 1681.974450955533 / sampleRate);
+    double Q = 0.7071752369554196;
+    double Vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    double Vb = std::pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    m_shelf = {(Vh + Vb * K / Q + K * K) / a0, 2.0 * (K * K - Vh) / a0, (Vh - Vb * K / Q + K * K) / a0,
+               2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0};
+
+    K = std::tan(PI * 38.13547087602444 / sampleRate);
+    Q = 0.5003270373238773;
+    a0 = 1.0 + K / Q + K * K;
+    m_highPass = {1.0, -2.0, 1.0, 2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0};
+    m_filterState.assign(m_channels * 8, 0.0);
+
+    m_subBlockFrames = std::max<size_t>(1, (sampleRate + 5) / 10);
+
+    m_oversampling = sampleRate < 96000 ? 4 : (sampleRate < 192000 ? 2 : 1);
+    m_phaseTaps.resize(m_oversampling);
+    for (unsigned int p = 1; p < m_oversampling; p++)
+    {
+        // taps applied to the frames [k - TAPS/2 + 1, k + TAPS/2] for the point k + p / oversampling
+        double fraction = static_cast<double>(p) / m_oversampling;
+        std::vector<double> kernel(TRUE_PEAK_TAPS);
+        double sum = 0.0;
+        for (size_t i = 0; i < TRUE_PEAK_TAPS; i++)
+        {
+            kernel[i] = interpolationKernel(static_cast<double>(i) - (TRUE_PEAK_TAPS / 2 - 1) - fraction);
+            sum += kernel[i];
+        }
+        float gain = 0.0f;
+        m_phaseTaps[p].resize(TRUE_PEAK_TAPS);
+        for (size_t i = 0; i < TRUE_PEAK_TAPS; i++)
+        {
+            m_phaseTaps[p][i] = static_cast<float>(kernel[i] / sum);
+            gain += std::abs(m_phaseTaps[p][i]);
+        }
+        m_maxPhaseGain = std::max(m_maxPhaseGain, gain);
+    }
+    m_history.assign(m_channels, std::vector<float>(TRUE_PEAK_TAPS - 1, 0.0f));
+}
+
+void LoudnessMeter::addFrames(const float* samples, size_t frames)
+{
+    while (frames > 0)
+    {
+        size_t count = std::min(frames, BLOCK_FRAMES);
+        addBlock(samples, count);
+        samples += count * m_channels;
+        frames -= count;
+    }
+}
+
+void LoudnessMeter::addBlock(const float* samples, size_t frames)
+{
+    float blockPeak;
+    float sumSquares;
+    computePeakAndSumSquares(samples, frames * m_channels, blockPeak, sumSquares);
+    m_samplePeak = std::max(m_samplePeak, blockPeak);
+
+    const Biquad& s = m_shelf;
+    const Biquad& h = m_highPass;
+    for (size_t f = 0; f < frames; f++)
+    {
+        double energy = 0.0;
+        for (unsigned int c = 0; c < m_channels; c++)
+        {
+            double* z = &m_filterState[c * 8];
+            double x = samples[f * m_channels + c];
+            double y = s.b0 * x + s.b1 * z[0] + s.b2 * z[1] - s.a1 * z[2] - s.a2 * z[3];
+            z[1] = z[0];
+            z[0] = x;
+            z[3] = z[2];
+            z[2] = y;
+            double k = h.b0 * y + h.b1 * z[4] + h.b2 * z[5] - h.a1 * z[6] - h.a2 * z[7];
+            z[5] = z[4];
+            z[4] = y;
+            z[7] = z[6];
+            z[6] = k;
+            energy += k * k;
+        }
+        m_subBlockEnergy += energy;
+
+        if (++m_subBlockPosition == m_subBlockFrames)
+        {
+            std::copy(m_subBlocks + 1, m_subBlocks + 4, m_subBlocks);
+            m_subBlocks[3] = m_channelWeight * m_subBlockEnergy / m_subBlockFrames;
+            m_subBlockEnergy = 0.0;
+            m_subBlockPosition = 0;
+            if (++m_subBlockCount >= 4)
+            {
+                m_blockEnergies.push_back(0.25 * (m_subBlocks[0] + m_subBlocks[1] + m_subBlocks[2] + m_subBlocks[3]));
+            }
+        }
+    }
+
+    // filters fed with silence decay to denormals, which are very slow on some cpus
+    for (auto& value : m_filterState)
+    {
+        if (std::abs(value) < 1e-30)
+        {
+            value = 0.0;
+        }
+    }
+
+    measureTruePeak(samples, frames, blockPeak);
+}
+
+void LoudnessMeter::measureTruePeak(const float* samples, size_t frames, float blockPeak)
+{
+    const size_t historyFrames = TRUE_PEAK_TAPS - 1;
+    for (unsigned int c = 0; c < m_channels; c++)
+    {
+        auto& history = m_history[c];
+        history.resize(historyFrames + frames);
+        for (size_t f = 0; f < frames; f++)
+        {
+            history[historyFrames + f] = samples[f * m_channels + c];
+        }
+    }
+
+    // the interpolation cannot exceed the input peak by more than the filter gain:
+    // blocks that cannot raise the true peak are skipped (most of them once the loudest part is found)
+    float inputPeak = std::max(blockPeak, m_previousBlockPeak);
+    m_previousBlockPeak = blockPeak;
+    if (inputPeak * m_maxPhaseGain > m_truePeak)
+    {
+        for (unsigned int c = 0; c < m_channels; c++)
+        {
+            const float* history = m_history[c].data();
+            for (size_t i = 0; i < frames; i++)
+            {
+                for (unsigned int p = 1; p < m_oversampling; p++)
+                {
+                    float value = std::abs(dotProduct(history + i, m_phaseTaps[p].data(), TRUE_PEAK_TAPS));
+                    m_truePeak = std::max(m_truePeak, value);
+                }
+            }
+        }
+    }
+
+    for (auto& history : m_history)
+    {
+        std::copy(history.end() - historyFrames, history.end(), history.begin());
+        history.resize(historyFrames);
+    }
+}
+
+double LoudnessMeter::getIntegratedLoudness() const
+{
+    double absoluteGate = loudnessToEnergy(ABSOLUTE_GATE_LUFS);
+    double sum = 0.0;
+    size_t count = 0;
+    for (double energy : m_blockEnergies)
+    {
+        if (energy > absoluteGate)
+        {
+            sum += energy;
+            count++;
+        }
+    }
+    if (count == 0)
+    {
+        return LOUDNESS_SILENCE;
+    }
+
+    double relativeGate = sum / count * std::pow(10.0, RELATIVE_GATE_LU / 10.0);
+    double gate = std::max(absoluteGate, relativeGate);
+    sum = 0.0;
+    count = 0;
+    for (double energy : m_blockEnergies)
+    {
+        if (energy > gate)
+        {
+            sum += energy;
+            count++;
+        }
+    }
+    return count > 0 ? energyToLoudness(sum / count) : LOUDNESS_SILENCE;
+}
+
+double LoudnessMeter::getTruePeak() const
+{
+    float peak = std::max(m_samplePeak, m_truePeak);
+    return peak > 0.0f ? 20.0 * std::log10(peak) : LOUDNESS_SILENCE;
+}
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Tonton {
+namespace Utils {
+
+// value returned for a silent track, same floor as amplitudeToDb
+const double LOUDNESS_SILENCE = -120.0;
+
+// Loudness of a whole track, EBU R128 / ITU-R BS.1770:
+// integrated loudness (K-weighted, gated 400 ms blocks) and true peak
+// (4x oversampled below 96 kHz, 2x below 192 kHz).
+// Mono tracks are played on both sides of a bus, they are measured as dual mono.
+class LoudnessMeter {
+public:
+    LoudnessMeter(unsigned int sampleRate, unsigned int channels);
+
+    // interleaved frames, any count per call
+    void addFrames(const float* samples, size_t frames);
+
+    // LUFS, LOUDNESS_SILENCE when every block is below the absolute gate
+    double getIntegratedLoudness() const;
+    // dBTP, LOUDNESS_SILENCE for a silent track
+    double getTruePeak() const;
+
+private:
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+    };
+
+    void addBlock(const float* samples, size_t frames);
+    void measureTruePeak(const float* samples, size_t frames, float blockPeak);
+
+    unsigned int m_channels;
+    float m_channelWeight;
+
+    // k-weighting: high shelf then high pass, 2 biquads per channel
+    Biquad m_shelf;
+    Biquad m_highPass;
+    std::vector<double> m_filterState;  // per channel: x1, x2, y1, y2 of both stages
+
+    // gating: 100 ms sub-blocks, 400 ms blocks overlapping by 75 %
+    size_t m_subBlockFrames;
+    size_t m_subBlockPosition = 0;
+    double m_subBlockEnergy = 0.0;
+    double m_subBlocks[4] = {0.0, 0.0, 0.0, 0.0};
+    size_t m_subBlockCount = 0;
+    std::vector<double> m_blockEnergies;
+
+    // true peak: polyphase interpolator, one filter per phase (phase 0 is the sample itself)
+    unsigned int m_oversampling;
+    std::vector<std::vector<float>> m_phaseTaps;
+    float m_maxPhaseGain = 1.0f;  // bound of |interpolated| / max |input|
+    std::vector<std::vector<float>> m_history;  // planar, per channel: last TAPS - 1 frames, then the block
+    float m_previousBlockPeak = 0.0f;
+    float m_samplePeak = 0.0f;
+    float m_truePeak = 0.0f;
+};
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,268 @@
+#include "peakPyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "simd.h"
+
+namespace Tonton {
+namespace Utils {
+
+namespace {
+    const char PEAKS_MAGIC[4] = {'T', 'P', 'K', 'S'};
+    const uint32_t PEAKS_VERSION = 1;
+
+    int8_t quantizeMin(float value)
+    {
+        return static_cast<int8_t>(std::max(-127.0f, std::min(127.0f, std::floor(value * 127.0f))));
+    }
+
+    int8_t quantizeMax(float value)
+    {
+        return static_cast<int8_t>(std::max(-127.0f, std::min(127.0f, std::ceil(value * 127.0f))));
+    }
+
+    template<typename T>
+    void writeValue(std::ofstream& stream, T value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool readValue(std::ifstream& stream, T& value)
+    {
+        stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return stream.good();
+    }
+} // unnamed namespace
+
+void computeMinMax(const float* samples, size_t count, float& minValue, float& maxValue)
+{
+    size_t i = 0;
+    float lo = count > 0 ? samples[0] : 0.0f;
+    float hi = lo;
+#if defined(TONTON_SIMD_SSE)
+    if (count >= 8)
+    {
+        __m128 min0 = _mm_loadu_ps(samples);
+        __m128 max0 = min0;
+        __m128 min1 = _mm_loadu_ps(samples + 4);
+        __m128 max1 = min1;
+        for (i = 8; i + 8 <= count; i += 8)
+        {
+            __m128 a = _mm_loadu_ps(samples + i);
+            __m128 b = _mm_loadu_ps(samples + i + 4);
+            min0 = _mm_min_ps(min0, a);
+            max0 = _mm_max_ps(max0, a);
+            min1 = _mm_min_ps(min1, b);
+            max1 = _mm_max_ps(max1, b);
+        }
+        min0 = _mm_min_ps(min0, min1);
+        min0 = _mm_min_ps(min0, _mm_movehl_ps(min0, min0));
+        min0 = _mm_min_ss(min0, _mm_shuffle_ps(min0, min0, 1));
+        lo = _mm_cvtss_f32(min0);
+        max0 = _mm_max_ps(max0, max1);
+        max0 = _mm_max_ps(max0, _mm_movehl_ps(max0, max0));
+        max0 = _mm_max_ss(max0, _mm_shuffle_ps(max0, max0, 1));
+        hi = _mm_cvtss_f32(max0);
+    }
+#elif defined(TONTON_SIMD_NEON)
+    if (count >= 4)
+    {
+        float32x4_t min0 = vld1q_f32(samples);
+        float32x4_t max0 = min0;
+        for (i = 4; i + 4 <= count; i += 4)
+        {
+            float32x4_t a = vld1q_f32(samples + i);
+            min0 = vminq_f32(min0, a);
+            max0 = vmaxq_f32(max0, a);
+        }
+        float32x2_t min2 = vpmin_f32(vget_low_f32(min0), vget_high_f32(min0));
+        lo = vget_lane_f32(vpmin_f32(min2, min2), 0);
+        float32x2_t max2 = vpmax_f32(vget_low_f32(max0), vget_high_f32(max0));
+        hi = vget_lane_f32(vpmax_f32(max2, max2), 0);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        lo = std::min(lo, samples[i]);
+        hi = std::max(hi, samples[i]);
+    }
+    minValue = lo;
+    maxValue = hi;
+}
+
+void PeakPyramid::setup(unsigned int sampleRate, unsigned int channels)
+{
+    m_sampleRate = sampleRate;
+    m_channels = std::max(1u, channels);
+    m_frames = 0;
+    m_levels.assign(1, std::vector<int8_t>());
+    m_bucketFrames = 0;
+}
+
+void PeakPyramid::addFrames(const float* samples, size_t frames)
+{
+    while (frames > 0)
+    {
+        size_t count = std::min(frames, BUCKET_FRAMES - m_bucketFrames);
+        float lo;
+        float hi;
+        computeMinMax(samples, count * m_channels, lo, hi);
+        m_bucketMin = m_bucketFrames == 0 ? lo : std::min(m_bucketMin, lo);
+        m_bucketMax = m_bucketFrames == 0 ? hi : std::max(m_bucketMax, hi);
+        m_bucketFrames += count;
+        m_frames += count;
+        if (m_bucketFrames == BUCKET_FRAMES)
+        {
+            pushBucket();
+        }
+        samples += count * m_channels;
+        frames -= count;
+    }
+}
+
+void PeakPyramid::pushBucket()
+{
+    m_levels[0].push_back(quantizeMin(m_bucketMin));
+    m_levels[0].push_back(quantizeMax(m_bucketMax));
+    m_bucketFrames = 0;
+}
+
+void PeakPyramid::finish()
+{
+    if (m_bucketFrames > 0)
+    {
+        pushBucket();
+    }
+    buildLevels();
+}
+
+void PeakPyramid::buildLevels()
+{
+    m_levels.resize(1);
+    while (m_levels.back().size() > 2)
+    {
+        const std::vector<int8_t>& lower = m_levels.back();
+        size_t buckets = lower.size() / 2;
+        std::vector<int8_t> level((buckets + 1) / 2 * 2);
+        for (size_t b = 0; b < buckets; b += 2)
+        {
+            size_t next = std::min(b + 1, buckets - 1);
+            level[b] = std::min(lower[2 * b], lower[2 * next]);
+            level[b + 1] = std::max(lower[2 * b + 1], lower[2 * next + 1]);
+        }
+        m_levels.push_back(std::move(level));
+    }
+}
+
+bool PeakPyramid::getMinMax(double startSeconds, double endSeconds, float& minValue, float& maxValue) const
+{
+    if (m_levels.empty() || m_levels[0].empty() || m_sampleRate == 0)
+    {
+        return false;
+    }
+    size_t buckets = m_levels[0].size() / 2;
+    double startBucket = std::max(0.0, startSeconds * m_sampleRate / BUCKET_FRAMES);
+    if (startBucket >= buckets)
+    {
+        return false;
+    }
+    size_t first = static_cast<size_t>(startBucket);
+    size_t last = std::max(first + 1, std::min(buckets, static_cast<size_t>(std::ceil(endSeconds * m_sampleRate / BUCKET_FRAMES))));
+
+    // exact cover of the buckets [first, last): at most two buckets per level, from the finest
+    int8_t lo = 127;
+    int8_t hi = -127;
+    auto take = [&](size_t level, size_t bucket) {
+        lo = std::min(lo, m_levels[level][2 * bucket]);
+        hi = std::max(hi, m_levels[level][2 * bucket + 1]);
+    };
+    for (size_t level = 0; first < last; level++)
+    {
+        if (first % 2 == 1)
+        {
+            take(level, first++);
+        }
+        if (last % 2 == 1)
+        {
+            take(level, --last);
+        }
+        first /= 2;
+        last /= 2;
+    }
+    minValue = lo / 127.0f;
+    maxValue = hi / 127.0f;
+    return true;
+}
+
+double PeakPyramid::getDurationSeconds() const
+{
+    return m_sampleRate > 0 ? static_cast<double>(m_frames) / m_sampleRate : 0.0;
+}
+
+bool PeakPyramid::save(const std::string& path, uint64_t fileSize) const
+{
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open() || m_levels.empty())
+    {
+        return false;
+    }
+    stream.write(PEAKS_MAGIC, sizeof(PEAKS_MAGIC));
+    writeValue<uint32_t>(stream, PEAKS_VERSION);
+    writeValue<uint64_t>(stream, fileSize);
+    writeValue<uint32_t>(stream, m_sampleRate);
+    writeValue<uint32_t>(stream, m_channels);
+    writeValue<uint64_t>(stream, m_frames);
+    writeValue<uint64_t>(stream, m_levels[0].size());
+    // upper levels are rebuilt when loading
+    stream.write(reinterpret_cast<const char*>(m_levels[0].data()), m_levels[0].size());
+    return stream.good();
+}
+
+bool PeakPyramid::load(const std::string& path, uint64_t fileSize)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t storedFileSize = 0;
+    uint32_t sampleRate = 0;
+    uint32_t channels = 0;
+    uint64_t frames = 0;
+    uint64_t count = 0;
+    stream.read(magic, sizeof(magic));
+    if (!stream.good() || std::memcmp(magic, PEAKS_MAGIC, sizeof(magic)) != 0
+        || !readValue(stream, version) || version != PEAKS_VERSION
+        || !readValue(stream, storedFileSize) || !readValue(stream, sampleRate) || !readValue(stream, channels)
+        || !readValue(stream, frames) || !readValue(stream, count))
+    {
+        return false;
+    }
+    // the audio file was replaced since the pyramid was written
+    if (storedFileSize != fileSize || sampleRate == 0 || count != (frames + BUCKET_FRAMES - 1) / BUCKET_FRAMES * 2)
+    {
+        return false;
+    }
+
+    std::vector<int8_t> values(static_cast<size_t>(count));
+    stream.read(reinterpret_cast<char*>(values.data()), values.size());
+    if (!stream.good())
+    {
+        return false;
+    }
+    setup(sampleRate, channels);
+    m_frames = frames;
+    m_levels[0] = std::move(values);
+    buildLevels();
+    return true;
+}
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Tonton {
+namespace Utils {
+
+// min and max of a sample block (sse / neon / scalar)
+void computeMinMax(const float* samples, size_t count, float& minValue, float& maxValue);
+
+// Min/max overview of a track at several resolutions, to draw its waveform.
+// Level 0 holds the min and max of every BUCKET_FRAMES frames (all channels together),
+// every next level halves the resolution: any range of the track is summarized by
+// reading a handful of buckets, whatever its length. Values are stored on 8 bits.
+class PeakPyramid {
+public:
+    static const size_t BUCKET_FRAMES = 256;
+
+    void setup(unsigned int sampleRate, unsigned int channels);
+    // interleaved frames, any count per call
+    void addFrames(const float* samples, size_t frames);
+    // closes the last bucket and builds the upper levels
+    void finish();
+
+    // min and max in [-1, 1] over [startSeconds, endSeconds), false outside of the track
+    bool getMinMax(double startSeconds, double endSeconds, float& minValue, float& maxValue) const;
+    double getDurationSeconds() const;
+
+    // cache file, fileSize identifies the audio file the pyramid was built from
+    bool save(const std::string& path, uint64_t fileSize) const;
+    bool load(const std::string& path, uint64_t fileSize);
+
+private:
+    void pushBucket();
+    void buildLevels();
+
+    unsigned int m_sampleRate = 0;
+    unsigned int m_channels = 1;
+    uint64_t m_frames = 0;
+    std::vector<std::vector<int8_t>> m_levels;  // min, max of every bucket
+
+    // bucket being filled
+    size_t m_bucketFrames = 0;
+    float m_bucketMin = 0.0f;
+    float m_bucketMax = 0.0f;
+};
+
+} // namespace Utils
+} // namespace Tonton
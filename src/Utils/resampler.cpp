@@ -0,0 +1,266 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "simd.h"
+
+namespace Tonton {
+namespace Utils {
+
+namespace {
+    const double PI = 3.14159265358979323846;
+    const unsigned int MAX_PHASES = 2048;  // above this, filter phases are quantized
+    const double KAISER_BETA = 8.6;  // ~ 90 dB stopband attenuation
+    const double CUTOFF = 0.94;  // fraction of the lowest nyquist frequency kept
+
+    double besselI0(double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 50; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+            if (term < sum * 1e-12) break;
+        }
+        return sum;
+    }
+
+    double sinc(double x)
+    {
+        if (std::abs(x) < 1e-9) return 1.0;
+        return std::sin(PI * x) / (PI * x);
+    }
+} // unnamed namespace
+
+float dotProduct(const float* a, const float* b, size_t count)
+{
+    size_t i = 0;
+    float result = 0.0f;
+#if defined(TONTON_SIMD_SSE)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= count; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+    result = _mm_cvtss_f32(acc0);
+#elif defined(TONTON_SIMD_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= count; i += 8)
+    {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    for (; i + 4 <= count; i += 4)
+    {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    acc0 = vaddq_f32(acc0, acc1);
+    float32x2_t sum2 = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    result = vget_lane_f32(vpadd_f32(sum2, sum2), 0);
+#endif
+    for (; i < count; i++)
+    {
+        result += a[i] * b[i];
+    }
+    return result;
+}
+
+Resampler::Resampler(unsigned int inputRate, unsigned int outputRate, unsigned int channels, unsigned int halfTaps)
+{
+    m_inputRate = std::max(1u, inputRate);
+    m_outputRate = std::max(1u, outputRate);
+    m_channels = std::max(1u, channels);
+
+    uint64_t divisor = std::gcd<uint64_t, uint64_t>(m_inputRate, m_outputRate);
+    m_up = m_outputRate / divisor;
+    m_down = m_inputRate / divisor;
+
+    buildFilter(halfTaps);
+    reset();
+}
+
+void Resampler::buildFilter(unsigned int halfTaps)
+{
+    m_numPhases = static_cast<unsigned int>(std::min<uint64_t>(m_up, MAX_PHASES));
+
+    // when downsampling, the cutoff follows the output nyquist and the kernel gets wider
+    double rho = CUTOFF * std::min(1.0, static_cast<double>(m_up) / static_cast<double>(m_down));
+    int halfWidth = static_cast<int>(std::ceil(halfTaps / rho));
+    m_centerOffset = -(halfWidth - 1);
+    m_numTaps = ((2 * halfWidth + 3) / 4) * 4;
+
+    m_filter.assign(static_cast<size_t>(m_numPhases) * m_numTaps, 0.0f);
+    double i0Beta = besselI0(KAISER_BETA);
+    for (unsigned int p = 0; p < m_numPhases; p++)
+    {
+        double frac = static_cast<double>(p) / m_numPhases;
+        float* coeffs = &m_filter[static_cast<size_t>(p) * m_numTaps];
+        double sum = 0.0;
+        for (int i = 0; i < 2 * halfWidth; i++)
+        {
+            // distance between the output instant and input frame (first tap + i)
+            double tau = frac + halfWidth - 1 - i;
+            double u = tau / halfWidth;
+            double window = 0.0;
+            if (u > -1.0 && u < 1.0)
+            {
+                window = besselI0(KAISER_BETA * std::sqrt(1.0 - u * u)) / i0Beta;
+            }
+            double c = rho * sinc(rho * tau) * window;
+            coeffs[i] = static_cast<float>(c);
+            sum += c;
+        }
+        // unity gain at DC for every phase
+        if (sum != 0.0)
+        {
+            for (int i = 0; i < 2 * halfWidth; i++)
+            {
+                coeffs[i] = static_cast<float>(coeffs[i] / sum);
+            }
+        }
+    }
+}
+
+void Resampler::reset()
+{
+    m_history.assign(m_channels, std::vector<float>());
+    // the first output frame is centered on input frame 0: pad the past with silence
+    for (auto& channelHistory : m_history)
+    {
+        channelHistory.assign(-m_centerOffset, 0.0f);
+    }
+    m_historyStart = 0;
+    m_inputFramesReceived = 0;
+    m_outputFramesProduced = 0;
+}
+
+size_t Resampler::getOutputFrameCount(size_t inputFrames) const
+{
+    return static_cast<size_t>((static_cast<uint64_t>(inputFrames) * m_up + m_down - 1) / m_down);
+}
+
+const float* Resampler::phaseCoefficients(uint64_t phase) const
+{
+    if (m_numPhases == m_up)
+    {
+        return &m_filter[phase * m_numTaps];
+    }
+    uint64_t quantized = (phase * m_numPhases + m_up / 2) / m_up;
+    return &m_filter[std::min<uint64_t>(quantized, m_numPhases - 1) * m_numTaps];
+}
+
+void Resampler::produce(std::vector<float>& output)
+{
+    // history covers input frames [m_historyStart + m_centerOffset, m_inputFramesReceived)
+    int64_t historyOrigin = static_cast<int64_t>(m_historyStart) + m_centerOffset;
+    while (true)
+    {
+        uint64_t position = m_outputFramesProduced * m_down;
+        uint64_t frame = position / m_up;
+        uint64_t phase = position % m_up;
+        int64_t firstTap = static_cast<int64_t>(frame) + m_centerOffset;
+        if (firstTap + m_numTaps > static_cast<int64_t>(m_inputFramesReceived))
+        {
+            break;
+        }
+        const float* coeffs = phaseCoefficients(phase);
+        size_t offset = static_cast<size_t>(firstTap - historyOrigin);
+        for (unsigned int c = 0; c < m_channels; c++)
+        {
+            output.push_back(dotProduct(coeffs, &m_history[c][offset], m_numTaps));
+        }
+        m_outputFramesProduced += 1;
+    }
+
+    // drop the input frames no future output frame will read
+    uint64_t nextFrame = (m_outputFramesProduced * m_down) / m_up;
+    int64_t keepFrom = static_cast<int64_t>(nextFrame) + m_centerOffset;
+    if (keepFrom > historyOrigin)
+    {
+        size_t drop = static_cast<size_t>(keepFrom - historyOrigin);
+        drop = std::min(drop, m_history[0].size());
+        for (auto& channelHistory : m_history)
+        {
+            channelHistory.erase(channelHistory.begin(), channelHistory.begin() + drop);
+        }
+        m_historyStart += drop;
+    }
+}
+
+void Resampler::process(const float* input, size_t inputFrames, std::vector<float>& output)
+{
+    if (inputFrames == 0)
+    {
+        return;
+    }
+    for (unsigned int c = 0; c < m_channels; c++)
+    {
+        auto& channelHistory = m_history[c];
+        size_t start = channelHistory.size();
+        channelHistory.resize(start + inputFrames);
+        for (size_t i = 0; i < inputFrames; i++)
+        {
+            channelHistory[start + i] = input[i * m_channels + c];
+        }
+    }
+    m_inputFramesReceived += inputFrames;
+    output.reserve(output.size() + getOutputFrameCount(inputFrames) * m_channels);
+    produce(output);
+}
+
+void Resampler::flush(std::vector<float>& output)
+{
+    uint64_t expectedFrames = getOutputFrameCount(m_inputFramesReceived);
+    uint64_t inputFramesReceived = m_inputFramesReceived;
+    if (m_outputFramesProduced < expectedFrames)
+    {
+        size_t sizeBefore = output.size();
+        std::vector<float> silence(static_cast<size_t>(m_numTaps) * m_channels, 0.0f);
+        process(silence.data(), m_numTaps, output);
+        m_inputFramesReceived = inputFramesReceived;
+
+        // the silence padding only completes the tail, it must not lengthen the track
+        uint64_t extraFrames = m_outputFramesProduced - expectedFrames;
+        uint64_t producedNow = (output.size() - sizeBefore) / m_channels;
+        extraFrames = std::min(extraFrames, producedNow);
+        output.resize(output.size() - static_cast<size_t>(extraFrames) * m_channels);
+        m_outputFramesProduced -= extraFrames;
+    }
+}
+
+std::vector<float> Resampler::resample(const float* input, size_t inputFrames, unsigned int channels, unsigned int inputRate, unsigned int outputRate)
+{
+    if (inputRate == outputRate || inputFrames == 0)
+    {
+        return std::vector<float>(input, input + inputFrames * channels);
+    }
+    Resampler resampler(inputRate, outputRate, channels);
+    std::vector<float> output;
+    output.reserve(resampler.getOutputFrameCount(inputFrames) * channels);
+
+    // feed by blocks to keep the planar history small
+    const size_t blockFrames = 16384;
+    for (size_t offset = 0; offset < inputFrames; offset += blockFrames)
+    {
+        size_t frames = std::min(blockFrames, inputFrames - offset);
+        resampler.process(input + offset * channels, frames, output);
+    }
+    resampler.flush(output);
+    return output;
+}
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Tonton {
+namespace Utils {
+
+// Polyphase windowed-sinc sample rate converter.
+// Works on interleaved float frames. Can be used in one shot (resample) when a
+// track is loaded, or fed block by block (process / flush) in a streaming reader.
+class Resampler {
+public:
+    Resampler(unsigned int inputRate, unsigned int outputRate, unsigned int channels, unsigned int halfTaps = 32);
+
+    // convert a whole interleaved buffer, output duration is inputFrames * outputRate / inputRate
+    static std::vector<float> resample(const float* input, size_t inputFrames, unsigned int channels, unsigned int inputRate, unsigned int outputRate);
+
+    // streaming api: appends every output frame that can be computed so far to output
+    void process(const float* input, size_t inputFrames, std::vector<float>& output);
+    // pushes the tail of the filter out once the input is over
+    void flush(std::vector<float>& output);
+    void reset();
+
+    size_t getOutputFrameCount(size_t inputFrames) const;
+    unsigned int getChannels() const { return m_channels; }
+    bool isPassthrough() const { return m_inputRate == m_outputRate; }
+
+private:
+    void buildFilter(unsigned int halfTaps);
+    void produce(std::vector<float>& output);
+    const float* phaseCoefficients(uint64_t phase) const;
+
+    unsigned int m_inputRate;
+    unsigned int m_outputRate;
+    unsigned int m_channels;
+
+    // ratio outputRate / inputRate = m_up / m_down, reduced
+    uint64_t m_up;
+    uint64_t m_down;
+    unsigned int m_numPhases;
+    unsigned int m_numTaps;  // coefficients per phase, multiple of 4 for the simd kernel
+    int m_centerOffset;  // index of the first tap relative to the current input frame
+    std::vector<float> m_filter;  // m_numPhases x m_numTaps
+
+    // streaming state
+    std::vector<std::vector<float>> m_history;  // planar input, per channel
+    uint64_t m_historyStart = 0;  // absolute input frame index of m_history[c][0]
+    uint64_t m_inputFramesReceived = 0;
+    uint64_t m_outputFramesProduced = 0;
+};
+
+// dot product used by the resampler inner loop (sse / neon / scalar)
+float dotProduct(const float* a, const float* b, size_t count);
+
+} // namespace Utils
+} // namespace Tonton
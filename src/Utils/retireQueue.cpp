@@ -0,0 +1,46 @@
+#include "retireQueue.h"
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
+namespace Tonton {
+namespace Utils {
+
+namespace {
+    std::mutex retireMutex;
+    // retireMutex locked
+    std::vector<std::shared_ptr<const void>> retiredObjects;
+} // unnamed namespace
+
+void RetireQueue::retire(std::shared_ptr<const void> object)
+{
+    if (!object)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(retireMutex);
+    retiredObjects.push_back(std::move(object));
+}
+
+size_t RetireQueue::collect()
+{
+    // freed out of the lock, a destructor may retire objects of its own
+    std::vector<std::shared_ptr<const void>> freed;
+    size_t left = 0;
+    {
+        std::lock_guard<std::mutex> lock(retireMutex);
+        // a replaced object cannot be picked up again: once only held here, it stays so
+        auto unused = std::partition(retiredObjects.begin(), retiredObjects.end(), [](const std::shared_ptr<const void>& object) {
+            return object.use_count() > 1;
+        });
+        std::move(unused, retiredObjects.end(), std::back_inserter(freed));
+        retiredObjects.erase(unused, retiredObjects.end());
+        left = retiredObjects.size();
+    }
+    return left;
+}
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+namespace Tonton {
+namespace Utils {
+
+// Objects replaced while the audio thread may still hold them (decoded tracks, streams,
+// mixer setups). Freeing them is left to the ui thread: they are kept here until nothing
+// else holds them, so the audio thread never drops their last reference.
+class RetireQueue {
+public:
+    // any thread but the audio thread, after the object is replaced for the audio thread
+    static void retire(std::shared_ptr<const void> object);
+    // ui thread: frees the objects only held here, returns how many are left
+    static size_t collect();
+};
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,89 @@
+#include "sampleFormat.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simd.h"
+
+namespace Tonton {
+namespace Utils {
+
+namespace {
+    const float INT16_TO_FLOAT = 1.0f / 32768.0f;
+} // unnamed namespace
+
+void int16ToFloat(const int16_t* src, float* dst, size_t count)
+{
+    size_t i = 0;
+#if defined(TONTON_SIMD_SSE)
+    const __m128 scale = _mm_set1_ps(INT16_TO_FLOAT);
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        // each sample in the high half of a 32-bit lane, shifted back down with its sign
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#elif defined(TONTON_SIMD_NEON)
+    for (; i + 8 <= count; i += 8)
+    {
+        int16x8_t v = vld1q_s16(src + i);
+        vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), INT16_TO_FLOAT));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), INT16_TO_FLOAT));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        dst[i] = src[i] * INT16_TO_FLOAT;
+    }
+}
+
+void floatToInt16(const float* src, int16_t* dst, size_t count)
+{
+    // only used when a track is loaded, the audio thread reads int16 only
+    for (size_t i = 0; i < count; i++)
+    {
+        float value = std::nearbyint(src[i] * 32768.0f);
+        dst[i] = static_cast<int16_t>(std::max(-32768.0f, std::min(32767.0f, value)));
+    }
+}
+
+bool isDualMono(const float* samples, size_t frames)
+{
+    size_t f = 0;
+#if defined(TONTON_SIMD_SSE)
+    for (; f + 2 <= frames; f += 2)
+    {
+        // (l0 r0 l1 r1) against (r0 l0 r1 l1)
+        __m128 v = _mm_loadu_ps(samples + 2 * f);
+        __m128 swapped = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        if (_mm_movemask_ps(_mm_cmpneq_ps(v, swapped)) != 0)
+        {
+            return false;
+        }
+    }
+#elif defined(TONTON_SIMD_NEON)
+    for (; f + 4 <= frames; f += 4)
+    {
+        float32x4x2_t v = vld2q_f32(samples + 2 * f);
+        uint32x4_t equal = vceqq_f32(v.val[0], v.val[1]);
+        if (vgetq_lane_u32(equal, 0) == 0 || vgetq_lane_u32(equal, 1) == 0 || vgetq_lane_u32(equal, 2) == 0 || vgetq_lane_u32(equal, 3) == 0)
+        {
+            return false;
+        }
+    }
+#endif
+    for (; f < frames; f++)
+    {
+        if (samples[2 * f] != samples[2 * f + 1])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Tonton {
+namespace Utils {
+
+// Conversions of the compact storage of the decoded tracks (sse / neon / scalar).
+// int16 samples are scaled by 1 / 32768 like the decoders do, so a 16-bit file
+// goes through float and back without any change.
+void int16ToFloat(const int16_t* src, float* dst, size_t count);
+// rounded to the nearest value, saturated
+void floatToInt16(const float* src, int16_t* dst, size_t count);
+
+// true when both channels of an interleaved stereo block are identical
+bool isDualMono(const float* samples, size_t frames);
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,105 @@
+#include "silenceMap.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Tonton {
+namespace Utils {
+
+void SilenceMap::setup(unsigned int channels)
+{
+    m_channels = std::max(1u, channels);
+    m_silentBlocks.clear();
+    m_blockFrames = 0;
+    m_blockSilent = true;
+}
+
+void SilenceMap::addFrames(const float* samples, size_t frames)
+{
+    while (frames > 0)
+    {
+        size_t count = std::min(frames, BLOCK_FRAMES - m_blockFrames);
+        if (m_blockSilent)
+        {
+            float lo;
+            float hi;
+            computeMinMax(samples, count * m_channels, lo, hi);
+            m_blockSilent = lo == 0.0f && hi == 0.0f;
+        }
+        m_blockFrames += count;
+        if (m_blockFrames == BLOCK_FRAMES)
+        {
+            finish();
+        }
+        samples += count * m_channels;
+        frames -= count;
+    }
+}
+
+void SilenceMap::finish()
+{
+    if (m_blockFrames > 0)
+    {
+        m_silentBlocks.push_back(m_blockSilent ? 1 : 0);
+    }
+    m_blockFrames = 0;
+    m_blockSilent = true;
+}
+
+void SilenceMap::buildFromPeaks(const PeakPyramid& peaks, unsigned int outputSampleRate, double marginSeconds)
+{
+    setup(1);
+    if (outputSampleRate == 0)
+    {
+        return;
+    }
+    double blockSeconds = static_cast<double>(BLOCK_FRAMES) / outputSampleRate;
+    size_t blocks = static_cast<size_t>(std::ceil(peaks.getDurationSeconds() / blockSeconds));
+    m_silentBlocks.resize(blocks);
+    for (size_t b = 0; b < blocks; b++)
+    {
+        float lo;
+        float hi;
+        bool found = peaks.getMinMax(std::max(0.0, b * blockSeconds - marginSeconds), (b + 1) * blockSeconds + marginSeconds, lo, hi);
+        m_silentBlocks[b] = found && lo == 0.0f && hi == 0.0f ? 1 : 0;
+    }
+}
+
+bool SilenceMap::isSilent(uint64_t firstFrame, size_t frames) const
+{
+    if (frames == 0)
+    {
+        return false;
+    }
+    uint64_t firstBlock = firstFrame / BLOCK_FRAMES;
+    uint64_t lastBlock = (firstFrame + frames - 1) / BLOCK_FRAMES;
+    if (lastBlock >= m_silentBlocks.size())
+    {
+        return false;
+    }
+    for (uint64_t b = firstBlock; b <= lastBlock; b++)
+    {
+        if (m_silentBlocks[b] == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SilenceMap::empty() const
+{
+    return m_silentBlocks.empty();
+}
+
+double SilenceMap::getSilentRatio() const
+{
+    if (m_silentBlocks.empty())
+    {
+        return 0.0;
+    }
+    return static_cast<double>(std::count(m_silentBlocks.begin(), m_silentBlocks.end(), 1)) / m_silentBlocks.size();
+}
+
+} // namespace Utils
+} // namespace Tonton
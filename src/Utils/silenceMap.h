@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "peakPyramid.h"
+
+namespace Tonton {
+namespace Utils {
+
+// Blocks of digital silence of a track (every sample exactly 0), so that the player,
+// the mixer and the stream reader can skip them. Stems are often silent for most of
+// a song (a guitar double only playing in the choruses).
+// Ranges outside of the map are never silent.
+class SilenceMap {
+public:
+    static const size_t BLOCK_FRAMES = 1024;
+
+    void setup(unsigned int channels);
+    // interleaved frames, any count per call
+    void addFrames(const float* samples, size_t frames);
+    // closes the last block
+    void finish();
+
+    // from the waveform of a track (its 8-bit buckets are 0 only for digital silence),
+    // at outputSampleRate. marginSeconds around a block must be silent too (resampling filter).
+    void buildFromPeaks(const PeakPyramid& peaks, unsigned int outputSampleRate, double marginSeconds);
+
+    bool isSilent(uint64_t firstFrame, size_t frames) const;
+    bool empty() const;
+    // share of the track that can be skipped, in [0, 1]
+    double getSilentRatio() const;
+
+private:
+    std::vector<uint8_t> m_silentBlocks;
+    unsigned int m_channels = 1;
+
+    // block being filled
+    size_t m_blockFrames = 0;
+    bool m_blockSilent = true;
+};
+
+} // namespace Utils
+} // namespace Tonton
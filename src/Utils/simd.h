@@ -0,0 +1,12 @@
+#pragma once
+
+// Instruction set selection for the audio kernels.
+// SSE is always available on the x86_64 targets we build for (windows and macos intel),
+// NEON on apple silicon. Anything else falls back to the scalar loops.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define TONTON_SIMD_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define TONTON_SIMD_NEON 1
+#endif
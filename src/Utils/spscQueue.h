@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace Tonton {
+namespace Utils {
+
+// Bounded lock-free queue between exactly one producer thread and one consumer thread.
+// push and pop never allocate or block, both can be called from the audio thread.
+template<typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity + 1)
+        {
+            size *= 2;
+        }
+        m_items.resize(size);
+        m_mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // producer thread, false if the queue is full
+    bool push(const T& value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) & m_mask;
+        if (next == m_head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        m_items[tail] = value;
+        m_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer thread, false if the queue is empty
+    bool pop(T& value)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = m_items[head];
+        m_head.store((head + 1) & m_mask, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return (m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire)) & m_mask;
+    }
+
+private:
+    std::vector<T> m_items;
+    size_t m_mask = 0;
+    std::atomic<size_t> m_head {0};
+    std::atomic<size_t> m_tail {0};
+};
+
+} // namespace Utils
+} // namespace Tonton
@@ -77,7 +77,7 @@ void shortenString(std::string& str, unsigned int len, int maxWordLen, unsigned
     }
 }
 
-string replaceSpacesWithNewline(string& str)
+string replaceSpacesWithNewline(const string& str)
 {
     auto words = split_sentence(str);
     // recombine string
@@ -121,11 +121,23 @@ ofVec2f estimateStringSize(std::string& str)
     return ofVec2f(maxWidth, height);
 }
 
+bool isValidElektronPatternStr(const std::string& elektronPatternStr)
+{
+    // bank A to H, pattern 01 to 16
+    if (elektronPatternStr.size() != 3 || elektronPatternStr[0] < 'A' || elektronPatternStr[0] > 'H'
+        || !isdigit(static_cast<unsigned char>(elektronPatternStr[1])) || !isdigit(static_cast<unsigned char>(elektronPatternStr[2])))
+    {
+        return false;
+    }
+    int num = (elektronPatternStr[1] - '0') * 10 + (elektronPatternStr[2] - '0');
+    return num >= 1 && num <= 16;
+}
+
 unsigned int getProgramNumberFromElektronPatternStr(std::string elektronPatternStr)
 {
-    if (elektronPatternStr.size() != 3)
+    if (!isValidElektronPatternStr(elektronPatternStr))
     {
-        // TODO show error for bad config
+        // reported by the setlist preflight
         return 0;
     }
 
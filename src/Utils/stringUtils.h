@@ -8,8 +8,10 @@ std::vector<std::string> split_sentence(std::string sen);
 
 void shortenString(std::string& str, unsigned int len, int maxWordLen = -1, unsigned int maxWordCount = 0);
 
-std::string replaceSpacesWithNewline(std::string& str);
+std::string replaceSpacesWithNewline(const std::string& str);
 
 ofVec2f estimateStringSize(std::string& str);
 
+bool isValidElektronPatternStr(const std::string& elektronPatternStr);
+// 0 when the pattern is not valid
 unsigned int getProgramNumberFromElektronPatternStr(std::string elektronPatternStr);
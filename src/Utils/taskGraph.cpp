@@ -0,0 +1,185 @@
+#include "taskGraph.h"
+
+#include <chrono>
+
+#include "trace.h"
+
+namespace Tonton {
+namespace Utils {
+
+TaskGraph::TaskGraph()
+{
+
+}
+
+TaskGraph::~TaskGraph()
+{
+    stop();
+}
+
+size_t TaskGraph::add(const char* name, Thread thread, std::function<void()> run, const std::vector<size_t>& dependencies)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Task task;
+    task.name = name;
+    task.thread = thread;
+    task.run = std::move(run);
+    task.dependencies = dependencies;
+    m_tasks.push_back(std::move(task));
+    return m_tasks.size() - 1;
+}
+
+void TaskGraph::start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_started = true;
+    startWorkers();
+}
+
+bool TaskGraph::update()
+{
+    size_t next = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_started || m_stop)
+        {
+            return false;
+        }
+        while (next < m_tasks.size() && (m_tasks[next].thread != Thread::UI || !isReady(m_tasks[next])))
+        {
+            next++;
+        }
+        if (next < m_tasks.size())
+        {
+            m_tasks[next].status = Status::RUNNING;
+        }
+    }
+    if (next < m_tasks.size())
+    {
+        runTask(next);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_doneTasks < m_tasks.size())
+        {
+            return false;
+        }
+    }
+    // the last workers are returning
+    joinWorkers();
+    return true;
+}
+
+void TaskGraph::wait()
+{
+    while (!update())
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_started || m_stop)
+        {
+            return;
+        }
+        m_changed.wait(lock, [this]() {
+            if (m_doneTasks == m_tasks.size())
+            {
+                return true;
+            }
+            for (const auto& task : m_tasks)
+            {
+                if (task.thread == Thread::UI && isReady(task))
+                {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+}
+
+void TaskGraph::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    joinWorkers();
+}
+
+std::vector<TaskGraph::TaskState> TaskGraph::getStates() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<TaskState> states;
+    for (const auto& task : m_tasks)
+    {
+        states.push_back({ task.name, task.status, task.durationMs });
+    }
+    return states;
+}
+
+bool TaskGraph::isReady(const Task& task) const
+{
+    if (task.status != Status::WAITING)
+    {
+        return false;
+    }
+    for (size_t dependency : task.dependencies)
+    {
+        if (dependency >= m_tasks.size() || m_tasks[dependency].status != Status::DONE)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TaskGraph::startWorkers()
+{
+    if (m_stop)
+    {
+        return;
+    }
+    for (size_t i = 0; i < m_tasks.size(); i++)
+    {
+        if (m_tasks[i].thread == Thread::WORKER && isReady(m_tasks[i]))
+        {
+            m_tasks[i].status = Status::RUNNING;
+            m_workers.push_back(std::thread(&TaskGraph::runTask, this, i));
+        }
+    }
+}
+
+void TaskGraph::runTask(size_t id)
+{
+    // the tasks are not added to once started, the reference stays valid
+    Task& task = m_tasks[id];
+    auto startTime = std::chrono::steady_clock::now();
+    {
+        TraceScope trace(task.name);
+        task.run();
+    }
+    int64_t durationMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    task.status = Status::DONE;
+    task.durationMs = durationMs;
+    m_doneTasks++;
+    startWorkers();
+    m_changed.notify_all();
+}
+
+void TaskGraph::joinWorkers()
+{
+    std::vector<std::thread> workers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        workers.swap(m_workers);
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+} // namespace Utils
+} // namespace Tonton
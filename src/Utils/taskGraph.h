@@ -0,0 +1,79 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Tonton {
+namespace Utils {
+
+// Tasks run as soon as the tasks they depend on are done: worker tasks each on their own
+// thread, ui tasks (opengl, state read by draw) one per update() call of the ui thread.
+// Independent tasks thus run concurrently, and the ui keeps drawing while they do.
+class TaskGraph {
+public:
+    enum class Thread {
+        WORKER,
+        UI
+    };
+
+    enum class Status {
+        WAITING,
+        RUNNING,
+        DONE
+    };
+
+    struct TaskState {
+        const char* name;
+        Status status;
+        int64_t durationMs;  // once done
+    };
+
+    TaskGraph();
+    virtual ~TaskGraph();
+
+    // before start(). name: a string literal, also the name of the task in the trace.
+    // dependencies: ids returned by add(). Returns the id of the task
+    size_t add(const char* name, Thread thread, std::function<void()> run, const std::vector<size_t>& dependencies = {});
+    // starts the worker tasks that depend on nothing
+    void start();
+    // ui thread: runs the next ui task that is ready, true once every task is done
+    bool update();
+    // ui thread: runs the ui tasks until every task is done
+    void wait();
+    // waits for the running tasks, the others never start
+    void stop();
+    std::vector<TaskState> getStates() const;
+
+private:
+    struct Task {
+        const char* name;
+        Thread thread;
+        std::function<void()> run;
+        std::vector<size_t> dependencies;
+        Status status = Status::WAITING;
+        int64_t durationMs = 0;
+    };
+
+    void runTask(size_t id);
+    void joinWorkers();
+    // m_mutex locked
+    bool isReady(const Task& task) const;
+    void startWorkers();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    // m_mutex locked
+    std::vector<Task> m_tasks;
+    std::vector<std::thread> m_workers;
+    size_t m_doneTasks = 0;
+    bool m_started = false;
+    bool m_stop = false;
+};
+
+} // namespace Utils
+} // namespace Tonton
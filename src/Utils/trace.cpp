@@ -0,0 +1,152 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "asyncWriter.h"
+
+namespace Tonton {
+namespace Utils {
+
+namespace {
+    struct TraceEvent {
+        const char* name;
+        std::string detail;
+        int64_t startUs;
+        int64_t durationUs;
+        int thread;
+    };
+
+    std::atomic<bool> traceEnabled(false);
+    std::chrono::steady_clock::time_point traceStart;
+    std::mutex traceMutex;
+    // traceMutex locked
+    std::string tracePath;
+    std::vector<TraceEvent> traceEvents;
+    std::map<std::thread::id, int> traceThreads;  // 0: the thread that started the trace
+
+    int getThreadIndex()
+    {
+        auto inserted = traceThreads.emplace(std::this_thread::get_id(), static_cast<int>(traceThreads.size()));
+        return inserted.first->second;
+    }
+
+    void appendJsonString(std::string& json, const std::string& value)
+    {
+        json += '"';
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                json += '\\';
+                json += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                json += escaped;
+            }
+            else
+            {
+                json += c;
+            }
+        }
+        json += '"';
+    }
+} // unnamed namespace
+
+void Trace::start(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(traceMutex);
+    tracePath = path;
+    traceEvents.clear();
+    traceThreads.clear();
+    getThreadIndex();
+    traceStart = std::chrono::steady_clock::now();
+    traceEnabled = true;
+}
+
+bool Trace::isEnabled()
+{
+    return traceEnabled;
+}
+
+bool Trace::save()
+{
+    if (!traceEnabled)
+    {
+        return false;
+    }
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        path = tracePath;
+        for (const auto& thread : traceThreads)
+        {
+            json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(thread.second) + ",\"args\":{\"name\":";
+            appendJsonString(json, thread.second == 0 ? "main" : "thread " + std::to_string(thread.second));
+            json += "}},\n";
+        }
+        for (const auto& event : traceEvents)
+        {
+            json += "{\"name\":";
+            appendJsonString(json, event.name);
+            json += ",\"cat\":\"tonton\",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(event.thread)
+                + ",\"ts\":" + std::to_string(event.startUs) + ",\"dur\":" + std::to_string(event.durationUs);
+            if (!event.detail.empty())
+            {
+                json += ",\"args\":{\"detail\":";
+                appendJsonString(json, event.detail);
+                json += '}';
+            }
+            json += "},\n";
+        }
+    }
+    // no comma after the last event
+    json.erase(json.size() - 2);
+    json += "\n]}\n";
+    return replaceFile(path, json);
+}
+
+void Trace::addEvent(const char* name, const std::string& detail, int64_t startUs, int64_t durationUs)
+{
+    if (!traceEnabled)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(traceMutex);
+    traceEvents.push_back({ name, detail, startUs, durationUs, getThreadIndex() });
+}
+
+int64_t Trace::getTimeUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - traceStart).count();
+}
+
+TraceScope::TraceScope(const char* name, std::string detail) :
+    m_name(name)
+{
+    if (Trace::isEnabled())
+    {
+        m_detail = std::move(detail);
+        m_startUs = Trace::getTimeUs();
+    }
+}
+
+TraceScope::~TraceScope()
+{
+    if (m_startUs >= 0)
+    {
+        Trace::addEvent(m_name, m_detail, m_startUs, Trace::getTimeUs() - m_startUs);
+    }
+}
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace Tonton {
+namespace Utils {
+
+// Durations of the phases of the app, saved as Chrome trace event JSON: open the file in
+// chrome://tracing or ui.perfetto.dev. Off until start(), a TraceScope then costs nothing but
+// a check. Events are kept in memory and written by save(), any thread can add them.
+class Trace {
+public:
+    static void start(const std::string& path);
+    static bool isEnabled();
+    // writes every event so far, the file is replaced
+    static bool save();
+    static void addEvent(const char* name, const std::string& detail, int64_t startUs, int64_t durationUs);
+    // microseconds since start()
+    static int64_t getTimeUs();
+};
+
+// one event from its construction to the end of its scope
+class TraceScope {
+public:
+    // name: a string literal. detail: shown with the event, e.g. the song or device
+    explicit TraceScope(const char* name, std::string detail = std::string());
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    std::string m_detail;
+    int64_t m_startUs = -1;  // -1: tracing off
+};
+
+} // namespace Utils
+} // namespace Tonton
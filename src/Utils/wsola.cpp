@@ -0,0 +1,194 @@
+#include "wsola.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "resampler.h"
+
+namespace Tonton {
+namespace Utils {
+
+namespace {
+    const double PI = 3.14159265358979323846;
+    const double SEGMENT_SECONDS = 0.045;  // long enough for bass notes, short enough for drums
+    const size_t COARSE_DECIMATION = 4;  // the search is done on a decimated guide, then refined
+
+    // normalized cross-correlation of the natural continuation with a candidate segment
+    float similarity(const float* natural, const float* candidate, size_t count)
+    {
+        float energy = dotProduct(candidate, candidate, count);
+        if (energy <= 1e-12f)
+        {
+            return 0.0f;
+        }
+        return dotProduct(natural, candidate, count) / std::sqrt(energy);
+    }
+
+    void decimate(const std::vector<float>& input, std::vector<float>& output)
+    {
+        output.resize(input.size() / COARSE_DECIMATION);
+        for (size_t i = 0; i < output.size(); i++)
+        {
+            const float* block = &input[i * COARSE_DECIMATION];
+            output[i] = block[0] + block[1] + block[2] + block[3];
+        }
+    }
+} // unnamed namespace
+
+Wsola::Wsola(unsigned int sampleRate, const std::vector<unsigned int>& trackChannels):
+    m_trackChannels(trackChannels)
+{
+    // power of two, multiple of the decimation and of the simd width
+    m_window = 256;
+    while (m_window * 2 <= SEGMENT_SECONDS * sampleRate)
+    {
+        m_window *= 2;
+    }
+    m_hop = m_window / 2;
+    m_tolerance = m_window / 4;
+
+    // periodic hann: two windows one hop apart sum to 1
+    m_hann.resize(m_window);
+    for (size_t i = 0; i < m_window; i++)
+    {
+        m_hann[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * PI * i / m_window));
+    }
+
+    m_overlap.resize(m_trackChannels.size());
+    m_region.resize(m_trackChannels.size());
+    m_naturalRegion.resize(m_trackChannels.size());
+    for (size_t t = 0; t < m_trackChannels.size(); t++)
+    {
+        m_overlap[t].assign(m_window * m_trackChannels[t], 0.0f);
+    }
+}
+
+void Wsola::reset(double sourceFrame, double tempo)
+{
+    m_startFrame = sourceFrame;
+    m_tempo = tempo;
+    m_segmentIndex = 0;
+    for (auto& overlap : m_overlap)
+    {
+        std::fill(overlap.begin(), overlap.end(), 0.0f);
+    }
+}
+
+double Wsola::getSourcePosition() const
+{
+    // the first segment only completes the frames before the start
+    uint64_t outputFrames = m_segmentIndex > 0 ? (m_segmentIndex - 1) * m_hop : 0;
+    return m_startFrame + outputFrames * m_tempo;
+}
+
+void Wsola::readRegion(const Reader& read, int64_t frame, size_t count, std::vector<std::vector<float>>& tracks, std::vector<float>& guide)
+{
+    guide.assign(count, 0.0f);
+    for (size_t t = 0; t < m_trackChannels.size(); t++)
+    {
+        unsigned int channels = m_trackChannels[t];
+        tracks[t].resize(count * channels);
+        read(t, frame, count, tracks[t].data());
+        const float* samples = tracks[t].data();
+        for (size_t i = 0; i < count; i++)
+        {
+            for (unsigned int c = 0; c < channels; c++)
+            {
+                guide[i] += samples[i * channels + c];
+            }
+        }
+    }
+}
+
+int64_t Wsola::findSegment(const Reader& read, int64_t idealFrame)
+{
+    // m_region holds [idealFrame - tolerance, idealFrame + tolerance + window)
+    int64_t regionStart = idealFrame - static_cast<int64_t>(m_tolerance);
+    readRegion(read, regionStart, m_window + 2 * m_tolerance, m_region, m_guide);
+    if (m_segmentIndex == 0)
+    {
+        return idealFrame;
+    }
+
+    // the segment that would follow the previous one without any tempo change
+    int64_t naturalFrame = m_previousSegment + static_cast<int64_t>(m_hop);
+    readRegion(read, naturalFrame, m_window, m_naturalRegion, m_naturalGuide);
+    if (dotProduct(m_naturalGuide.data(), m_naturalGuide.data(), m_window) <= 1e-12f)
+    {
+        return idealFrame;  // silence, nothing to align
+    }
+
+    decimate(m_guide, m_coarseGuide);
+    decimate(m_naturalGuide, m_coarseNaturalGuide);
+    size_t coarseWindow = m_window / COARSE_DECIMATION;
+    size_t coarseRange = 2 * m_tolerance / COARSE_DECIMATION;
+    size_t bestOffset = m_tolerance;
+    float bestSimilarity = -1e30f;
+    for (size_t offset = 0; offset <= coarseRange; offset++)
+    {
+        float value = similarity(m_coarseNaturalGuide.data(), &m_coarseGuide[offset], coarseWindow);
+        if (value > bestSimilarity)
+        {
+            bestSimilarity = value;
+            bestOffset = offset * COARSE_DECIMATION;
+        }
+    }
+
+    size_t first = bestOffset >= COARSE_DECIMATION ? bestOffset - COARSE_DECIMATION : 0;
+    size_t last = std::min(bestOffset + COARSE_DECIMATION, 2 * m_tolerance);
+    bestSimilarity = -1e30f;
+    for (size_t offset = first; offset <= last; offset++)
+    {
+        float value = similarity(m_naturalGuide.data(), &m_guide[offset], m_window);
+        if (value > bestSimilarity)
+        {
+            bestSimilarity = value;
+            bestOffset = offset;
+        }
+    }
+    return regionStart + static_cast<int64_t>(bestOffset);
+}
+
+void Wsola::process(const Reader& read, std::vector<std::vector<float>>& output)
+{
+    // the first segment is centered on the start frame, it only fades in
+    for (;;)
+    {
+        double ideal = m_startFrame + (static_cast<double>(m_segmentIndex) - 1.0) * m_hop * m_tempo;
+        int64_t idealFrame = static_cast<int64_t>(std::floor(ideal + 0.5));
+        int64_t segment = findSegment(read, idealFrame);
+        size_t offset = static_cast<size_t>(segment - (idealFrame - static_cast<int64_t>(m_tolerance)));
+
+        for (size_t t = 0; t < m_trackChannels.size(); t++)
+        {
+            unsigned int channels = m_trackChannels[t];
+            float* overlap = m_overlap[t].data();
+            const float* samples = &m_region[t][offset * channels];
+            for (size_t i = 0; i < m_window; i++)
+            {
+                for (unsigned int c = 0; c < channels; c++)
+                {
+                    overlap[i * channels + c] += m_hann[i] * samples[i * channels + c];
+                }
+            }
+
+            // the first hop is complete, except after the first segment (frames before the start)
+            if (m_segmentIndex > 0)
+            {
+                output[t].insert(output[t].end(), overlap, overlap + m_hop * channels);
+            }
+            std::copy(overlap + m_hop * channels, overlap + m_window * channels, overlap);
+            std::fill(overlap + m_hop * channels, overlap + m_window * channels, 0.0f);
+        }
+
+        m_previousSegment = segment;
+        m_segmentIndex += 1;
+        if (m_segmentIndex > 1)
+        {
+            return;
+        }
+    }
+}
+
+} // namespace Utils
+} // namespace Tonton
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace Tonton {
+namespace Utils {
+
+// WSOLA time-stretcher (waveform similarity overlap-add), changes the tempo
+// without changing the pitch.
+// Works on several tracks at once: the segment offsets are searched on the sum of
+// all the tracks and applied to every track, so the stems stay sample aligned
+// with each other. Output is produced hop by hop, it can run in a streaming thread.
+class Wsola {
+public:
+    // reads the interleaved frames [frame, frame + count) of a track,
+    // silence outside of the track
+    using Reader = std::function<void(size_t track, int64_t frame, size_t count, float* output)>;
+
+    Wsola(unsigned int sampleRate, const std::vector<unsigned int>& trackChannels);
+
+    // tempo: source frames per output frame (0.9 plays at 90 %)
+    void reset(double sourceFrame, double tempo);
+
+    // appends getHopFrames() interleaved output frames to every track
+    void process(const Reader& read, std::vector<std::vector<float>>& output);
+
+    size_t getHopFrames() const { return m_hop; }
+    // source frame of the next output frame
+    double getSourcePosition() const;
+
+private:
+    int64_t findSegment(const Reader& read, int64_t idealFrame);
+    void readRegion(const Reader& read, int64_t frame, size_t count, std::vector<std::vector<float>>& tracks, std::vector<float>& guide);
+
+    std::vector<unsigned int> m_trackChannels;
+    size_t m_window;  // segment length, 2 hops
+    size_t m_hop;  // output frames per segment
+    size_t m_tolerance;  // max distance of a segment to its ideal position
+    std::vector<float> m_hann;
+
+    double m_startFrame = 0.0;
+    double m_tempo = 1.0;
+    uint64_t m_segmentIndex = 0;
+    int64_t m_previousSegment = 0;
+
+    std::vector<std::vector<float>> m_overlap;  // per track, m_window frames being summed
+    std::vector<std::vector<float>> m_region;  // per track, frames around the ideal position
+    std::vector<std::vector<float>> m_naturalRegion;
+    std::vector<float> m_guide;  // mono sum of the tracks over m_region
+    std::vector<float> m_naturalGuide;
+    std::vector<float> m_coarseGuide;
+    std::vector<float> m_coarseNaturalGuide;
+};
+
+} // namespace Utils
+} // namespace Tonton
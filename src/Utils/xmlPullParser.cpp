@@ -0,0 +1,579 @@
+#include "xmlPullParser.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace Tonton {
+namespace Utils {
+
+namespace {
+    bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    bool isNameChar(char c)
+    {
+        return !isSpace(c) && c != '<' && c != '>' && c != '/' && c != '=' && c != '"' && c != '\'' && c != '&' && c != '\0';
+    }
+
+    void appendUtf8(std::string& out, unsigned long codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            out += static_cast<char>(codePoint);
+        }
+        else if (codePoint < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (codePoint >> 6));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else if (codePoint < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (codePoint >> 12));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (codePoint >> 18));
+            out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+    }
+} // unnamed namespace
+
+bool XmlPullParser::loadFile(const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open())
+    {
+        setText("");
+        m_failed = true;
+        m_error = "cannot open " + path;
+        return false;
+    }
+    std::stringstream content;
+    content << stream.rdbuf();
+    setText(content.str());
+    return true;
+}
+
+void XmlPullParser::setText(std::string text)
+{
+    m_input = std::move(text);
+    m_position = 0;
+    // utf-8 byte order mark
+    if (m_input.compare(0, 3, "\xEF\xBB\xBF") == 0)
+    {
+        m_position = 3;
+    }
+    m_line = 1;
+    m_eventLine = 1;
+    m_openElements.clear();
+    m_rootClosed = false;
+    m_pendingEnd = false;
+    m_failed = false;
+    m_error.clear();
+    m_warnings.clear();
+}
+
+void XmlPullParser::advance(size_t count)
+{
+    size_t end = std::min(m_input.size(), m_position + count);
+    m_line += std::count(m_input.begin() + m_position, m_input.begin() + end, '\n');
+    m_position = end;
+}
+
+void XmlPullParser::skipSpaces()
+{
+    while (m_position < m_input.size() && isSpace(m_input[m_position]))
+    {
+        if (m_input[m_position] == '\n')
+        {
+            m_line++;
+        }
+        m_position++;
+    }
+}
+
+XmlPullParser::Event XmlPullParser::fail(const std::string& message)
+{
+    m_failed = true;
+    m_error = "line " + std::to_string(m_line) + ": " + message;
+    return Event::ERROR;
+}
+
+void XmlPullParser::warn(size_t position, const std::string& message)
+{
+    size_t line = m_line + std::count(m_input.begin() + m_position, m_input.begin() + position, '\n');
+    m_warnings.push_back("line " + std::to_string(line) + ": " + message);
+}
+
+bool XmlPullParser::parseName(std::string& name)
+{
+    size_t begin = m_position;
+    while (m_position < m_input.size() && isNameChar(m_input[m_position]))
+    {
+        m_position++;
+    }
+    name.assign(m_input, begin, m_position - begin);
+    return !name.empty();
+}
+
+void XmlPullParser::decodeText(size_t begin, size_t end, std::string& out)
+{
+    out.clear();
+    size_t position = begin;
+    while (position < end)
+    {
+        const char* entity = static_cast<const char*>(std::memchr(m_input.data() + position, '&', end - position));
+        size_t ampersand = entity != nullptr ? entity - m_input.data() : end;
+        out.append(m_input, position, ampersand - position);
+        if (ampersand == end)
+        {
+            break;
+        }
+        size_t semicolon = m_input.find(';', ampersand);
+        std::string name;
+        if (semicolon != std::string::npos && semicolon < end && semicolon - ampersand <= 10)
+        {
+            name.assign(m_input, ampersand + 1, semicolon - ampersand - 1);
+        }
+        unsigned long codePoint = 0;
+        if (name.size() > 1 && name[0] == '#')
+        {
+            char* parsedEnd = nullptr;
+            bool hex = name[1] == 'x' || name[1] == 'X';
+            codePoint = std::strtoul(name.c_str() + (hex ? 2 : 1), &parsedEnd, hex ? 16 : 10);
+            codePoint = (*parsedEnd != '\0' || codePoint > 0x10FFFF) ? 0 : codePoint;
+        }
+        if (name == "amp") out += '&';
+        else if (name == "lt") out += '<';
+        else if (name == "gt") out += '>';
+        else if (name == "quot") out += '"';
+        else if (name == "apos") out += '\'';
+        else if (codePoint != 0) appendUtf8(out, codePoint);
+        else
+        {
+            // "R&B": the '&' itself
+            out += '&';
+            warn(ampersand, "'&' starts no entity, it is kept as is (&amp; is the escaped form)");
+            position = ampersand + 1;
+            continue;
+        }
+        position = semicolon + 1;
+    }
+}
+
+XmlPullParser::Event XmlPullParser::next()
+{
+    if (m_failed)
+    {
+        return Event::ERROR;
+    }
+    if (m_pendingEnd)
+    {
+        m_pendingEnd = false;
+        m_openElements.pop_back();
+        m_rootClosed = m_openElements.empty();
+        return Event::END_ELEMENT;
+    }
+
+    while (true)
+    {
+        m_eventLine = m_line;
+        if (m_position >= m_input.size())
+        {
+            if (!m_openElements.empty())
+            {
+                return fail("unexpected end of file, <" + m_openElements.back() + "> is not closed");
+            }
+            if (!m_rootClosed)
+            {
+                return fail("no root element");
+            }
+            return Event::END_DOCUMENT;
+        }
+
+        if (m_input[m_position] != '<')
+        {
+            size_t end = m_input.find('<', m_position);
+            end = end == std::string::npos ? m_input.size() : end;
+            bool blank = std::all_of(m_input.begin() + m_position, m_input.begin() + end, isSpace);
+            if (blank)
+            {
+                advance(end - m_position);
+                continue;
+            }
+            if (m_openElements.empty())
+            {
+                return fail("text outside of the root element");
+            }
+            decodeText(m_position, end, m_text);
+            advance(end - m_position);
+            return Event::TEXT;
+        }
+
+        if (m_input.compare(m_position, 4, "<!--") == 0)
+        {
+            size_t end = m_input.find("-->", m_position + 4);
+            if (end == std::string::npos)
+            {
+                return fail("comment is not closed");
+            }
+            advance(end + 3 - m_position);
+            continue;
+        }
+        if (m_input.compare(m_position, 9, "<![CDATA[") == 0)
+        {
+            size_t end = m_input.find("]]>", m_position + 9);
+            if (end == std::string::npos)
+            {
+                return fail("CDATA section is not closed");
+            }
+            if (m_openElements.empty())
+            {
+                return fail("CDATA outside of the root element");
+            }
+            m_text.assign(m_input, m_position + 9, end - m_position - 9);
+            advance(end + 3 - m_position);
+            return Event::TEXT;
+        }
+        if (m_input.compare(m_position, 2, "<?") == 0)
+        {
+            size_t end = m_input.find("?>", m_position + 2);
+            if (end == std::string::npos)
+            {
+                return fail("processing instruction is not closed");
+            }
+            advance(end + 2 - m_position);
+            continue;
+        }
+        if (m_input.compare(m_position, 2, "<!") == 0)
+        {
+            // doctype, with its internal subset if any
+            size_t bracket = m_input.find('[', m_position);
+            size_t end = m_input.find('>', m_position);
+            if (bracket != std::string::npos && end != std::string::npos && bracket < end)
+            {
+                end = m_input.find("]>", bracket);
+                end = end == std::string::npos ? end : end + 1;
+            }
+            if (end == std::string::npos)
+            {
+                return fail("declaration is not closed");
+            }
+            advance(end + 1 - m_position);
+            continue;
+        }
+
+        if (m_input.compare(m_position, 2, "</") == 0)
+        {
+            m_position += 2;
+            if (!parseName(m_name))
+            {
+                return fail("bad closing tag");
+            }
+            skipSpaces();
+            if (m_position >= m_input.size() || m_input[m_position] != '>')
+            {
+                return fail("bad closing tag </" + m_name + ">");
+            }
+            m_position++;
+            if (m_openElements.empty() || m_openElements.back() != m_name)
+            {
+                return fail("</" + m_name + "> does not close " + (m_openElements.empty() ? std::string("any element") : "<" + m_openElements.back() + ">"));
+            }
+            m_openElements.pop_back();
+            m_rootClosed = m_openElements.empty();
+            return Event::END_ELEMENT;
+        }
+
+        // start tag
+        m_position++;
+        if (!parseName(m_name))
+        {
+            return fail("bad tag");
+        }
+        if (m_rootClosed)
+        {
+            return fail("<" + m_name + "> after the root element");
+        }
+        m_attributes.clear();
+        while (true)
+        {
+            skipSpaces();
+            if (m_position >= m_input.size())
+            {
+                return fail("tag <" + m_name + "> is not closed");
+            }
+            char c = m_input[m_position];
+            if (c == '>')
+            {
+                m_position++;
+                break;
+            }
+            if (c == '/')
+            {
+                if (m_input.compare(m_position, 2, "/>") != 0)
+                {
+                    return fail("bad tag <" + m_name + ">");
+                }
+                m_position += 2;
+                m_pendingEnd = true;
+                break;
+            }
+            std::string attributeName;
+            if (!parseName(attributeName))
+            {
+                return fail("bad attribute in <" + m_name + ">");
+            }
+            skipSpaces();
+            if (m_position >= m_input.size() || m_input[m_position] != '=')
+            {
+                return fail("attribute " + attributeName + " of <" + m_name + "> has no value");
+            }
+            m_position++;
+            skipSpaces();
+            char quote = m_position < m_input.size() ? m_input[m_position] : '\0';
+            size_t end = (quote == '"' || quote == '\'') ? m_input.find(quote, m_position + 1) : std::string::npos;
+            if (end == std::string::npos)
+            {
+                return fail("attribute " + attributeName + " of <" + m_name + "> is not quoted");
+            }
+            std::string value;
+            decodeText(m_position + 1, end, value);
+            advance(end + 1 - m_position);
+            m_attributes.emplace_back(std::move(attributeName), std::move(value));
+        }
+        m_openElements.push_back(m_name);
+        return Event::START_ELEMENT;
+    }
+}
+
+const std::vector<std::string>& XmlPullParser::getWarnings() const
+{
+    return m_warnings;
+}
+
+const std::string& XmlPullParser::getName() const
+{
+    return m_name;
+}
+
+const std::string& XmlPullParser::getText() const
+{
+    return m_text;
+}
+
+const std::vector<std::pair<std::string, std::string>>& XmlPullParser::getAttributes() const
+{
+    return m_attributes;
+}
+
+bool XmlPullParser::getAttribute(const std::string& name, std::string& value) const
+{
+    for (const auto& attribute : m_attributes)
+    {
+        if (attribute.first == name)
+        {
+            value = attribute.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t XmlPullParser::getLine() const
+{
+    return m_eventLine;
+}
+
+size_t XmlPullParser::getDepth() const
+{
+    return m_openElements.size();
+}
+
+const std::string& XmlPullParser::getError() const
+{
+    return m_error;
+}
+
+bool XmlPullParser::readElementText(std::string& text)
+{
+    text.clear();
+    bool hasChildren = false;
+    size_t depth = m_openElements.size();
+    while (true)
+    {
+        switch (next())
+        {
+        case Event::TEXT:
+            text += m_text;
+            break;
+        case Event::START_ELEMENT:
+            hasChildren = true;
+            if (!skipElement())
+            {
+                return false;
+            }
+            break;
+        case Event::END_ELEMENT:
+            if (m_openElements.size() < depth)
+            {
+                size_t first = 0;
+                while (first < text.size() && isSpace(text[first]))
+                {
+                    first++;
+                }
+                size_t last = text.size();
+                while (last > first && isSpace(text[last - 1]))
+                {
+                    last--;
+                }
+                text = text.substr(first, last - first);
+                return !hasChildren;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+}
+
+bool XmlPullParser::skipElement()
+{
+    size_t depth = m_openElements.size();
+    while (true)
+    {
+        Event event = next();
+        if (event == Event::END_ELEMENT && m_openElements.size() < depth)
+        {
+            return true;
+        }
+        if (event == Event::ERROR || event == Event::END_DOCUMENT)
+        {
+            return false;
+        }
+    }
+}
+
+bool parseXmlInteger(const std::string& text, long& value)
+{
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtol(text.c_str(), &end, 10);
+    if (end == text.c_str() || errno == ERANGE)
+    {
+        return false;
+    }
+    while (isSpace(*end))
+    {
+        end++;
+    }
+    return *end == '\0';
+}
+
+bool parseXmlNumber(const std::string& text, double& value)
+{
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str())
+    {
+        return false;
+    }
+    while (isSpace(*end))
+    {
+        end++;
+    }
+    return *end == '\0';
+}
+
+bool validateXmlFile(const std::string& path, const XmlSchema& schema, std::vector<std::string>& problems)
+{
+    XmlPullParser parser;
+    if (!parser.loadFile(path))
+    {
+        problems.push_back(parser.getError());
+        return false;
+    }
+    std::string elementPath;
+    std::vector<size_t> parentLengths;
+    std::string text;
+    while (true)
+    {
+        XmlPullParser::Event event = parser.next();
+        if (event == XmlPullParser::Event::END_DOCUMENT)
+        {
+            problems.insert(problems.end(), parser.getWarnings().begin(), parser.getWarnings().end());
+            return true;
+        }
+        if (event == XmlPullParser::Event::ERROR)
+        {
+            problems.push_back(parser.getError());
+            return false;
+        }
+        if (event == XmlPullParser::Event::END_ELEMENT)
+        {
+            elementPath.resize(parentLengths.back());
+            parentLengths.pop_back();
+            continue;
+        }
+        if (event != XmlPullParser::Event::START_ELEMENT)
+        {
+            continue;
+        }
+
+        size_t line = parser.getLine();
+        size_t parentLength = elementPath.size();
+        elementPath += (elementPath.empty() ? "" : "/") + parser.getName();
+        auto expected = schema.find(elementPath);
+        if (expected == schema.end())
+        {
+            problems.push_back("line " + std::to_string(line) + ": unknown element " + elementPath);
+            if (!parser.skipElement())
+            {
+                problems.push_back(parser.getError());
+                return false;
+            }
+            elementPath.resize(parentLength);
+            continue;
+        }
+        if (expected->second == XmlValueType::NONE)
+        {
+            parentLengths.push_back(parentLength);
+            continue;
+        }
+
+        bool leaf = parser.readElementText(text);
+        if (!parser.getError().empty())
+        {
+            problems.push_back(parser.getError());
+            return false;
+        }
+        long integer;
+        double number;
+        if (!leaf)
+        {
+            problems.push_back("line " + std::to_string(line) + ": " + elementPath + " should only contain a value");
+        }
+        else if (expected->second == XmlValueType::INTEGER && !text.empty() && !parseXmlInteger(text, integer))
+        {
+            problems.push_back("line " + std::to_string(line) + ": " + elementPath + " '" + text + "' is not an integer");
+        }
+        else if (expected->second == XmlValueType::NUMBER && !text.empty() && !parseXmlNumber(text, number))
+        {
+            problems.push_back("line " + std::to_string(line) + ": " + elementPath + " '" + text + "' is not a number");
+        }
+        elementPath.resize(parentLength);
+    }
+}
+
+} // namespace Utils
+} // namespace Tonton
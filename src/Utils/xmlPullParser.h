@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Tonton {
+namespace Utils {
+
+// Pull parser for the xml files of the app: one pass over the text, no tree is built,
+// the caller asks for the next element and reads what it expects at its position.
+// Elements, attributes, text, comments, processing instructions, CDATA, the predefined
+// and numeric entities. No DTD, no namespaces. Errors are reported with their line.
+// A '&' that starts no known entity is kept as a character, as TinyXML (ofxXmlSettings)
+// reads it, with a warning.
+class XmlPullParser {
+public:
+    enum class Event {
+        START_ELEMENT,
+        END_ELEMENT,
+        TEXT,  // whitespace only text is skipped
+        END_DOCUMENT,
+        ERROR
+    };
+
+    bool loadFile(const std::string& path);
+    void setText(std::string text);
+
+    Event next();
+    // element of a START_ELEMENT or END_ELEMENT event
+    const std::string& getName() const;
+    // TEXT event, entities decoded
+    const std::string& getText() const;
+    const std::vector<std::pair<std::string, std::string>>& getAttributes() const;
+    bool getAttribute(const std::string& name, std::string& value) const;
+    // line of the current event, from 1
+    size_t getLine() const;
+    // open elements, the current one included
+    size_t getDepth() const;
+    // "line N: ..." once next() returned ERROR
+    const std::string& getError() const;
+    // "line N: ...", what was read anyway since the text was set
+    const std::vector<std::string>& getWarnings() const;
+
+    // after START_ELEMENT: trimmed text of an element without children, up to its END_ELEMENT.
+    // False when it has child elements, which are skipped
+    bool readElementText(std::string& text);
+    // after START_ELEMENT: skips its content, up to its END_ELEMENT
+    bool skipElement();
+
+private:
+    Event fail(const std::string& message);
+    bool parseName(std::string& name);
+    void decodeText(size_t begin, size_t end, std::string& out);
+    // position: in m_input, after m_position
+    void warn(size_t position, const std::string& message);
+    void skipSpaces();
+    void advance(size_t count);
+
+    std::string m_input;
+    size_t m_position = 0;
+    size_t m_line = 1;
+    size_t m_eventLine = 1;
+    std::vector<std::string> m_openElements;
+    bool m_rootClosed = false;
+    bool m_pendingEnd = false;  // <element/>: END_ELEMENT follows START_ELEMENT
+    bool m_failed = false;
+
+    std::string m_name;
+    std::string m_text;
+    std::vector<std::pair<std::string, std::string>> m_attributes;
+    std::string m_error;
+    std::vector<std::string> m_warnings;
+};
+
+// trimmed text as a number, false when it is not one
+bool parseXmlInteger(const std::string& text, long& value);
+bool parseXmlNumber(const std::string& text, double& value);
+
+enum class XmlValueType {
+    NONE,  // element with children only
+    TEXT,
+    INTEGER,
+    NUMBER
+};
+// elements a file may contain, by path from the root: "settings/midi_outputs/output/name"
+typedef std::map<std::string, XmlValueType> XmlSchema;
+
+// one pass over a file: syntax, unknown elements, values of the wrong type.
+// Problems are added as "line N: ...", false when the file cannot be opened or parsed
+bool validateXmlFile(const std::string& path, const XmlSchema& schema, std::vector<std::string>& problems);
+
+} // namespace Utils
+} // namespace Tonton
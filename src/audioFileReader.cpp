@@ -0,0 +1,355 @@
+#include "audioFileReader.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "ofMain.h"
+
+namespace {
+    const char SEEK_TABLE_MAGIC[4] = {'T', 'S', 'E', 'K'};
+    const uint32_t SEEK_TABLE_VERSION = 1;
+    // upper bound, dr_mp3 spreads the points evenly over the file
+    const drmp3_uint32 MAX_SEEK_POINTS = 2048;
+
+    // the dr_libs bundled with ofxAudioFile may predate the pcm frame api
+#if defined(DRWAV_VERSION_MINOR)
+    bool wavInit(drwav* wav, const char* path) { return drwav_init_file(wav, path, NULL); }
+    uint64_t wavRead(drwav* wav, uint64_t frames, float* out) { return drwav_read_pcm_frames_f32(wav, frames, out); }
+    bool wavSeek(drwav* wav, uint64_t frame) { return drwav_seek_to_pcm_frame(wav, frame); }
+    uint64_t wavFrames(const drwav& wav) { return wav.totalPCMFrameCount; }
+#else
+    bool wavInit(drwav* wav, const char* path) { return drwav_init_file(wav, path); }
+    uint64_t wavRead(drwav* wav, uint64_t frames, float* out) { return drwav_read_f32(wav, frames * wav->channels, out) / wav->channels; }
+    bool wavSeek(drwav* wav, uint64_t frame) { return drwav_seek_to_sample(wav, frame * wav->channels); }
+    uint64_t wavFrames(const drwav& wav) { return wav.totalSampleCount / wav.channels; }
+#endif
+
+#if defined(DRFLAC_VERSION_MINOR)
+    drflac* flacOpen(const char* path) { return drflac_open_file(path, NULL); }
+    uint64_t flacRead(drflac* flac, uint64_t frames, float* out) { return drflac_read_pcm_frames_f32(flac, frames, out); }
+    bool flacSeek(drflac* flac, uint64_t frame) { return drflac_seek_to_pcm_frame(flac, frame); }
+    uint64_t flacFrames(const drflac* flac) { return flac->totalPCMFrameCount; }
+    bool flacHasSeekTable(const drflac* flac) { return flac->seekpointCount > 0; }
+#else
+    drflac* flacOpen(const char* path) { return drflac_open_file(path); }
+    uint64_t flacRead(drflac* flac, uint64_t frames, float* out) { return drflac_read_f32(flac, frames * flac->channels, out) / flac->channels; }
+    bool flacSeek(drflac* flac, uint64_t frame) { return drflac_seek_to_sample(flac, frame * flac->channels); }
+    uint64_t flacFrames(const drflac* flac) { return flac->totalSampleCount / flac->channels; }
+    bool flacHasSeekTable(const drflac* flac) { return flac->seektableSize > 0; }
+#endif
+
+    template<typename T>
+    void writeValue(std::ofstream& stream, T value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool readValue(std::ifstream& stream, T& value)
+    {
+        stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return stream.good();
+    }
+} // unnamed namespace
+
+AudioFileReader::AudioFileReader() {
+
+}
+
+AudioFileReader::~AudioFileReader() {
+    close();
+}
+
+bool AudioFileReader::open(const std::string& filePath)
+{
+    close();
+
+    std::string extension = ofToLower(ofFilePath::getFileExt(filePath));
+    std::string path = ofToDataPath(filePath);
+    if (extension == "wav")
+    {
+        if (!wavInit(&m_wav, path.c_str()))
+        {
+            ofLogError() << "could not open wav file " << filePath;
+            return false;
+        }
+        m_format = Format::WAV;
+        m_channels = m_wav.channels;
+        m_sampleRate = m_wav.sampleRate;
+        m_totalFrames = wavFrames(m_wav);
+        m_bitsPerSample = m_wav.translatedFormatTag == DR_WAVE_FORMAT_IEEE_FLOAT ? 32 : m_wav.bitsPerSample;
+    }
+    else if (extension == "flac")
+    {
+        m_flac = flacOpen(path.c_str());
+        if (m_flac == nullptr)
+        {
+            ofLogError() << "could not open flac file " << filePath;
+            return false;
+        }
+        m_format = Format::FLAC;
+        m_channels = m_flac->channels;
+        m_sampleRate = m_flac->sampleRate;
+        m_totalFrames = flacFrames(m_flac);
+        m_bitsPerSample = m_flac->bitsPerSample;
+        if (!flacHasSeekTable(m_flac))
+        {
+            ofLog() << filePath << " has no SEEKTABLE, seeking falls back to a bisection of the file";
+        }
+    }
+    else if (extension == "mp3")
+    {
+        if (!drmp3_init_file(&m_mp3, path.c_str(), NULL))
+        {
+            ofLogError() << "could not open mp3 file " << filePath;
+            return false;
+        }
+        m_format = Format::MP3;
+        m_channels = m_mp3.channels;
+        m_sampleRate = m_mp3.sampleRate;
+        // lossy, players decode it to 16 bits
+        m_bitsPerSample = 16;
+        if (!loadSeekTable(filePath))
+        {
+            buildSeekTable(filePath);
+        }
+        if (!m_seekPoints.empty())
+        {
+            drmp3_bind_seek_table(&m_mp3, static_cast<drmp3_uint32>(m_seekPoints.size()), m_seekPoints.data());
+        }
+    }
+    else
+    {
+        ofLogError() << "unsupported audio file " << filePath;
+        return false;
+    }
+
+    if (m_channels == 0)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void AudioFileReader::close()
+{
+    switch (m_format)
+    {
+        case Format::WAV:
+            drwav_uninit(&m_wav);
+            break;
+        case Format::MP3:
+            drmp3_uninit(&m_mp3);
+            break;
+        case Format::FLAC:
+            drflac_close(m_flac);
+            m_flac = nullptr;
+            break;
+        default:
+            break;
+    }
+    m_format = Format::NONE;
+    m_seekPoints.clear();
+    m_channels = 0;
+    m_sampleRate = 0;
+    m_bitsPerSample = 0;
+    m_totalFrames = 0;
+}
+
+bool AudioFileReader::isOpen() const
+{
+    return m_format != Format::NONE;
+}
+
+unsigned int AudioFileReader::getChannels() const
+{
+    return m_channels;
+}
+
+unsigned int AudioFileReader::getSampleRate() const
+{
+    return m_sampleRate;
+}
+
+uint64_t AudioFileReader::getTotalFrames() const
+{
+    return m_totalFrames;
+}
+
+unsigned int AudioFileReader::getBitsPerSample() const
+{
+    return m_bitsPerSample;
+}
+
+bool AudioFileReader::hasSeekTable() const
+{
+    switch (m_format)
+    {
+        case Format::WAV:
+            return true;
+        case Format::MP3:
+            return !m_seekPoints.empty();
+        case Format::FLAC:
+            return flacHasSeekTable(m_flac);
+        default:
+            return false;
+    }
+}
+
+size_t AudioFileReader::read(float* output, size_t frames)
+{
+    switch (m_format)
+    {
+        case Format::WAV:
+            return static_cast<size_t>(wavRead(&m_wav, frames, output));
+        case Format::MP3:
+            return static_cast<size_t>(drmp3_read_pcm_frames_f32(&m_mp3, frames, output));
+        case Format::FLAC:
+            return static_cast<size_t>(flacRead(m_flac, frames, output));
+        default:
+            return 0;
+    }
+}
+
+bool AudioFileReader::seek(uint64_t frame)
+{
+    switch (m_format)
+    {
+        case Format::WAV:
+            return wavSeek(&m_wav, frame);
+        case Format::MP3:
+            return drmp3_seek_to_pcm_frame(&m_mp3, frame);
+        case Format::FLAC:
+            return flacSeek(m_flac, frame);
+        default:
+            return false;
+    }
+}
+
+bool AudioFileReader::decodeFile(const std::string& filePath, std::vector<float>& samples, unsigned int& channels, unsigned int& sampleRate, unsigned int& bitsPerSample,
+    const std::atomic<bool>* cancel)
+{
+    AudioFileReader reader;
+    if (!reader.open(filePath))
+    {
+        return false;
+    }
+    channels = reader.getChannels();
+    sampleRate = reader.getSampleRate();
+    bitsPerSample = reader.getBitsPerSample();
+
+    // the frame count is exact for wav, flac and mp3 files with a seek table
+    samples.clear();
+    samples.reserve(static_cast<size_t>(reader.getTotalFrames()) * channels);
+    const size_t chunkFrames = 16384;
+    size_t frames = 0;
+    for (;;)
+    {
+        if (cancel != nullptr && *cancel)
+        {
+            samples.clear();
+            return false;
+        }
+        samples.resize((frames + chunkFrames) * channels);
+        size_t read = reader.read(samples.data() + frames * channels, chunkFrames);
+        frames += read;
+        if (read < chunkFrames)
+        {
+            break;
+        }
+    }
+    samples.resize(frames * channels);
+    return frames > 0;
+}
+
+std::string AudioFileReader::getSeekTablePath(const std::string& filePath)
+{
+    return filePath + ".seek";
+}
+
+bool AudioFileReader::loadSeekTable(const std::string& filePath)
+{
+    std::ifstream stream(ofToDataPath(getSeekTablePath(filePath)), std::ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t fileSize = 0;
+    uint64_t totalFrames = 0;
+    uint32_t count = 0;
+    stream.read(magic, sizeof(magic));
+    if (!stream.good() || std::memcmp(magic, SEEK_TABLE_MAGIC, sizeof(magic)) != 0
+        || !readValue(stream, version) || version != SEEK_TABLE_VERSION
+        || !readValue(stream, fileSize) || !readValue(stream, totalFrames) || !readValue(stream, count)
+        || count > MAX_SEEK_POINTS)
+    {
+        return false;
+    }
+    // the audio file was replaced since the table was written
+    if (fileSize != ofFile(filePath, ofFile::Reference).getSize())
+    {
+        return false;
+    }
+
+    std::vector<drmp3_seek_point> points(count);
+    for (auto& point : points)
+    {
+        if (!readValue(stream, point.seekPosInBytes) || !readValue(stream, point.pcmFrameIndex)
+            || !readValue(stream, point.mp3FramesToDiscard) || !readValue(stream, point.pcmFramesToDiscard))
+        {
+            return false;
+        }
+    }
+    m_seekPoints = std::move(points);
+    m_totalFrames = totalFrames;
+    return true;
+}
+
+bool AudioFileReader::saveSeekTable(const std::string& filePath) const
+{
+    std::ofstream stream(ofToDataPath(getSeekTablePath(filePath)), std::ios::binary | std::ios::trunc);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+    stream.write(SEEK_TABLE_MAGIC, sizeof(SEEK_TABLE_MAGIC));
+    writeValue<uint32_t>(stream, SEEK_TABLE_VERSION);
+    writeValue<uint64_t>(stream, ofFile(filePath, ofFile::Reference).getSize());
+    writeValue<uint64_t>(stream, m_totalFrames);
+    writeValue<uint32_t>(stream, static_cast<uint32_t>(m_seekPoints.size()));
+    for (const auto& point : m_seekPoints)
+    {
+        writeValue<uint64_t>(stream, point.seekPosInBytes);
+        writeValue<uint64_t>(stream, point.pcmFrameIndex);
+        writeValue<uint16_t>(stream, point.mp3FramesToDiscard);
+        writeValue<uint16_t>(stream, point.pcmFramesToDiscard);
+    }
+    return stream.good();
+}
+
+void AudioFileReader::buildSeekTable(const std::string& filePath)
+{
+    // one pass over the frame headers, done once per file
+    uint64_t startTime = ofGetElapsedTimeMillis();
+    m_totalFrames = drmp3_get_pcm_frame_count(&m_mp3);
+
+    drmp3_uint32 count = MAX_SEEK_POINTS;
+    m_seekPoints.resize(count);
+    if (!drmp3_calculate_seek_points(&m_mp3, &count, m_seekPoints.data()))
+    {
+        ofLogError() << "could not index " << filePath;
+        m_seekPoints.clear();
+        return;
+    }
+    m_seekPoints.resize(count);
+    ofLog() << "indexed " << filePath << " (" << count << " seek points) in " << (ofGetElapsedTimeMillis() - startTime) << " ms";
+
+    if (!saveSeekTable(filePath))
+    {
+        ofLogError() << "could not write " << getSeekTablePath(filePath);
+    }
+}
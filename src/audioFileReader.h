@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dr_flac.h"
+#include "dr_mp3.h"
+#include "dr_wav.h"
+
+// Incremental decoder for the stem formats (wav, flac, mp3), built on the dr_libs
+// shipped with ofxAudioFile.
+// mp3 has no index of its frames: seeking means decoding from the start of the file.
+// A seek table (one point every few hundred ms) is computed the first time a file is
+// opened and saved next to it (<file>.seek), so positioning only decodes a few frames.
+// flac files use their own SEEKTABLE, wav files are seeked directly.
+class AudioFileReader {
+public:
+    AudioFileReader();
+    virtual ~AudioFileReader();
+
+    bool open(const std::string& filePath);
+    void close();
+    bool isOpen() const;
+
+    unsigned int getChannels() const;
+    unsigned int getSampleRate() const;
+    uint64_t getTotalFrames() const;
+    // resolution of the source: 16 or less can be stored as int16 without loss. 32 for float files
+    unsigned int getBitsPerSample() const;
+    bool hasSeekTable() const;
+
+    // interleaved frames, returns the number of frames read (0 at end of file)
+    size_t read(float* output, size_t frames);
+    bool seek(uint64_t frame);
+
+    // decode a whole file in memory. cancel: checked between chunks, false once set
+    static bool decodeFile(const std::string& filePath, std::vector<float>& samples, unsigned int& channels, unsigned int& sampleRate, unsigned int& bitsPerSample,
+        const std::atomic<bool>* cancel = nullptr);
+
+    static std::string getSeekTablePath(const std::string& filePath);
+
+private:
+    enum class Format {
+        NONE,
+        WAV,
+        MP3,
+        FLAC
+    };
+
+    bool loadSeekTable(const std::string& filePath);
+    bool saveSeekTable(const std::string& filePath) const;
+    void buildSeekTable(const std::string& filePath);
+
+    Format m_format = Format::NONE;
+    drwav m_wav;
+    drmp3 m_mp3;
+    drflac* m_flac = nullptr;
+    std::vector<drmp3_seek_point> m_seekPoints;
+    unsigned int m_channels = 0;
+    unsigned int m_sampleRate = 0;
+    unsigned int m_bitsPerSample = 0;
+    uint64_t m_totalFrames = 0;
+};
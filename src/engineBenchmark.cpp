@@ -0,0 +1,503 @@
+#include "engineBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+
+#include "ofMain.h"
+#include "ofxXmlSettings.h"
+#include "metronome.h"
+#include "midiOutput.h"
+#include "nullAudioDriver.h"
+#include "resampler.h"
+#include "retireQueue.h"
+#include "song.h"
+#include "stemMixer.h"
+#include "stemPlayer.h"
+#include "transport.h"
+#include "volumesDb.h"
+
+namespace {
+    // distinct buffers, so that the players do not all read the same cache lines
+    const unsigned int DISTINCT_STEMS = 16;
+    const double STEM_SECONDS = 8.0;
+
+    std::shared_ptr<const AudioData> makeSyntheticStem(unsigned int index, unsigned int sampleRate)
+    {
+        auto data = std::make_shared<AudioData>();
+        data->channels = 2;
+        data->sampleRate = sampleRate;
+        data->frames = static_cast<size_t>(STEM_SECONDS * sampleRate);
+        data->samples.resize(data->frames * data->channels);
+        float frequency = 55.0f * (index + 1);
+        uint32_t noise = 22222 + index;
+        for (size_t i = 0; i < data->frames; i++)
+        {
+            noise = noise * 1664525u + 1013904223u;
+            float sine = 0.2f * sin(TWO_PI * frequency * i / sampleRate);
+            data->samples[2 * i] = sine;
+            data->samples[2 * i + 1] = sine + 0.01f * (static_cast<int32_t>(noise) / 2147483648.0f);
+        }
+        return data;
+    }
+
+    // clicks of the sync check, one per stem
+    const uint64_t FIRST_CLICK_FRAME = 20000;
+    const uint64_t CLICK_SPACING = 2000;
+
+    // keeps the left channel of every buffer it passes
+    class CaptureProcessor : public ofxSoundObject {
+    public:
+        CaptureProcessor() : ofxSoundObject(OFX_SOUND_OBJECT_PROCESSOR)
+        {
+            setName("Capture");
+        }
+
+        void process(ofSoundBuffer& input, ofSoundBuffer& output) override
+        {
+            output = input;
+            for (size_t i = 0; i < output.getNumFrames(); i++)
+            {
+                left.push_back(output[i * output.getNumChannels()]);
+            }
+        }
+
+        std::vector<float> left;
+    };
+
+    // best time of the runs, in ms
+    double timeBestMs(unsigned int runs, const std::function<void()>& run)
+    {
+        double best = 0.0;
+        for (unsigned int i = 0; i < runs; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            run();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best = i == 0 ? ms : std::min(best, ms);
+        }
+        return best;
+    }
+} // unnamed namespace
+
+void runEngineBenchmark(const EngineBenchmarkConfig& config)
+{
+    std::vector<std::shared_ptr<const AudioData>> stems;
+    for (unsigned int i = 0; i < DISTINCT_STEMS; i++)
+    {
+        stems.push_back(makeSyntheticStem(i, config.sampleRate));
+    }
+
+    // one part, the metronome ticks for the whole run
+    songEvent part;
+    part.tick = 0;
+    part.bpm = 120;
+    part.program = 0;
+    auto song = std::make_shared<const Song>(std::vector<songEvent>{part});
+
+    // virtual ports where the midi api has them, the clock is then really sent
+    std::vector<std::shared_ptr<MidiOutput>> midiOuts;
+    for (unsigned int i = 0; i < config.midiOutputs; i++)
+    {
+        auto midiOut = std::make_shared<MidiOutput>(i, "benchmark " + ofToString(i), i, "", "bench");
+        midiOut->_midiOut.openVirtualPort("Tonton benchmark " + ofToString(i));
+        midiOut->sendTicks = true;
+        midiOuts.push_back(midiOut);
+    }
+
+    ofLog() << "engine benchmark: " << config.sampleRate << " Hz, " << config.midiOutputs << " midi outputs"
+            << (midiOuts.size() > 0 && !midiOuts[0]->isOpen() ? " (not opened, clock not sent)" : "");
+    ofLog() << "stems  buffer     ns/frame   mean buffer us   worst buffer us   budget us   load %";
+
+    for (unsigned int stemCount : config.stemCounts)
+    {
+        for (unsigned int bufferSize : config.bufferSizes)
+        {
+            StemMixer mixer;
+            Metronome metronome;
+            Transport transport;
+            std::vector<std::unique_ptr<StemPlayer>> players;
+            for (unsigned int i = 0; i < stemCount; i++)
+            {
+                players.push_back(std::make_unique<StemPlayer>());
+                players[i]->setLoop(true);
+                players[i]->setAudioData(stems[i % stems.size()]);
+                players[i]->setTransport(&transport);
+                mixer.addTrack(players[i].get(), {1.0f});
+                mixer.setConnectionVolume(i, 0.5f);
+            }
+            mixer.setMasterVolume(1.0f);
+            metronome.setMidiOuts(midiOuts);
+            metronome.setNewSong(song);
+            metronome.setSampleRate(config.sampleRate);
+            metronome.setTransport(&transport);
+            mixer.connectTo(metronome).connectTo(transport);
+
+            NullAudioDriver driver;
+            driver.setup(transport, config.sampleRate, 2, bufferSize, NullAudioDriver::Mode::MAX_SPEED);
+            transport.play(0);
+            driver.run(64);  // warm up caches and apply the start
+            driver.resetStats();
+            driver.run(static_cast<uint64_t>(config.secondsPerRun * config.sampleRate / bufferSize));
+
+            AudioDriverStats stats = driver.getStats();
+            double budgetUs = 1e6 * bufferSize / config.sampleRate;
+            std::stringstream line;
+            line << std::fixed << std::setprecision(1)
+                 << std::setw(5) << stemCount << std::setw(8) << bufferSize
+                 << std::setw(13) << stats.nsPerFrame
+                 << std::setw(17) << stats.meanBufferNs / 1000.0
+                 << std::setw(18) << stats.worstBufferNs / 1000.0
+                 << std::setw(12) << budgetUs
+                 << std::setw(9) << 100.0 * stats.meanBufferNs / 1000.0 / budgetUs;
+            ofLog() << line.str();
+
+            mixer.clearTracks();
+            players.clear();
+            Tonton::Utils::RetireQueue::collect();
+        }
+    }
+}
+
+bool runSyncCheck(const SyncCheckConfig& config)
+{
+    std::vector<std::shared_ptr<const AudioData>> stems;
+    for (unsigned int i = 0; i < config.stemCount; i++)
+    {
+        auto data = std::make_shared<AudioData>();
+        data->channels = 1;
+        data->sampleRate = config.sampleRate;
+        data->frames = static_cast<size_t>(FIRST_CLICK_FRAME + config.stemCount * CLICK_SPACING + config.sampleRate);
+        data->samples.resize(data->frames, 0.0f);
+        data->samples[FIRST_CLICK_FRAME + i * CLICK_SPACING] = 1.0f;
+        stems.push_back(data);
+    }
+
+    ofLog() << "sync check: " << config.stemCount << " stems, " << config.sampleRate << " Hz";
+    ofLog() << "buffer   seek frame   clicks   start latency frames   spread frames";
+    bool passed = true;
+    for (unsigned int bufferSize : config.bufferSizes)
+    {
+        for (uint64_t seekFrame : config.seekFrames)
+        {
+            StemMixer mixer;
+            CaptureProcessor capture;
+            Transport transport;
+            std::vector<std::unique_ptr<StemPlayer>> players;
+            for (unsigned int i = 0; i < config.stemCount; i++)
+            {
+                players.push_back(std::make_unique<StemPlayer>());
+                players[i]->setAudioData(stems[i]);
+            }
+            for (unsigned int i = 0; i + 1 < config.stemCount; i++)
+            {
+                players[i]->setTransport(&transport);
+                mixer.addTrack(players[i].get(), {1.0f});
+            }
+            mixer.connectTo(capture).connectTo(transport);
+
+            // playing over the last click: a stem that would apply this command after it is
+            // attached plays the click once more
+            uint64_t lastClick = FIRST_CLICK_FRAME + (config.stemCount - 1) * CLICK_SPACING;
+            NullAudioDriver driver;
+            driver.setup(transport, config.sampleRate, 2, bufferSize, NullAudioDriver::Mode::MAX_SPEED);
+            transport.play(lastClick - bufferSize / 2);
+            driver.run(4);
+
+            // the seek is armed, the last stem is attached before it is latched
+            capture.left.clear();
+            transport.play(seekFrame);
+            players.back()->setTransport(&transport);
+            mixer.addTrack(players.back().get(), {1.0f});
+            driver.run((lastClick - seekFrame) / bufferSize + 3);
+
+            // distance of every click from where its frame would be if the seek applied at once
+            std::vector<int64_t> offsets;
+            for (size_t i = 0; i < capture.left.size(); i++)
+            {
+                if (fabs(capture.left[i]) > 0.01f)
+                {
+                    uint64_t clickFrame = FIRST_CLICK_FRAME + (offsets.size() % config.stemCount) * CLICK_SPACING;
+                    offsets.push_back(static_cast<int64_t>(i) - static_cast<int64_t>(clickFrame - seekFrame));
+                }
+            }
+            int64_t latency = offsets.empty() ? 0 : *std::min_element(offsets.begin(), offsets.end());
+            int64_t spread = offsets.empty() ? 0 : *std::max_element(offsets.begin(), offsets.end()) - latency;
+
+            std::stringstream line;
+            line << std::setw(6) << bufferSize << std::setw(13) << seekFrame
+                 << std::setw(6) << offsets.size() << "/" << config.stemCount
+                 << std::setw(23) << latency << std::setw(16) << spread;
+            ofLog() << line.str();
+            if (offsets.size() != config.stemCount || spread != 0)
+            {
+                ofLogError() << "buffer " << bufferSize << ", seek to " << seekFrame << ": " << offsets.size()
+                             << " clicks out of " << config.stemCount << ", " << spread << " frames between the stems";
+                passed = false;
+            }
+
+            mixer.clearTracks();
+            players.clear();
+            Tonton::Utils::RetireQueue::collect();
+        }
+    }
+    return passed;
+}
+
+void runSilenceBenchmark(const SilenceBenchmarkConfig& config)
+{
+    ofDirectory songsDir(config.songsRootDir);
+    songsDir.listDir();
+    songsDir.sort();
+
+    ofLog() << "silence benchmark: " << config.sampleRate << " Hz, buffer " << config.bufferSize;
+    ofLog() << "song                              tracks   silent %   ns/frame full   ns/frame skip   saved %";
+    for (size_t s = 0; s < songsDir.size(); s++)
+    {
+        if (!ofDirectory::doesDirectoryExist(songsDir.getPath(s) + "/audio"))
+        {
+            continue;
+        }
+        ofDirectory audioDir;
+        audioDir.allowExt("wav");
+        audioDir.allowExt("flac");
+        audioDir.allowExt("mp3");
+        audioDir.listDir(songsDir.getPath(s) + "/audio");
+        if (audioDir.size() == 0)
+        {
+            continue;
+        }
+
+        std::vector<std::shared_ptr<const AudioData>> tracks;
+        uint64_t frames = 0;
+        double silentRatio = 0.0;
+        for (size_t t = 0; t < audioDir.size(); t++)
+        {
+            auto data = StemPlayer::decode(audioDir.getPath(t), config.sampleRate);
+            if (data != nullptr)
+            {
+                frames = std::max<uint64_t>(frames, data->frames);
+                silentRatio += data->silence.getSilentRatio();
+                tracks.push_back(data);
+            }
+        }
+        if (tracks.empty())
+        {
+            continue;
+        }
+        silentRatio /= tracks.size();
+
+        // the same song, every block mixed then silent blocks skipped
+        double nsPerFrame[2];
+        for (int skip = 0; skip < 2; skip++)
+        {
+            StemMixer mixer;
+            Transport transport;
+            std::vector<std::unique_ptr<StemPlayer>> players;
+            for (size_t t = 0; t < tracks.size(); t++)
+            {
+                players.push_back(std::make_unique<StemPlayer>());
+                players[t]->setAudioData(tracks[t]);
+                players[t]->setTransport(&transport);
+                players[t]->setSkipSilence(skip == 1);
+                mixer.addTrack(players[t].get(), {1.0f});
+                mixer.setConnectionVolume(t, 0.5f);
+            }
+            mixer.connectTo(transport);
+
+            NullAudioDriver driver;
+            driver.setup(transport, config.sampleRate, 2, config.bufferSize, NullAudioDriver::Mode::MAX_SPEED);
+            transport.play(0);
+            driver.run(1);  // apply the start
+            driver.resetStats();
+            driver.run(frames / config.bufferSize);
+            nsPerFrame[skip] = driver.getStats().nsPerFrame;
+            mixer.clearTracks();
+            players.clear();
+            Tonton::Utils::RetireQueue::collect();
+        }
+
+        std::string songName = songsDir.getName(s);
+        std::stringstream line;
+        line << std::fixed << std::setprecision(1)
+             << std::left << std::setw(34) << songName.substr(0, 32) << std::right
+             << std::setw(6) << tracks.size()
+             << std::setw(11) << 100.0 * silentRatio
+             << std::setw(16) << nsPerFrame[0]
+             << std::setw(16) << nsPerFrame[1]
+             << std::setw(10) << (nsPerFrame[0] > 0.0 ? 100.0 * (1.0 - nsPerFrame[1] / nsPerFrame[0]) : 0.0);
+        ofLog() << line.str();
+    }
+}
+
+void runParserBenchmark(const ParserBenchmarkConfig& config)
+{
+    // a song of the songs root directory, as the app reads it
+    const std::string songName = "parser";
+    ofDirectory::createDirectory(config.directory + songName, true, true);
+    std::string structurePath = ofToDataPath(config.directory + songName + "/structure.xml");
+    std::string tracksPath = ofToDataPath(config.directory + songName + "/tracks.xml");
+
+    // elektron patterns for every output, each part changes two of them
+    std::vector<std::shared_ptr<MidiOutput>> midiOuts;
+    for (unsigned int i = 0; i < config.midiOutputs; i++)
+    {
+        auto midiOut = std::make_shared<MidiOutput>(i, "Output" + ofToString(i), i, "", "out" + ofToString(i));
+        midiOut->_patchFormat = PatchFormat::ELEKTRON_PATTERN;
+        midiOuts.push_back(midiOut);
+    }
+    const char* shaders[] = {"flashes", "spiral", "tunnel"};
+    std::ofstream structure(structurePath);
+    structure << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n<structure>\n\t<songparts>\n";
+    for (unsigned int part = 0; part < config.partCount; part++)
+    {
+        structure << "\t\t<songpart>\n"
+                  << "\t\t\t<desc>Part " << part << "</desc>\n"
+                  << "\t\t\t<bpm>" << 90 + part % 60 << "</bpm>\n"
+                  << "\t\t\t<length>" << 16 + 16 * (part % 4) << "</length>\n"
+                  << "\t\t\t<patches>\n";
+        for (unsigned int output = part % 2; output < config.midiOutputs; output += 2)
+        {
+            structure << "\t\t\t\t<Output" << output << ">" << static_cast<char>('A' + part % 8)
+                      << std::setw(2) << std::setfill('0') << 1 + part % 16 << std::setfill(' ')
+                      << "</Output" << output << ">\n";
+        }
+        structure << "\t\t\t</patches>\n"
+                  << "\t\t\t<shader>" << shaders[part % 3] << "</shader>\n"
+                  << "\t\t</songpart>\n";
+    }
+    structure << "\t</songparts>\n</structure>\n";
+    structure.close();
+
+    std::vector<std::pair<std::string, float>> volumes;
+    std::ofstream tracks(tracksPath);
+    tracks << "<tracks>\n";
+    for (unsigned int track = 0; track < config.partCount; track++)
+    {
+        std::string file = "audio/track" + ofToString(track) + ".wav";
+        tracks << "\t<track file=\"" << file << "\" volume=\"" << track % 101 << "\"/>\n";
+        volumes.emplace_back(file, 1.0f);
+    }
+    tracks << "</tracks>\n";
+    tracks.close();
+
+    ofLog() << "parser benchmark: " << config.partCount << " parts and tracks, " << config.midiOutputs
+            << " midi outputs, best of " << config.runs << " runs";
+
+    // the tree alone, what ofxXmlSettings costs before any lookup
+    double domStructureMs = timeBestMs(config.runs, [&]() {
+        ofxXmlSettings settings;
+        settings.load(structurePath);
+    });
+    double domTracksMs = timeBestMs(config.runs, [&]() {
+        ofxXmlSettings settings;
+        settings.load(tracksPath);
+    });
+
+    size_t parts = 0;
+    std::vector<std::string> problems;
+    double pullStructureMs = timeBestMs(config.runs, [&]() {
+        problems.clear();
+        parts = loadSongStructure(structurePath, midiOuts, &problems).size();
+    });
+    size_t storedTracks = 0;
+    double pullTracksMs = timeBestMs(config.runs, [&]() {
+        for (auto& volume : volumes)
+        {
+            volume.second = -1.0f;
+        }
+        VolumesDb::getStoredSongVolumes(config.directory, songName, volumes);
+        storedTracks = std::count_if(volumes.begin(), volumes.end(), [](const std::pair<std::string, float>& volume) {
+            return volume.second >= 0.0f;
+        });
+    });
+
+    ofLog() << "file            items   ofxXmlSettings load ms   reader ms   speedup";
+    auto printLine = [&config](const std::string& name, size_t items, double domMs, double pullMs) {
+        std::stringstream line;
+        line << std::fixed << std::setprecision(1)
+             << std::left << std::setw(14) << name << std::right
+             << std::setw(7) << items << (items == config.partCount ? " " : "!")
+             << std::setw(24) << domMs
+             << std::setw(12) << pullMs
+             << std::setw(9) << (pullMs > 0.0 ? domMs / pullMs : 0.0) << "x";
+        ofLog() << line.str();
+    };
+    printLine("structure.xml", parts, domStructureMs, pullStructureMs);
+    printLine("tracks.xml", storedTracks, domTracksMs, pullTracksMs);
+    if (!problems.empty())
+    {
+        ofLogWarning() << problems.size() << " problems in the generated structure, first: " << problems[0];
+    }
+}
+
+bool runResamplerBenchmark(const ResamplerBenchmarkConfig& config)
+{
+    ofLog() << "resampler benchmark: " << config.channels << " channels, " << config.seconds << " s, best of " << config.runs << " runs";
+    ofLog() << "rates              Hz   snr dB   Mframes/s";
+    bool passed = true;
+    for (const auto& rates : config.ratePairs)
+    {
+        unsigned int inputRate = rates.first;
+        unsigned int outputRate = rates.second;
+        size_t inputFrames = static_cast<size_t>(config.seconds * inputRate);
+        for (double frequency : config.frequencies)
+        {
+            std::vector<float> input(inputFrames * config.channels);
+            for (size_t i = 0; i < inputFrames; i++)
+            {
+                float sine = 0.5f * static_cast<float>(sin(2.0 * PI * frequency * i / inputRate));
+                for (unsigned int c = 0; c < config.channels; c++)
+                {
+                    input[i * config.channels + c] = sine;
+                }
+            }
+
+            std::vector<float> output;
+            double ms = timeBestMs(config.runs, [&]() {
+                output = Tonton::Utils::Resampler::resample(input.data(), inputFrames, config.channels, inputRate, outputRate);
+            });
+
+            // the filter sees silence before the first and after the last frame: skip 10 ms at each end
+            size_t outputFrames = output.size() / config.channels;
+            size_t margin = outputRate / 100;
+            double signal = 0.0;
+            double error = 0.0;
+            for (size_t i = margin; i + margin < outputFrames; i++)
+            {
+                double reference = 0.5 * sin(2.0 * PI * frequency * i / outputRate);
+                for (unsigned int c = 0; c < config.channels; c++)
+                {
+                    double difference = output[i * config.channels + c] - reference;
+                    signal += reference * reference;
+                    error += difference * difference;
+                }
+            }
+            double snrDb = error > 0.0 ? 10.0 * log10(signal / error) : 200.0;
+            double framesPerSecond = ms > 0.0 ? inputFrames / (ms / 1000.0) : 0.0;
+
+            std::stringstream line;
+            line << std::fixed << std::setprecision(1)
+                 << std::setw(6) << inputRate << " > " << std::setw(6) << outputRate
+                 << std::setw(7) << frequency
+                 << std::setw(9) << snrDb
+                 << std::setw(12) << framesPerSecond / 1e6;
+            if (outputFrames != (inputFrames * outputRate + inputRate - 1) / inputRate)
+            {
+                line << "   " << outputFrames << " frames out of " << inputFrames;
+                passed = false;
+            }
+            ofLog() << line.str();
+            if (snrDb < config.minSnrDb)
+            {
+                ofLogError() << inputRate << " > " << outputRate << " at " << frequency << " Hz: " << snrDb << " dB, below " << config.minSnrDb;
+                passed = false;
+            }
+        }
+    }
+    return passed;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Cost of the whole audio graph (stem players, mixer, metronome and its midi outputs),
+// driven by the null audio driver at maximum speed: no sound card needed.
+// Prints the mean time per frame and the worst buffer for every stem count / buffer size.
+struct EngineBenchmarkConfig {
+    std::vector<unsigned int> stemCounts = {16, 32, 64, 128};
+    std::vector<unsigned int> bufferSizes = {64, 128, 256, 512};
+    unsigned int midiOutputs = 4;
+    unsigned int sampleRate = 48000;
+    double secondsPerRun = 5.0;  // audio duration pulled for each configuration
+};
+
+void runEngineBenchmark(const EngineBenchmarkConfig& config);
+
+// Offset between the stems after a start or a seek, on the null audio driver: every stem
+// holds one click at its own frame, and the clicks must come out of the mix at the same
+// distance from their frame. One stem is attached after the seek is armed, like a track
+// added while a song plays. Prints the offset spread for every buffer size / seek frame.
+struct SyncCheckConfig {
+    unsigned int stemCount = 16;
+    std::vector<unsigned int> bufferSizes = {64, 256, 1024};
+    std::vector<uint64_t> seekFrames = {0, 12345, 19999};  // before the first click
+    unsigned int sampleRate = 48000;
+};
+
+// false when a click is missing or the stems are not on the same sample
+bool runSyncCheck(const SyncCheckConfig& config);
+
+// Cost of the real songs with and without skipping the silent blocks of their tracks:
+// every song of songsRootDir is decoded and played from start to end through the mixer,
+// on the null audio driver. Prints the silent share of the tracks and the time saved.
+struct SilenceBenchmarkConfig {
+    std::string songsRootDir = "songs/";
+    unsigned int sampleRate = 48000;
+    unsigned int bufferSize = 256;
+};
+
+void runSilenceBenchmark(const SilenceBenchmarkConfig& config);
+
+// Time to read the xml files of a song with the readers of the app, loadSongStructure and
+// VolumesDb, against loading the same file in an ofxXmlSettings tree without any lookup. A song
+// with a structure.xml of partCount parts and a tracks.xml of as many tracks is generated in
+// directory. Prints the best time of the runs.
+struct ParserBenchmarkConfig {
+    unsigned int partCount = 10000;
+    unsigned int midiOutputs = 4;
+    unsigned int runs = 5;
+    std::string directory = "benchmark/";
+};
+
+void runParserBenchmark(const ParserBenchmarkConfig& config);
+
+// Quality and speed of the resampler used when a track's rate differs from the output's:
+// a sine is converted for every rate pair and compared with the same sine computed at the
+// output rate, away from the edges. Prints the signal to error ratio and the frames per
+// second, and an error for the pairs below minSnrDb.
+struct ResamplerBenchmarkConfig {
+    std::vector<std::pair<unsigned int, unsigned int>> ratePairs = {{44100, 48000}, {48000, 44100}, {22050, 48000}, {96000, 48000}};
+    std::vector<double> frequencies = {100.0, 1000.0, 8000.0};
+    unsigned int channels = 2;
+    double seconds = 10.0;
+    unsigned int runs = 5;
+    double minSnrDb = 80.0;
+};
+
+// false when a pair is below minSnrDb
+bool runResamplerBenchmark(const ResamplerBenchmarkConfig& config);
@@ -3,8 +3,57 @@
 #include "ofAppGLFWWindow.h"
 #include "ofxXmlSettings.h"
 
+#include "engineBenchmark.h"
+#include "trace.h"
+
 //========================================================================
-int main() {
+int main(int argc, char* argv[]) {
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--benchmark")
+		{
+			// headless: no window, no sound card
+			runEngineBenchmark(EngineBenchmarkConfig());
+			return 0;
+		}
+		if (std::string(argv[i]) == "--benchmark-silence")
+		{
+			// the songs of settings.xml, headless
+			ofxXmlSettings benchmarkSettings;
+			benchmarkSettings.load("settings.xml");
+			SilenceBenchmarkConfig config;
+			config.songsRootDir = benchmarkSettings.getValue("settings:songs_root_dir", config.songsRootDir);
+			runSilenceBenchmark(config);
+			return 0;
+		}
+		if (std::string(argv[i]) == "--benchmark-parser")
+		{
+			// generated files, headless
+			runParserBenchmark(ParserBenchmarkConfig());
+			return 0;
+		}
+		if (std::string(argv[i]) == "--benchmark-sync")
+		{
+			// synthetic clicks, headless. exit code 1 when the stems are not on the same sample
+			return runSyncCheck(SyncCheckConfig()) ? 0 : 1;
+		}
+		if (std::string(argv[i]) == "--benchmark-resampler")
+		{
+			// generated sines, headless. exit code 1 when the quality is too low
+			return runResamplerBenchmark(ResamplerBenchmarkConfig()) ? 0 : 1;
+		}
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--trace")
+		{
+			// chrome trace of the startup and of every song load, next to settings.xml
+			std::string tracePath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[i + 1] : "trace.json";
+			Tonton::Utils::Trace::start(ofToDataPath(tracePath, true));
+		}
+	}
 
 	ofGLFWWindowSettings settings;
     settings.glVersionMajor = 3;
@@ -20,9 +69,20 @@ int main() {
 	settings.windowMode = OF_WINDOW;
 	settings.monitor = 1;
 	settings.title = "Tonton Media Player";
-	shared_ptr<ofAppBaseWindow> dawWindow = ofCreateWindow(settings);
+	shared_ptr<ofAppBaseWindow> dawWindow;
+	{
+		Tonton::Utils::TraceScope trace("window create");
+		dawWindow = ofCreateWindow(settings);
+	}
 
 	shared_ptr<ofApp> mainApp(new ofApp);
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--render")
+		{
+			mainApp->m_renderSetlistAndExit = true;
+		}
+	}
 
 	// secondary window (mapping)
 	if (xmlSettings.getValue("settings:show_video_window", 1) == 1)
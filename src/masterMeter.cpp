@@ -0,0 +1,25 @@
+#include "masterMeter.h"
+
+MasterMeter::MasterMeter():ofxSoundObject(OFX_SOUND_OBJECT_PROCESSOR) {
+    setName("MasterMeter");
+}
+
+MasterMeter::~MasterMeter() {
+
+}
+
+void MasterMeter::setSampleRate(unsigned int sampleRate)
+{
+    m_meter.setup(sampleRate);
+}
+
+void MasterMeter::process(ofSoundBuffer& input, ofSoundBuffer& output)
+{
+    output = input;
+    m_meter.analyze(output.getBuffer().data(), output.size(), output.getNumChannels());
+}
+
+Tonton::Utils::LevelMeter& MasterMeter::getMeter()
+{
+    return m_meter;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ofxSoundObject.h"
+
+#include "levelMeter.h"
+
+// pass-through processor measuring the level sent to the sound card
+class MasterMeter : public ofxSoundObject {
+public:
+    MasterMeter();
+    virtual ~MasterMeter();
+
+    void setSampleRate(unsigned int sampleRate);
+    void process(ofSoundBuffer& input, ofSoundBuffer& output) override;
+
+    Tonton::Utils::LevelMeter& getMeter();
+
+private:
+    Tonton::Utils::LevelMeter m_meter;
+};
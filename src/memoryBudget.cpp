@@ -0,0 +1,76 @@
+#include "memoryBudget.h"
+
+void MemoryBudget::setLimit(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_limit = bytes;
+}
+
+uint64_t MemoryBudget::getLimit() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limit;
+}
+
+void MemoryBudget::setUsage(const std::string& owner, Category category, uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto entry = m_usage.find(owner);
+    if (entry == m_usage.end())
+    {
+        entry = m_usage.emplace(owner, std::array<uint64_t, CATEGORY_COUNT>()).first;
+        entry->second.fill(0);
+    }
+    entry->second[category] = bytes;
+}
+
+void MemoryBudget::release(const std::string& owner, Category category)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto entry = m_usage.find(owner);
+    if (entry == m_usage.end())
+    {
+        return;
+    }
+    entry->second[category] = 0;
+    for (uint64_t bytes : entry->second)
+    {
+        if (bytes > 0)
+        {
+            return;
+        }
+    }
+    m_usage.erase(entry);
+}
+
+uint64_t MemoryBudget::getUsage() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t total = 0;
+    for (const auto& entry : m_usage)
+    {
+        for (uint64_t bytes : entry.second)
+        {
+            total += bytes;
+        }
+    }
+    return total;
+}
+
+uint64_t MemoryBudget::getUsage(Category category) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t total = 0;
+    for (const auto& entry : m_usage)
+    {
+        total += entry.second[category];
+    }
+    return total;
+}
+
+uint64_t MemoryBudget::getExcess() const
+{
+    uint64_t usage = getUsage();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return usage > m_limit ? usage - m_limit : 0;
+}
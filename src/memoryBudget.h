@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Memory used by the media of the setlist, in bytes, accounted per owner
+// (a song for its decoded tracks, the video clip, the mapping textures).
+// The limit comes from settings.xml (<memory_budget_mb>). The budget only counts,
+// the song cache evicts its songs to stay below the limit. Any thread.
+class MemoryBudget {
+public:
+    enum Category {
+        AUDIO,
+        VIDEO,
+        TEXTURES,
+        CATEGORY_COUNT
+    };
+
+    void setLimit(uint64_t bytes);
+    uint64_t getLimit() const;
+
+    // replaces the previous usage of the owner in the category
+    void setUsage(const std::string& owner, Category category, uint64_t bytes);
+    void release(const std::string& owner, Category category);
+
+    uint64_t getUsage() const;
+    uint64_t getUsage(Category category) const;
+    // bytes above the limit, 0 within the budget
+    uint64_t getExcess() const;
+
+private:
+    mutable std::mutex m_mutex;
+    uint64_t m_limit = 0;
+    std::map<std::string, std::array<uint64_t, CATEGORY_COUNT>> m_usage;
+};
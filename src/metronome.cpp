@@ -1,9 +1,35 @@
 #include "metronome.h"
 
+#include "retireQueue.h"
+
+namespace {
+    // bars are counted from the start of each part, as in getBarStartBeats
+    const long CLICK_BEATS_PER_BAR = 4;
+    const double CLICK_LENGTH_SECONDS = 0.04;
+    const double CLICK_DECAY_SECONDS = 0.008;
+    const double CLICK_ATTACK_SECONDS = 0.0005;
+
+    // sine burst with a short attack and an exponential decay, faded out at the end
+    std::vector<float> makeClickSound(unsigned int sampleRate, double frequency, float gain)
+    {
+        size_t length = static_cast<size_t>(CLICK_LENGTH_SECONDS * sampleRate);
+        std::vector<float> sound(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            double t = static_cast<double>(i) / sampleRate;
+            double envelope = std::exp(-t / CLICK_DECAY_SECONDS) * std::min(1.0, t / CLICK_ATTACK_SECONDS);
+            envelope *= static_cast<double>(length - i) / length;
+            sound[i] = static_cast<float>(gain * envelope * std::sin(TWO_PI * frequency * t));
+        }
+        return sound;
+    }
+} // unnamed namespace
+
 Metronome::Metronome():ofxSoundObject(OFX_SOUND_OBJECT_PROCESSOR) {
     setName("Metronome");
 
 	m_ticksPerBeat = 24;
+	buildClickSounds();
 }
 
 void Metronome::setMidiOuts(std::vector<std::shared_ptr<MidiOutput>>& midiOuts) {
@@ -25,6 +51,106 @@ void Metronome::setNbIgnoredStartupsTicks(int nbIgnoredStartupTicks)
 void Metronome::setSampleRate(unsigned int sampleRate)
 {
     m_sampleRate = sampleRate;
+    m_samplesPerTick = 0;
+    updateSamplesPerTick(*std::atomic_load(&m_song));
+    buildClickSounds();
+}
+
+void Metronome::setMidiRecorder(MidiRecorder* recorder)
+{
+    m_midiRecorder = recorder;
+}
+
+void Metronome::setClickEnabled(bool enabled)
+{
+    m_clickEnabled = enabled;
+}
+
+bool Metronome::isClickEnabled() const
+{
+    return m_clickEnabled;
+}
+
+void Metronome::setClickVolume(float volume)
+{
+    m_clickVolume = volume;
+}
+
+void Metronome::setClickOutput(int leftChannel, int rightChannel)
+{
+    m_clickLeftChannel = leftChannel;
+    m_clickRightChannel = rightChannel;
+}
+
+void Metronome::buildClickSounds()
+{
+    // the audio thread picks the new sounds up once the click being played is over
+    auto sounds = std::make_shared<ClickSounds>();
+    sounds->accent = makeClickSound(m_sampleRate, 2000.0, 1.0f);
+    sounds->beat = makeClickSound(m_sampleRate, 1000.0, 0.6f);
+    Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_clickSounds, std::shared_ptr<const ClickSounds>(sounds)));
+}
+
+void Metronome::startClick(long tickCount)
+{
+    const Song& song = *m_playingSong;
+    if (m_playingClickSounds == nullptr || song.getEvents().size() == 0 || tickCount % m_ticksPerBeat != 0)
+    {
+        return;
+    }
+    int partIndex = getPartIndexAtTick(song, tickCount);
+    long beatInPart = (tickCount - getPartTick(song, partIndex)) / m_ticksPerBeat;
+    if (beatInPart % CLICK_BEATS_PER_BAR == 0)
+    {
+        m_clickVoice = &m_playingClickSounds->accent;
+    }
+    else
+    {
+        m_clickVoice = &m_playingClickSounds->beat;
+    }
+    m_clickVoicePosition = 0;
+}
+
+int Metronome::getPartIndexAtTick(const Song& song, long tick) const
+{
+    // the current part index moves a few ticks before the part starts, for the program changes
+    int partIndex = m_currentSongPartIndex;
+    while (partIndex > 0 && tick < getPartTick(song, partIndex))
+    {
+        partIndex--;
+    }
+    return partIndex;
+}
+
+double Metronome::getSamplesPerTick(const Song& song, int partIndex) const
+{
+    // the whole clock runs slower or faster at a rehearsal tempo
+    return (m_sampleRate * 60.0) / song.getEvents()[partIndex].bpm / m_ticksPerBeat / m_tempo;
+}
+
+void Metronome::updateSamplesPerTick(const Song& song)
+{
+    if (song.getEvents().size() == 0)
+    {
+        return;
+    }
+    // the tempo changes on the first tick of the part, not with its program changes
+    m_samplesPerTickExact = getSamplesPerTick(song, getPartIndexAtTick(song, m_totalTickCount));
+    if (m_samplesPerTick == 0)
+    {
+        m_tickLengthRemainder = 0.0;
+        m_samplesPerTick = nextTickLength();
+    }
+}
+
+unsigned long Metronome::nextTickLength()
+{
+    // carry the fractional part of the tick length over, so that the clock never drifts from the audio samples
+    m_tickLengthRemainder += m_samplesPerTickExact;
+    // the epsilon keeps thirds of samples from summing to 0.999...
+    unsigned long length = static_cast<unsigned long>(m_tickLengthRemainder + 1e-9);
+    m_tickLengthRemainder -= length;
+    return length;
 }
 
 const unsigned int Metronome::getTickCount() const
@@ -44,53 +170,175 @@ const bool Metronome::loopEndReached() const
 
 void Metronome::setCurrentSongPartIdx(unsigned int newSongPartIdx)
 {
-    if (newSongPartIdx >= m_songEvents.size())
+    auto song = std::atomic_load(&m_song);
+    if (newSongPartIdx >= song->getEvents().size())
     {
         return;
     }
 	m_currentSongPartIndex = newSongPartIdx;
-	m_totalTickCount = m_songEvents[m_currentSongPartIndex].tick;
+	m_totalTickCount = getPartTick(*song, m_currentSongPartIndex);
+    m_samplesPerTick = 0;  // restart tick length at the new part tempo
     m_currentTickCountStartThreshold = m_totalTickCount + m_tickCountStartThreshold;
 	m_loopEndReached = false;
 }
 
+void Metronome::setBeatPosition(long beat)
+{
+    auto song = std::atomic_load(&m_song);
+    if (song->getEvents().size() == 0)
+    {
+        return;
+    }
+    long tick = beat * m_ticksPerBeat;
+    m_currentSongPartIndex = 0;
+    for (int i = 0; i < song->getEvents().size(); i++)
+    {
+        if (getPartTick(*song, i) <= tick)
+        {
+            m_currentSongPartIndex = i;
+        }
+    }
+    m_totalTickCount = tick;
+    m_samplesPerTick = 0;
+    m_currentTickCountStartThreshold = m_totalTickCount + m_tickCountStartThreshold;
+    m_loopEndReached = false;
+}
+
+void Metronome::setTransport(const Transport* transport)
+{
+    m_transport = transport;
+    if (m_transport != nullptr)
+    {
+        m_appliedTransportGeneration = m_transport->getLatchedGeneration();
+    }
+}
+
+void Metronome::setPositionFromFrame(uint64_t songFrame)
+{
+    const Song& song = *m_playingSong;
+    if (song.getEvents().size() == 0)
+    {
+        return;
+    }
+
+    // walk the parts to convert the position into a tick position, in samples played at the playback tempo
+    uint64_t frame = static_cast<uint64_t>(round(songFrame / m_tempo));
+    double remainingSamples = static_cast<double>(frame);
+    double partStartSamples = 0.0;
+    int partIndex = 0;
+    for (int i = 0; i < static_cast<int>(song.getEvents().size()) - 1; i++)
+    {
+        double partSamples = (getPartTick(song, i + 1) - getPartTick(song, i)) * getSamplesPerTick(song, i);
+        if (remainingSamples < partSamples)
+        {
+            break;
+        }
+        remainingSamples -= partSamples;
+        partStartSamples += partSamples;
+        partIndex = i + 1;
+    }
+
+    // ticks fall on the same samples as when playing from the start of the song:
+    // the sample before the exact tick position, the fraction is carried to the next tick
+    double samplesPerTick = getSamplesPerTick(song, partIndex);
+    long ticksInPart = static_cast<long>(floor(remainingSamples / samplesPerTick));
+    auto tickStartFrame = [&](long tick) {
+        return static_cast<uint64_t>(partStartSamples + tick * samplesPerTick + 1e-9);
+    };
+    if (tickStartFrame(ticksInPart + 1) <= frame)
+    {
+        ticksInPart += 1;
+    }
+    double tickExactPosition = partStartSamples + ticksInPart * samplesPerTick;
+    m_currentSongPartIndex = partIndex;
+    m_totalTickCount = getPartTick(song, partIndex) + ticksInPart;
+    m_samplesPerTickExact = samplesPerTick;
+    m_tickLengthRemainder = tickExactPosition - tickStartFrame(ticksInPart);
+    m_samplesPerTick = nextTickLength();
+    m_samples = static_cast<int>(frame - tickStartFrame(ticksInPart));
+    m_frame = frame;
+    m_loopEndReached = false;
+    // started right on a tick: it is not sent on the clock, but its beat is clicked
+    m_clickVoice = nullptr;
+    m_clickPendingTick = (m_samples == 0) ? m_totalTickCount.load() : -1;
+}
+
 double Metronome::getPlaybackPositionMs() const
 {
+	auto song = std::atomic_load(&m_song);
+	const std::vector<songEvent>& events = song->getEvents();
 	double msTime = 0.0;
-	for (int i = 0; i < static_cast<int>(m_songEvents.size()) - 1; i++)
+	for (int i = 0; i < static_cast<int>(events.size()) - 1; i++)
 	{
-		if (m_totalTickCount >= m_songEvents[i + 1].tick)
+		if (m_totalTickCount >= getPartTick(*song, i + 1))
 		{
 			// we already passed this whole part, we sum it
-			unsigned int partTicksCount = m_songEvents[i + 1].tick - m_songEvents[i].tick;
-			msTime += 1000.0 * partTicksCount / m_ticksPerBeat / m_songEvents[i].bpm * 60.0;
+			unsigned int partTicksCount = getPartTick(*song, i + 1) - getPartTick(*song, i);
+			msTime += 1000.0 * partTicksCount / m_ticksPerBeat / events[i].bpm * 60.0;
 		}
 		else
 		{
 			// we are in the current part
-			msTime += 1000.0 * (m_totalTickCount - m_songEvents[i].tick) / m_ticksPerBeat / m_songEvents[i].bpm * 60.0;
+			msTime += 1000.0 * (m_totalTickCount - getPartTick(*song, i)) / m_ticksPerBeat / events[i].bpm * 60.0;
 			break;
 		}
 	}
 	return msTime;
 }
 
-void Metronome::setNewSong(std::vector<songEvent> songEvents)
+void Metronome::setNewSong(std::shared_ptr<const Song> song)
 {
-	m_songEvents.clear();
-	for (auto event : songEvents) {
-		m_songEvents.push_back(event);
-        ofLog() << "event patches: " << event.patches.size();
-	}
 	m_totalTickCount = 0;
 	m_currentSongPartIndex = 0;
 	m_samples = 0;
+	m_frame = 0;
+    m_samplesPerTick = 0;
     m_samplesPerTickCorrection = 0;
     m_currentTickCountStartThreshold = m_tickCountStartThreshold;
+	// the audio thread may still play the previous song, it is freed once it moved on
+	Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_song, std::move(song)));
+}
+
+void Metronome::updateSong(std::shared_ptr<const Song> song)
+{
+	if (song == nullptr || song->getEvents().empty())
+	{
+		return;
+	}
+	Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_song, std::move(song)));
+}
+
+void Metronome::applySongChange()
+{
+	auto song = std::atomic_load(&m_song);
+	if (song == m_playingSong)
+	{
+		return;
+	}
+	// the ui retired the previous song, the audio thread never frees it
+	m_playingSong = std::move(song);
+	const Song& playingSong = *m_playingSong;
+	if (playingSong.getEvents().empty())
+	{
+		return;
+	}
 
-	for (int i = 0; i < m_songEvents.size(); i++) {
-		m_songEvents[i].tick *= m_ticksPerBeat;  // on adapte la valeur au nombre de coups rels transmis par pulsation
+	m_currentSongPartIndex = 0;
+	for (int i = 0; i < static_cast<int>(playingSong.getEvents().size()); i++)
+	{
+		if (getPartTick(playingSong, i) <= m_totalTickCount)
+		{
+			m_currentSongPartIndex = i;
+		}
 	}
+	// the tick being counted keeps its length, the next ones follow the new tempo
+	m_samplesPerTickExact = getSamplesPerTick(playingSong, m_currentSongPartIndex);
+	m_loopEndReached = false;
+}
+
+long Metronome::getPartTick(const Song& song, int partIndex) const
+{
+	return song.getEvents()[partIndex].tick * m_ticksPerBeat;
 }
 
 void Metronome::setEnabled(bool enabled) {
@@ -104,7 +352,12 @@ void Metronome::setLoopMode(bool loop)
 }
 
 void Metronome::tick() {
-	for (auto midiOut: m_midiOuts)
+	if (m_midiRecorder != nullptr)
+	{
+		m_midiRecorder->record(m_frame, {0xF8});
+		return;
+	}
+	for (const auto& midiOut : m_midiOuts)
 	{
 		if (midiOut->sendTicks && midiOut->isOpen())
 		{
@@ -114,39 +367,23 @@ void Metronome::tick() {
 
 }
 
-void Metronome::sendNextProgramChange() {
-    for (auto midiOut: m_midiOuts)
+void Metronome::sendNextProgramChange()
+{
+    sendNextProgramChange(*std::atomic_load(&m_song));
+}
+
+void Metronome::sendNextProgramChange(const Song& song) {
+    for (const auto& midiOut : m_midiOuts)
     {
         int programNumber = -1;
+        int channel = midiOut->defaultChannel;
         if (midiOut->_automaticMode)
         {
-            if (m_songEvents.size() > 0)
+            const PatchTable::Patch& patch = song.getPatchTable().get(m_currentSongPartIndex, midiOut->_deviceIndex);
+            programNumber = patch.program;
+            if (m_currentSongPartIndex > 0 && song.getPatchTable().get(m_currentSongPartIndex - 1, midiOut->_deviceIndex).program == programNumber)
             {
-                for (auto patch : m_songEvents[m_currentSongPartIndex].patches)
-                {
-                    if (patch.midiOutputIndex == midiOut->_deviceIndex)
-                    {
-                        programNumber = patch.programNumber;
-                    }
-                }
-            }
-            
-            if (m_currentSongPartIndex > 0)
-            {
-                if (m_songEvents.size() > 1)
-                {
-                    for (auto patch : m_songEvents[m_currentSongPartIndex - 1].patches)
-                    {
-                        if (patch.midiOutputIndex == midiOut->_deviceIndex)
-                        {
-                            if (programNumber == patch.programNumber)
-                            {
-                                programNumber = -1;  // don't re-send the same program, it will cause an unwanted VST interruption
-                            }
-                        }
-                    }
-                }
-
+                programNumber = -1;  // don't re-send the same program, it will cause an unwanted VST interruption
             }
         }
         else
@@ -159,15 +396,20 @@ void Metronome::sendNextProgramChange() {
             ofLog() << "sending Pch " << programNumber << " to midi device " << midiOut->_deviceOsName << " (" << midiOut->_deviceName << ")";
             // midiOut._midiOut.sendControlChange(10, 0, 1);  // 0 = MSB = playlist (start at 1)  //(int channel, int control, int value);
             // midiOut._midiOut.sendControlChange(10, 32, 2);  // 32 = LSB = song (start at 1)
-            midiOut->_midiOut.sendProgramChange(midiOut->defaultChannel, programNumber);
+            if (m_midiRecorder != nullptr)
+            {
+                unsigned char status = 0xC0 | ((channel - 1) & 0x0F);
+                m_midiRecorder->record(m_frame, {status, static_cast<unsigned char>(programNumber & 0x7F)});
+            }
+            else
+            {
+                midiOut->_midiOut.sendProgramChange(channel, programNumber);
+            }
         }
 
     }
 
-    if (m_songEvents.size() > 0)
-    {
-        m_samplesPerTick = round((m_sampleRate * 60.0) / m_songEvents[m_currentSongPartIndex].bpm / m_ticksPerBeat);
-    }
+    updateSamplesPerTick(song);
 }
 
 bool Metronome::isSongEnded()
@@ -176,21 +418,21 @@ bool Metronome::isSongEnded()
 	{
 		return false;
 	}
-	return m_currentSongPartIndex == (static_cast<int>(m_songEvents.size()) - 1);
+	return m_currentSongPartIndex == (static_cast<int>(std::atomic_load(&m_song)->getEvents().size()) - 1);
 }
 
 void Metronome::correctTicksToPlaybackPosition(double realPlaybackPositionMs)
 {
     double metronomePositionMs = getPlaybackPositionMs();
     double timeLate = realPlaybackPositionMs - metronomePositionMs;
-    double ticksLate = timeLate * m_songEvents[m_currentSongPartIndex].bpm / 60000.0 * m_ticksPerBeat;
+    double ticksLate = timeLate * std::atomic_load(&m_song)->getEvents()[m_currentSongPartIndex].bpm / 60000.0 * m_ticksPerBeat;
     
     if (ticksLate >= 1.0) m_futureSamplesPerTickCorrection = -2;
     else if (ticksLate > 0.5) m_futureSamplesPerTickCorrection = -1;
     else if (ticksLate <= -1.0) m_futureSamplesPerTickCorrection = 2;
     else if (ticksLate < -0.5) m_futureSamplesPerTickCorrection = 1;
     
-    //m_samplesPerTickCorrection = round((m_sampleRate * 60.0f) / m_songEvents[m_currentSongPartIndex].bpm / m_ticksPerBeat);
+    //m_samplesPerTickCorrection = round((m_sampleRate * 60.0f) / m_song->getEvents()[m_currentSongPartIndex].bpm / m_ticksPerBeat);
     ofLog() << "metronome is late " << timeLate << " ms, " << ticksLate << " subticks (m_futureSamplesPerTickCorrection = " << m_futureSamplesPerTickCorrection << ")";
 }
 
@@ -198,31 +440,97 @@ void Metronome::process(ofSoundBuffer& input, ofSoundBuffer& output) {
 
 	output = input;
 
+	applySongChange();
+	const Song& song = *m_playingSong;
+
+	if (m_transport != nullptr)
+	{
+		const TransportCommand& command = m_transport->getCommand();
+		if (command.generation != m_appliedTransportGeneration)
+		{
+			m_appliedTransportGeneration = command.generation;
+			if (command.play)
+			{
+				// 0.8f is not exactly 0.8, ticks would fall one sample early
+				m_tempo = round(command.tempo * 10000.0) / 10000.0;
+				setPositionFromFrame(command.frame);
+			}
+			m_enabled = command.play;
+		}
+	}
+
 	if (!m_enabled)
 	{
+		m_clickVoice = nullptr;
+		m_clickPendingTick = -1;
 		return;
 	}
 
+	if (m_clickVoice == nullptr)
+	{
+		m_playingClickSounds = std::atomic_load(&m_clickSounds);
+	}
+	bool click = m_clickEnabled.load();
+	float clickVolume = m_clickVolume.load();
+	size_t nbChannels = output.getNumChannels();
+	size_t clickLeft = static_cast<size_t>(std::max(0, m_clickLeftChannel.load()));
+	size_t clickRight = static_cast<size_t>(std::max(0, m_clickRightChannel.load()));
+	if (!click || clickLeft >= nbChannels || clickRight >= nbChannels)
+	{
+		click = false;
+		m_clickVoice = nullptr;
+	}
+
 	for (size_t i = 0; i < output.getNumFrames(); i++)
 	{
-		if (++m_samples == (m_samplesPerTick + m_samplesPerTickCorrection))
+		// the click of a tick starts on the sample following it, which is the beat position of the song
+		if (m_clickPendingTick >= 0)
+		{
+			if (click)
+			{
+				startClick(m_clickPendingTick);
+			}
+			m_clickPendingTick = -1;
+		}
+		if (m_clickVoice != nullptr)
+		{
+			float sample = (*m_clickVoice)[m_clickVoicePosition] * clickVolume;
+			output[i * nbChannels + clickLeft] += sample;
+			if (clickRight != clickLeft)
+			{
+				output[i * nbChannels + clickRight] += sample;
+			}
+			if (++m_clickVoicePosition >= m_clickVoice->size())
+			{
+				m_clickVoice = nullptr;
+			}
+		}
+
+		if (++m_samples >= static_cast<long>(m_samplesPerTick) + m_samplesPerTickCorrection)
 		{
             tick();
             m_totalTickCount += 1;
+            m_clickPendingTick = m_totalTickCount;
             
 			m_samples = 0;
 
-			if ((m_currentSongPartIndex + 1 < m_songEvents.size()) && (m_totalTickCount >= m_songEvents[m_currentSongPartIndex + 1].tick - 20))
+			if ((m_currentSongPartIndex + 1 < song.getEvents().size()) && (m_totalTickCount >= getPartTick(song, m_currentSongPartIndex + 1) - 20))
 			{
 				m_currentSongPartIndex += 1;
-				sendNextProgramChange();
+				sendNextProgramChange(song);
 				if (m_loop)
 				{
 					m_loopEndReached = true;
 				}
 			}
+			if (getPartTick(song, m_currentSongPartIndex) == m_totalTickCount)
+			{
+				updateSamplesPerTick(song);
+			}
             
             m_samplesPerTickCorrection = m_futureSamplesPerTickCorrection;
+            m_samplesPerTick = nextTickLength();
 		}
+		m_frame += 1;
 	}
 }
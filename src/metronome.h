@@ -1,12 +1,17 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+
 #include "ofMain.h"
 #include "ofxSoundObject.h"
 #include "ofxMidi.h"
 
 #include "midiOutput.h"
+#include "midiRecorder.h"
 
 #include "song.h"
+#include "transport.h"
 
 
 class Metronome : public ofxSoundObject {
@@ -16,7 +21,11 @@ public:
 
 	void setMidiOuts(std::vector<std::shared_ptr<MidiOutput>>& midiOuts);
 
-	void setNewSong(std::vector<songEvent> songEvents);
+	// program changes are read from the patch table of the song
+	void setNewSong(std::shared_ptr<const Song> song);
+	// edited structure of the loaded song, picked up by the audio thread at its next buffer:
+	// the clock keeps its tick position and follows the new parts from there
+	void updateSong(std::shared_ptr<const Song> song);
 
 	void process(ofSoundBuffer& input, ofSoundBuffer& output);
 
@@ -36,30 +45,86 @@ public:
 
 	const unsigned int getCurrentSongPartIdx() const;
 	void setCurrentSongPartIdx(unsigned int newSongPartIdx);
+	void setBeatPosition(long beat);
+
+	// the clock is started, stopped and positioned by the transport, on the same sample as the tracks
+	void setTransport(const Transport* transport);
 
 	void setNbIgnoredStartupsTicks(int nbIgnoredStartupTicks);
 	void correctTicksToPlaybackPosition(double realPlaybackPositionMs);
 	void setSampleRate(unsigned int sampleRate);
 
+	// offline render: midi events are recorded with their sample position instead of being sent
+	void setMidiRecorder(MidiRecorder* recorder);
+
+	// click synthesized on every beat, on the same sample as the midi clock tick,
+	// accented on the first beat of the bars. Written to two channels of the device.
+	void setClickEnabled(bool enabled);
+	bool isClickEnabled() const;
+	void setClickVolume(float volume);
+	void setClickOutput(int leftChannel, int rightChannel);
+
 private:
 
+	// precomputed click sounds, at the device sample rate
+	struct ClickSounds {
+		std::vector<float> accent;
+		std::vector<float> beat;
+	};
+
 	void tick();
+	// audio thread: plays the song set or updated by the ui from this buffer on
+	void applySongChange();
+	// part start in clock ticks, the parts count beats
+	long getPartTick(const Song& song, int partIndex) const;
+	int getPartIndexAtTick(const Song& song, long tick) const;
+	void startClick(long tickCount);
+	void buildClickSounds();
+	void setPositionFromFrame(uint64_t songFrame);
+	double getSamplesPerTick(const Song& song, int partIndex) const;
+	void updateSamplesPerTick(const Song& song);
+	void sendNextProgramChange(const Song& song);
+	unsigned long nextTickLength();
 
 	bool m_loop = false;
 	bool m_loopEndReached = false;
 
 	bool m_enabled = false;
 
-	unsigned long m_samplesPerTick;
+	unsigned long m_samplesPerTick = 0;
+	double m_samplesPerTickExact = 0.0;  // exact tick length at current bpm and device sample rate
+	double m_tickLengthRemainder = 0.0;
     int m_samplesPerTickCorrection = 0;  // correction to re-align with audio
     int m_futureSamplesPerTickCorrection = 0;
 	int m_ticksPerBeat;
 	int m_samples = 0;
-	std::vector<songEvent> m_songEvents;
-	long m_totalTickCount;
-	int m_currentSongPartIndex;
+	// never null. Atomic access: set by the ui, the audio thread plays it from its next buffer
+	std::shared_ptr<const Song> m_song = std::make_shared<const Song>(std::vector<songEvent>());
+	std::atomic<long> m_totalTickCount {0};  // read by the ui
+	std::atomic<int> m_currentSongPartIndex {0};  // read by the ui
 	int m_tickCountStartThreshold;
     int m_currentTickCountStartThreshold;
 
-	unsigned int m_sampleRate;
+	unsigned int m_sampleRate = 44100;
+
+	uint64_t m_frame = 0;  // samples played since the start of the song, at the playback tempo
+	double m_tempo = 1.0;  // rehearsal tempo of the transport, the clock follows it
+
+	MidiRecorder* m_midiRecorder = nullptr;
+
+	const Transport* m_transport = nullptr;
+	uint32_t m_appliedTransportGeneration = 0;
+
+	std::shared_ptr<const ClickSounds> m_clickSounds;
+	std::atomic<bool> m_clickEnabled {false};
+	std::atomic<float> m_clickVolume {0.7f};
+	std::atomic<int> m_clickLeftChannel {0};
+	std::atomic<int> m_clickRightChannel {1};
+
+	// audio thread only
+	std::shared_ptr<const Song> m_playingSong;  // m_song as of the current buffer
+	std::shared_ptr<const ClickSounds> m_playingClickSounds;
+	const std::vector<float>* m_clickVoice = nullptr;  // sound being played, null when silent
+	size_t m_clickVoicePosition = 0;
+	long m_clickPendingTick = -1;  // tick of the click to start on the next sample
 };
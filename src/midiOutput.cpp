@@ -1,5 +1,6 @@
 #include "midiOutput.h"
 #include "stringUtils.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -12,6 +13,7 @@ MidiOutput::MidiOutput(int port, string deviceName, int deviceIndex, string devi
     
     if (deviceOsName.size() > 0)
     {
+        Tonton::Utils::TraceScope trace("midi out open", deviceOsName);
         _midiOut.openPort(deviceOsName);
         if (!_midiOut.isOpen())
         {
@@ -0,0 +1,114 @@
+#include "midiRecorder.h"
+
+#include <cmath>
+#include <fstream>
+
+#include "ofMain.h"
+
+namespace {
+    void writeBigEndian(std::vector<unsigned char>& out, uint32_t value, unsigned int nBytes)
+    {
+        for (int i = nBytes - 1; i >= 0; i--)
+        {
+            out.push_back(static_cast<unsigned char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    void writeVariableLength(std::vector<unsigned char>& out, uint32_t value)
+    {
+        unsigned char bytes[5];
+        int count = 0;
+        do
+        {
+            bytes[count++] = value & 0x7F;
+            value >>= 7;
+        } while (value > 0);
+        for (int i = count - 1; i >= 0; i--)
+        {
+            out.push_back(bytes[i] | (i > 0 ? 0x80 : 0x00));
+        }
+    }
+} // unnamed namespace
+
+void MidiRecorder::clear()
+{
+    m_events.clear();
+}
+
+void MidiRecorder::record(uint64_t frame, std::vector<unsigned char> bytes)
+{
+    m_events.push_back({frame, std::move(bytes)});
+}
+
+const std::vector<RecordedMidiEvent>& MidiRecorder::getEvents() const
+{
+    return m_events;
+}
+
+bool MidiRecorder::saveSmf(const std::string& filePath, unsigned int sampleRate) const
+{
+    if (sampleRate == 0)
+    {
+        return false;
+    }
+
+    // ticks per second = division * 1e6 / tempo
+    uint32_t division = 960;
+    uint32_t tempo = static_cast<uint32_t>(std::round(division * 1000000.0 / sampleRate));
+    if (sampleRate % 100 == 0 && sampleRate / 100 <= 0x7FFF)
+    {
+        division = sampleRate / 100;
+        tempo = 10000;
+    }
+    double ticksPerFrame = division * 1000000.0 / tempo / sampleRate;
+
+    std::vector<unsigned char> track;
+    // tempo meta event
+    writeVariableLength(track, 0);
+    track.push_back(0xFF);
+    track.push_back(0x51);
+    track.push_back(0x03);
+    writeBigEndian(track, tempo, 3);
+
+    uint64_t previousTick = 0;
+    for (const auto& event : m_events)
+    {
+        if (event.bytes.empty())
+        {
+            continue;
+        }
+        uint64_t tick = static_cast<uint64_t>(std::llround(event.frame * ticksPerFrame));
+        writeVariableLength(track, static_cast<uint32_t>(tick - std::min(tick, previousTick)));
+        previousTick = std::max(tick, previousTick);
+        if (event.bytes[0] >= 0xF0)
+        {
+            // system messages have no smf event of their own
+            track.push_back(0xF7);
+            writeVariableLength(track, static_cast<uint32_t>(event.bytes.size()));
+        }
+        track.insert(track.end(), event.bytes.begin(), event.bytes.end());
+    }
+    // end of track
+    writeVariableLength(track, 0);
+    track.push_back(0xFF);
+    track.push_back(0x2F);
+    track.push_back(0x00);
+
+    std::vector<unsigned char> file = {'M', 'T', 'h', 'd'};
+    writeBigEndian(file, 6, 4);
+    writeBigEndian(file, 0, 2);  // format 0
+    writeBigEndian(file, 1, 2);  // one track
+    writeBigEndian(file, division, 2);
+    file.insert(file.end(), {'M', 'T', 'r', 'k'});
+    writeBigEndian(file, static_cast<uint32_t>(track.size()), 4);
+    file.insert(file.end(), track.begin(), track.end());
+
+    std::ofstream stream(ofToDataPath(filePath), std::ios::binary | std::ios::trunc);
+    if (!stream.is_open())
+    {
+        ofLogError() << "could not write midi file " << filePath;
+        return false;
+    }
+    stream.write(reinterpret_cast<const char*>(file.data()), file.size());
+    return stream.good();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RecordedMidiEvent {
+    uint64_t frame = 0;  // device sample at which the event is sent
+    std::vector<unsigned char> bytes;
+};
+
+// Midi events sent by the metronome, with their sample timestamps.
+// Used by the offline render to check the clock and the program changes.
+class MidiRecorder {
+public:
+    void clear();
+    void record(uint64_t frame, std::vector<unsigned char> bytes);
+    const std::vector<RecordedMidiEvent>& getEvents() const;
+
+    // Standard MIDI File (format 0). The tempo and the division are chosen so that one
+    // midi tick lasts one sample when the sample rate is a multiple of 100 Hz.
+    // Clock messages are stored as F7 escape events.
+    bool saveSmf(const std::string& filePath, unsigned int sampleRate) const;
+
+private:
+    std::vector<RecordedMidiEvent> m_events;
+};
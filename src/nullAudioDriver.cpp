@@ -0,0 +1,111 @@
+#include "nullAudioDriver.h"
+
+#include <chrono>
+
+NullAudioDriver::NullAudioDriver() {
+
+}
+
+NullAudioDriver::~NullAudioDriver() {
+    stop();
+}
+
+void NullAudioDriver::setup(ofxSoundObject& chainEnd, unsigned int sampleRate, unsigned int channels, unsigned int bufferSize, Mode mode)
+{
+    stop();
+    m_chainEnd = &chainEnd;
+    m_sampleRate = sampleRate;
+    m_bufferSize = bufferSize;
+    m_mode = mode;
+    m_buffer.setSampleRate(sampleRate);
+    m_buffer.allocate(bufferSize, channels);
+    resetStats();
+}
+
+void NullAudioDriver::start()
+{
+    if (m_running || m_chainEnd == nullptr)
+    {
+        return;
+    }
+    m_running = true;
+    m_thread = std::thread(&NullAudioDriver::threadedFunction, this);
+}
+
+void NullAudioDriver::stop()
+{
+    m_running = false;
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+bool NullAudioDriver::isRunning() const
+{
+    return m_running;
+}
+
+void NullAudioDriver::run(uint64_t buffers)
+{
+    if (m_chainEnd == nullptr)
+    {
+        return;
+    }
+    for (uint64_t i = 0; i < buffers; i++)
+    {
+        processBuffer();
+    }
+}
+
+AudioDriverStats NullAudioDriver::getStats() const
+{
+    AudioDriverStats stats;
+    stats.buffers = m_buffers;
+    stats.frames = stats.buffers * m_bufferSize;
+    if (stats.buffers > 0)
+    {
+        stats.meanBufferNs = static_cast<double>(m_totalNs) / stats.buffers;
+        stats.nsPerFrame = stats.meanBufferNs / m_bufferSize;
+    }
+    stats.worstBufferNs = static_cast<double>(m_worstNs);
+    return stats;
+}
+
+void NullAudioDriver::resetStats()
+{
+    m_buffers = 0;
+    m_totalNs = 0;
+    m_worstNs = 0;
+}
+
+void NullAudioDriver::processBuffer()
+{
+    auto startTime = std::chrono::steady_clock::now();
+    m_buffer.setTickCount(m_buffers);
+    m_chainEnd->audioOut(m_buffer);
+    uint64_t elapsedNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count());
+
+    m_buffers += 1;
+    m_totalNs += elapsedNs;
+    if (elapsedNs > m_worstNs)
+    {
+        m_worstNs = elapsedNs;
+    }
+}
+
+void NullAudioDriver::threadedFunction()
+{
+    auto period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 * m_bufferSize / m_sampleRate));
+    auto deadline = std::chrono::steady_clock::now();
+    while (m_running)
+    {
+        processBuffer();
+        if (m_mode == Mode::REALTIME)
+        {
+            // absolute deadlines: the pace does not drift with the processing time
+            deadline += period;
+            std::this_thread::sleep_until(deadline);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "ofMain.h"
+#include "ofxSoundObject.h"
+
+struct AudioDriverStats {
+    uint64_t buffers = 0;
+    uint64_t frames = 0;
+    double meanBufferNs = 0.0;
+    double worstBufferNs = 0.0;
+    double nsPerFrame = 0.0;
+};
+
+// Sound "device" without a sound card: pulls the chain from its last object,
+// either paced like a real device (one buffer every bufferSize / sampleRate seconds)
+// or as fast as possible, and measures the time spent in every callback.
+class NullAudioDriver {
+public:
+    enum class Mode {
+        REALTIME,
+        MAX_SPEED
+    };
+
+    NullAudioDriver();
+    virtual ~NullAudioDriver();
+
+    void setup(ofxSoundObject& chainEnd, unsigned int sampleRate, unsigned int channels, unsigned int bufferSize, Mode mode);
+
+    // background thread, like a device callback
+    void start();
+    void stop();
+    bool isRunning() const;
+
+    // pull a number of buffers from the calling thread
+    void run(uint64_t buffers);
+
+    AudioDriverStats getStats() const;
+    void resetStats();
+
+private:
+    void processBuffer();
+    void threadedFunction();
+
+    ofxSoundObject* m_chainEnd = nullptr;
+    ofSoundBuffer m_buffer;
+    unsigned int m_sampleRate = 44100;
+    unsigned int m_bufferSize = 256;
+    Mode m_mode = Mode::REALTIME;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running {false};
+    std::atomic<uint64_t> m_buffers {0};
+    std::atomic<uint64_t> m_totalNs {0};
+    std::atomic<uint64_t> m_worstNs {0};
+};
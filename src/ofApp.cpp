@@ -5,9 +5,13 @@
 #include <utility>
 
 #include "color.h"
+#include "loudness.h"
 #include "midiUtils.h"
+#include "offlineRenderer.h"
+#include "retireQueue.h"
 #include "volumesDb.h"
 #include "stringUtils.h"
+#include "xmlPullParser.h"
 
 #ifdef __unix__
 # include <unistd.h>
@@ -28,20 +32,156 @@ namespace {
         }
         return false;
     }
+
+    // every element read from settings.xml
+    const Tonton::Utils::XmlSchema& getSettingsSchema()
+    {
+        using Tonton::Utils::XmlValueType;
+        static const Tonton::Utils::XmlSchema schema = {
+            {"settings", XmlValueType::NONE},
+            {"settings/nb_ignored_startup_ticks", XmlValueType::INTEGER},
+            {"settings/midi_outputs", XmlValueType::NONE},
+            {"settings/midi_outputs/output", XmlValueType::NONE},
+            {"settings/midi_outputs/output/name", XmlValueType::TEXT},
+            {"settings/midi_outputs/output/device_id", XmlValueType::TEXT},
+            {"settings/midi_outputs/output/send_ticks", XmlValueType::INTEGER},
+            {"settings/midi_outputs/output/send_timecodes", XmlValueType::INTEGER},
+            {"settings/midi_outputs/output/channel", XmlValueType::INTEGER},
+            {"settings/midi_outputs/output/input_format", XmlValueType::TEXT},
+            {"settings/midi_outputs/output/use_legacy_program", XmlValueType::INTEGER},
+            {"settings/midi_outputs/output/patches", XmlValueType::NONE},
+            {"settings/midi_outputs/output/patches/patch", XmlValueType::NONE},
+            {"settings/midi_outputs/output/patches/patch/name", XmlValueType::TEXT},
+            {"settings/midi_outputs/output/patches/patch/program", XmlValueType::INTEGER},
+            {"settings/songs_root_dir", XmlValueType::TEXT},
+            {"settings/auto_play_delay_seconds", XmlValueType::INTEGER},
+            {"settings/ignore_audio_files", XmlValueType::NONE},
+            {"settings/ignore_audio_files/containing", XmlValueType::NONE},
+            {"settings/ignore_audio_files/containing/value", XmlValueType::TEXT},
+            {"settings/stream_audio", XmlValueType::INTEGER},
+            {"settings/memory_budget_mb", XmlValueType::INTEGER},
+            {"settings/audio_routing", XmlValueType::NONE},
+            {"settings/audio_routing/bus", XmlValueType::NONE},
+            {"settings/audio_routing/bus/name", XmlValueType::TEXT},
+            {"settings/audio_routing/bus/left", XmlValueType::INTEGER},
+            {"settings/audio_routing/bus/right", XmlValueType::INTEGER},
+            {"settings/audio_routing/default_bus", XmlValueType::TEXT},
+            {"settings/audio_routing/route", XmlValueType::NONE},
+            {"settings/audio_routing/route/containing", XmlValueType::TEXT},
+            {"settings/audio_routing/route/bus", XmlValueType::TEXT},
+            {"settings/loudness", XmlValueType::NONE},
+            {"settings/loudness/auto_gain", XmlValueType::INTEGER},
+            {"settings/loudness/target_lufs", XmlValueType::NUMBER},
+            {"settings/loudness/true_peak_max", XmlValueType::NUMBER},
+            {"settings/click", XmlValueType::NONE},
+            {"settings/click/enabled", XmlValueType::INTEGER},
+            {"settings/click/bus", XmlValueType::TEXT},
+            {"settings/click/volume", XmlValueType::NUMBER},
+            {"settings/performance_mode", XmlValueType::NONE},
+            {"settings/performance_mode/enabled", XmlValueType::INTEGER},
+            {"settings/performance_mode/audio_priority", XmlValueType::INTEGER},
+            {"settings/performance_mode/audio_cores", XmlValueType::TEXT},
+            {"settings/performance_mode/lock_memory", XmlValueType::INTEGER},
+            {"settings/video_start_delay_ms", XmlValueType::INTEGER},
+            {"settings/video_speed_change_delay_ms", XmlValueType::NUMBER},
+            {"settings/window_pos_x", XmlValueType::INTEGER},
+            {"settings/window_pos_y", XmlValueType::INTEGER},
+            {"settings/window_pos_w", XmlValueType::INTEGER},
+            {"settings/window_pos_h", XmlValueType::INTEGER},
+            {"settings/show_video_window", XmlValueType::INTEGER},
+            {"settings/enable_visuals", XmlValueType::INTEGER}
+        };
+        return schema;
+    }
 } // unnamed namespace
 
 //--------------------------------------------------------------
 void ofApp::setup(){
+	Tonton::Utils::TraceScope trace("setup");
 
 	ofSetLogLevel(OF_LOG_VERBOSE);
 	ofBackground(0);
 
-	loadHwConfig();
+	loadHwConfig(); // read by every startup task
+	transport.setPerformanceMode(&m_performanceMode);
+
+	// set metronome controls
+	metronome.setLoopMode(m_loop);
+	metronome.setTransport(&transport);
+	m_timeStretcher.setTransport(&transport);
+	mixer.setTimeStretcher(&m_timeStretcher);
+	VolumesDb::setWriter(&m_settingsWriter);
+	m_setlistBundle.setWriter(&m_settingsWriter);
+
+	// the devices, the setlist and the first song are set up concurrently, while the ui
+	// draws their progress. Nothing plays until the first song is loaded, so the audio
+	// thread does not read what the tasks set
+	using Tonton::Utils::TaskGraph;
+	size_t midiTask = m_startup.add("midi", TaskGraph::Thread::WORKER, [this]() {
+		openMidiIn();
+		openMidiOut();
+		metronome.setMidiOuts(_midiOuts);
+	});
+	// the audio thread reads the midi outputs of the metronome once the device is open
+	size_t audioTask = m_startup.add("audio", TaskGraph::Thread::WORKER, [this]() {
+		if (m_renderSetlistAndExit)
+		{
+			// no sound device, the chain is pulled by the offline renderer
+			metronome.setSampleRate(m_sampleRate);
+			masterMeter.setSampleRate(m_sampleRate);
+		}
+		else
+		{
+			openAudioOut();
+		}
+	}, { midiTask });
+	size_t volumesTask = m_startup.add("volumes", TaskGraph::Thread::WORKER, [this]() {
+		m_volumeStore.load(ofToDataPath("volumes.db", true), ofToDataPath("volumes.journal", true));
+	});
+	// the patches of the structures are resolved for the midi outputs
+	size_t setlistTask = m_startup.add("setlist", TaskGraph::Thread::WORKER, [this]() {
+		loadSetlist();
+	}, { midiTask });
+	// at the configured rate, while the device is opened: the cache is emptied if it opens at another one
+	unsigned int configuredSampleRate = m_sampleRate;
+	size_t decodingTask = m_startup.add("first song decoding", TaskGraph::Thread::WORKER, [this, configuredSampleRate]() {
+		preloadFirstSong(configuredSampleRate);
+	}, { setlistTask });
+	m_startup.add("first song", TaskGraph::Thread::UI, [this]() {
+		loadFirstSong();
+	}, { midiTask, audioTask, volumesTask, setlistTask, decodingTask });
+	if (!m_renderSetlistAndExit)
+	{
+		m_startup.add("mapping", TaskGraph::Thread::UI, [this]() {
+			setupMapping();
+		});
+	}
+	m_startup.start();
+
+	if (m_renderSetlistAndExit)
+	{
+		m_startup.wait();
+		for (unsigned int i = 0; i < m_setlist.size(); i++)
+		{
+			loadSongByIndex(i);
+			renderSong();
+		}
+		ofExit(0);
+		return;
+	}
+
+	ofSetFrameRate(m_audioRefreshRate);
 
-	// ----------------------------------------
+	// load logo
+	// m_logo = ofImage("TontonMediaPlayerLogo.png");
+}
+
+void ofApp::openMidiIn()
+{
 	// midi in (clock)
 	if (m_enableMidiIn)
 	{
+		Tonton::Utils::TraceScope trace("midi in open");
 		midiIn.listInPorts();
 		midiIn.openPort(0);
 		midiIn.ignoreTypes(true, // sysex  <-- ignore timecode messages!
@@ -50,27 +190,47 @@ void ofApp::setup(){
 		// add ofApp as a listener
 		midiIn.addListener(this);
 	}
+}
 
-	// ----------------------------------------
-	openMidiOut();
-	// set metronome controls
-	metronome.setMidiOuts(_midiOuts);
-	metronome.setLoopMode(m_loop);
-
-	openAudioOut();
+void ofApp::preloadFirstSong(unsigned int sampleRate)
+{
+	if (m_setlist.empty() || (m_streamAudio && m_tempo == 1.0f))
+	{
+		return;
+	}
+	const string& songName = m_setlist[m_currentSongIndex];
+	vector<string> trackPaths;
+	for (const auto& trackFile : getSongTrackFiles(songName))
+	{
+		trackPaths.push_back(ofToDataPath(trackFile));
+	}
+	m_songCache.setSampleRate(sampleRate);
+	m_songCache.setProtectedSongs(songName, "");
+	m_songCache.preload(songName, trackPaths);
+	m_songCache.finishPreload(songName);
+}
 
-	// chargement setlist
-    loadSetlist();
-    m_setlistView.setup("Setlist", m_setlist, 0, 0, false, m_colorFocused, m_colorNotFocused);
-    changeSelectedUiElement(MAIN_UI_ELEMENT::SETLIST);
+void ofApp::loadFirstSong()
+{
+	m_setlistView.setup("Setlist", m_setlist, 0, 0, false, m_colorFocused, m_colorNotFocused);
+	changeSelectedUiElement(MAIN_UI_ELEMENT::SETLIST);
 
-	metronome.setSampleRate(m_sampleRate);
+	if (!m_renderSetlistAndExit)
+	{
+		// checked in the background while the first song loads
+		m_preflight.start(m_setlistBundle, _midiOuts);
+	}
 
 	loadSong(); // chargement du premier morceau
+	initializeLayout();
+}
 
+void ofApp::setupMapping()
+{
 	m_quadSurfaces.push_back(QuadSurface());
 	loadMappingNodes();
 
+	Tonton::Utils::TraceScope traceFbos("fbo allocate");
 	for (uint32_t i = 0; i < m_quadSurfaces.size(); i++)
 	{
 		ofFbo fbo;
@@ -78,15 +238,17 @@ void ofApp::setup(){
 		m_fboSources.push_back(fbo);
 	}
     m_fboMapping.allocate(1920, 1080, GL_RGBA);
+    uint64_t textureBytes = 4 * static_cast<uint64_t>(m_fboMapping.getWidth() * m_fboMapping.getHeight());
+    for (auto& fbo : m_fboSources)
+    {
+        textureBytes += 4 * static_cast<uint64_t>(fbo.getWidth() * fbo.getHeight());
+    }
+    m_memoryBudget.setUsage("mapping", MemoryBudget::TEXTURES, textureBytes);
 
-    m_isDefaultShaderLoaded = m_defaultShader.load("shaders/default_150.vert", "shaders/bad_tv.frag");
-    
-    ofSetFrameRate(m_audioRefreshRate);
-
-	// load logo
-	// m_logo = ofImage("TontonMediaPlayerLogo.png");
-    
-    initializeLayout();
+    {
+        Tonton::Utils::TraceScope traceShader("shader compile", "bad_tv");
+        m_isDefaultShaderLoaded = m_defaultShader.load("shaders/default_150.vert", "shaders/bad_tv.frag");
+    }
 }
 
 void ofApp::initializeLayout()
@@ -238,7 +400,9 @@ void ofApp::saveAudioOutConfig() {
     settings.setValue("settings:sample_rate", static_cast<int>(m_sampleRate));
     settings.setValue("settings:requested_audio_out_api", toString(m_requestedAudioOutApi));
     settings.setValue("settings:requested_audio_out_device", m_requestedAudioOutDevice);
-    settings.save("audio_settings.xml");
+    std::string content;
+    settings.copyXmlToString(content);
+    m_settingsWriter.write(ofToDataPath("audio_settings.xml", true), content);
 }
 
 void ofApp::confirmAudioOutSelection() {
@@ -256,10 +420,18 @@ void ofApp::confirmAudioOutSelection() {
 }
 
 void ofApp::loadHwConfig() {
+    Tonton::Utils::TraceScope trace("loadHwConfig");
     loadAudioOutConfig();
 
 	ofxXmlSettings settings;
 	string filePath = "settings.xml";
+	// typos and misplaced tags would silently fall back to the defaults below
+	vector<string> settingsProblems;
+	Tonton::Utils::validateXmlFile(ofToDataPath(filePath), getSettingsSchema(), settingsProblems);
+	for (const auto& problem : settingsProblems)
+	{
+		ofLogWarning() << "settings.xml " << problem;
+	}
 	if (settings.load(filePath)) {
 		settings.pushTag("settings");
 		if (settings.tagExists("songs_root_dir"))
@@ -304,6 +476,50 @@ void ofApp::loadHwConfig() {
 			
 		}
 
+        m_streamAudio = settings.getValue("stream_audio", 0) == 1;
+        m_memoryBudget.setLimit(static_cast<uint64_t>(settings.getValue("memory_budget_mb", 2048)) * 1024 * 1024);
+        m_routing.load(settings);
+
+        if (settings.tagExists("loudness"))
+        {
+            settings.pushTag("loudness");
+            m_defaultAutoGain = settings.getValue("auto_gain", 0) == 1;
+            m_loudnessTarget = settings.getValue("target_lufs", -23.0);
+            m_truePeakCeiling = settings.getValue("true_peak_max", -1.0);
+            settings.popTag();
+        }
+
+        if (settings.tagExists("performance_mode"))
+        {
+            settings.pushTag("performance_mode");
+            PerformanceSettings performanceSettings;
+            performanceSettings.enabled = settings.getValue("enabled", 0) == 1;
+            performanceSettings.audioPriority = settings.getValue("audio_priority", performanceSettings.audioPriority);
+            for (const auto& core : ofSplitString(settings.getValue("audio_cores", ""), ",", true, true))
+            {
+                performanceSettings.audioCores.push_back(ofToInt(core));
+            }
+            performanceSettings.lockMemory = settings.getValue("lock_memory", 1) == 1;
+            settings.popTag();
+            // before the midi and audio devices start their threads
+            m_performanceMode.setup(performanceSettings);
+        }
+
+        if (settings.tagExists("click"))
+        {
+            settings.pushTag("click");
+            metronome.setClickEnabled(settings.getValue("enabled", 0) == 1);
+            metronome.setClickVolume(settings.getValue("volume", 0.7));
+            std::string clickBus = settings.getValue("bus", m_routing.getBuses()[0].name);
+            int bus = m_routing.findBus(clickBus);
+            if (bus < 0)
+            {
+                ofLogError() << "unknown output bus " << clickBus << " for the click, using " << m_routing.getBuses()[0].name;
+                bus = 0;
+            }
+            metronome.setClickOutput(m_routing.getBuses()[bus].leftChannel, m_routing.getBuses()[bus].rightChannel);
+            settings.popTag();
+        }
         m_enableVisuals = settings.getValue("enable_visuals", 1) == 1;
 	}
 	else {
@@ -313,32 +529,16 @@ void ofApp::loadHwConfig() {
 
 //--------------------------------------------------------------
 void ofApp::loadSetlist() {
-    ofDirectory dir;
-    dir.listDir(m_songsRootDir);
-    ofxXmlSettings settings;
-    string filePath = "setlist.xml";
-    if (settings.load(filePath)) {
-        settings.pushTag("setlist");
-        int numberOfSongs = settings.getNumTags("song");
-        for (int i = 0; i < numberOfSongs; i++) {
-            settings.pushTag("song", i);
-            std::string songName = settings.getValue("name", "");
-            // TODO v�rifications
-            shortenString(songName, 20, -1, 0);
-            m_setlist.push_back(songName);
-            settings.popTag();
-        }
-    }
-    else {
-        ofLogError() << "setlist.xml not found, creating a default setlist";
-        for (int i = 0; i < dir.size(); i++) {
-            m_setlist.push_back(dir.getName(i));
-        }
-    }
+    Tonton::Utils::TraceScope trace("loadSetlist");
+    // structures and audio files of every song, recompiled only when their files changed
+    m_setlistBundle.setup(m_songsRootDir, _midiOuts, m_audioFilesIgnoreIfContains);
+    m_setlistBundle.load("setlist.bundle", "setlist.xml", "settings.xml");
+    m_setlist = m_setlistBundle.getSetlist();
     ofLog() << "init setlist";
 }
 
 int ofApp::openMidiOut() {
+    Tonton::Utils::TraceScope trace("openMidiOut");
     _midiOuts.clear();
 
     // print midi out devices
@@ -456,7 +656,7 @@ void ofApp::openAudioOutPanel()
     ofSoundStreamSettings settings;
     settings.setOutListener(this);
     settings.sampleRate = m_sampleRate;
-    settings.numOutputChannels = 2;
+    settings.numOutputChannels = m_routing.getOutputChannels();
     settings.numInputChannels = 0;
     settings.bufferSize = m_bufferSize;
     settings.numBuffers = 1;
@@ -521,10 +721,13 @@ void ofApp::closeAudioOutPanel()
 
 int ofApp::openAudioOut()
 {
+	Tonton::Utils::TraceScope trace("openAudioOut", m_requestedAudioOutDevice);
+	m_nullAudioDriver.stop();
+
 	ofSoundStreamSettings settings;
 	settings.setOutListener(this);
 	settings.sampleRate = m_sampleRate;
-	settings.numOutputChannels = 2;
+	settings.numOutputChannels = m_routing.getOutputChannels();
     settings.numInputChannels = 0;
 	settings.bufferSize = m_bufferSize;
 	settings.numBuffers = 1;
@@ -536,7 +739,7 @@ int ofApp::openAudioOut()
 
     if (m_requestedAudioOutDevice.size() > 0)
     {
-        std::vector<ofSoundDevice> devices = soundStream.getMatchingDevices(m_requestedAudioOutDevice, UINT_MAX, 2, m_requestedAudioOutApi);
+        std::vector<ofSoundDevice> devices = soundStream.getMatchingDevices(m_requestedAudioOutDevice, UINT_MAX, m_routing.getOutputChannels(), m_requestedAudioOutApi);
         if (devices.size() == 0)
         {
             ofLogError() << "Audio out device not found: " << m_requestedAudioOutDevice;
@@ -550,10 +753,25 @@ int ofApp::openAudioOut()
         }
     }
 
-	m_isAudioOutOpened = soundStream.setup(settings);
+	{
+		Tonton::Utils::TraceScope traceOpen("audio out open");
+		m_isAudioOutOpened = soundStream.setup(settings);
+	}
+	m_outputChannels = settings.numOutputChannels;
 	if (m_isAudioOutOpened)
 	{
 		soundStream.setOutput(output);
+        if (soundStream.getNumOutputChannels() > 0 && soundStream.getNumOutputChannels() != m_outputChannels)
+        {
+            ofLogWarning() << "Audio out opened with " << soundStream.getNumOutputChannels() << " channels instead of " << m_outputChannels;
+            m_outputChannels = soundStream.getNumOutputChannels();
+        }
+        if (soundStream.getSampleRate() > 0 && soundStream.getSampleRate() != m_sampleRate)
+        {
+            // the device may not accept the configured rate, tracks are resampled to the real one
+            ofLogWarning() << "Audio out opened at " << soundStream.getSampleRate() << " Hz instead of " << m_sampleRate << " Hz";
+            m_sampleRate = soundStream.getSampleRate();
+        }
         if (soundStream.getSoundStream() != nullptr)
         {
 			string fullDevName = soundStream.getSoundStream()->getOutDevice().name;
@@ -573,14 +791,40 @@ int ofApp::openAudioOut()
             m_isWarningStateAudioOut = true;
         }
 	}
+	else
+	{
+		// keep the midi clock and the meters running, paced like a device
+		ofLogWarning() << "No audio out device, the audio engine runs on the null audio driver";
+		m_nullAudioDriver.setup(transport, m_sampleRate, m_outputChannels, m_bufferSize, NullAudioDriver::Mode::REALTIME);
+		m_nullAudioDriver.start();
+	}
 
 	ofLog() << "------------------------------------------------------";
+
+	mixer.setBuses(m_routing.getBuses(), m_outputChannels);
+
+	// midi clock is derived from the device sample clock
+	metronome.setSampleRate(m_sampleRate);
+	masterMeter.setSampleRate(m_sampleRate);
 	
 	return 0;
 }
 
 //--------------------------------------------------------------
 void ofApp::update(){
+	if (!m_isStarted)
+	{
+		m_isStarted = m_startup.update();
+		if (!m_isStarted)
+		{
+			return;
+		}
+		// the startup tasks and the first loadSong are over
+		Tonton::Utils::Trace::save();
+	}
+	// tracks, streams and mixer setups replaced since the last frame
+	Tonton::Utils::RetireQueue::collect();
+
 	// AUDIO UPDATE
 	if (metronome.isSongEnded())
 	{
@@ -610,6 +854,28 @@ void ofApp::update(){
 	// update the sound playing system:
 	ofSoundUpdate();
 
+	m_preflight.update(m_isPlaying);
+	for (const auto& path : m_settingsWriter.takeFailedPaths())
+	{
+		ofLogError() << "could not save " << path;
+	}
+	if (m_structureWatcher.poll())
+	{
+		reloadSongStructure();
+	}
+
+	std::vector<std::string> performanceReport;
+	if (m_performanceMode.pollReport(performanceReport))
+	{
+		for (const auto& line : performanceReport)
+		{
+			ofLog() << line;
+		}
+	}
+
+	updateLevelMeters();
+	updateTrackAnalysis();
+
 	if (m_isPlaying && players.size() > 0 && (players[0]->getPositionMS() - m_lastAudioMidiSyncPositionMs) > 1000)
 	{
         // do not check at playback beginning: measurement lacks precison and overcorrects, causing lags
@@ -667,6 +933,20 @@ void ofApp::update(){
     }
 }
 
+void ofApp::updateLevelMeters()
+{
+    float time = ofGetElapsedTimef();
+    m_trackMeters.resize(players.size());
+    for (int i = 0; i < players.size(); i++)
+    {
+        // players are metered pre-fader, the mixer gains are linear so they can be applied here
+        float volume = mixer.getTrackTrim(i) * mixer.getConnectionVolume(i);
+        auto& meter = players[i]->getMeter();
+        m_trackMeters[i].update(volume * meter.readPeak(), volume * meter.getRms(), time);
+    }
+    m_masterMeter.update(masterMeter.getMeter().readPeak(), masterMeter.getMeter().getRms(), time);
+}
+
 void ofApp::changeSelectedUiElement(MAIN_UI_ELEMENT uiElement)
 {
     m_setlistView.setFocus(uiElement == MAIN_UI_ELEMENT::SETLIST);
@@ -692,6 +972,10 @@ void ofApp::changeSelectedUiElement(MAIN_UI_ELEMENT uiElement)
 
 //--------------------------------------------------------------
 void ofApp::drawMapping(ofEventArgs& args){
+	if (!m_isStarted)
+	{
+		return;
+	}
 	m_fboMapping.draw(0, 0, ofGetWidth(), ofGetHeight());
 }
 
@@ -722,6 +1006,7 @@ void ofApp::drawMappingSetup()
 //--------------------------------------------------------------
 void ofApp::drawAnimatedLogo()
 {
+    const vector<songEvent>& songEvents = m_song->getEvents();
     int centerX = 300;
     int centerY = 200;
     int baseWidth = 200;
@@ -743,9 +1028,9 @@ void ofApp::drawAnimatedLogo()
 	{
 		ofSetColor(80, 90, 250);
         int songTicks = 0;
-        if (m_songEvents.size() > 0)
+        if (songEvents.size() > 0)
         {
-            m_songEvents[m_songEvents.size() - 1].tick;
+            songEvents[songEvents.size() - 1].tick;
         }
 		float progressOffset = (metronome.getTickCount() - 0.5 * songTicks) / songTicks;
 		xOffset = static_cast<int>(progressOffset * 5.2 * baseWidth / 220.0);
@@ -756,6 +1041,35 @@ void ofApp::drawAnimatedLogo()
 	ofSetColor(255);
 }
 
+void ofApp::drawStartup()
+{
+    ofDrawBitmapString("Starting...", 20, 30);
+    int y = 60;
+    for (const auto& task : m_startup.getStates())
+    {
+        std::stringstream strmStatus;
+        switch (task.status)
+        {
+        case Tonton::Utils::TaskGraph::Status::WAITING:
+            ofSetColor(m_colorNotFocused);
+            strmStatus << "waiting";
+            break;
+        case Tonton::Utils::TaskGraph::Status::RUNNING:
+            ofSetColor(m_colorSetting);
+            strmStatus << "in progress" << string((ofGetElapsedTimeMillis() / 300) % 4, '.');
+            break;
+        case Tonton::Utils::TaskGraph::Status::DONE:
+            ofSetColor(m_colorFocused);
+            strmStatus << "ready (" << task.durationMs << " ms)";
+            break;
+        }
+        ofDrawBitmapString(task.name, 30, y);
+        ofDrawBitmapString(strmStatus.str(), 230, y);
+        y += TEXT_LIST_SPACING;
+    }
+    ofSetColor(255);
+}
+
 void ofApp::drawAudioOutputPanel() {
     
     m_audioOutputListView.draw();
@@ -766,6 +1080,12 @@ void ofApp::draw() {
 	ofShowCursor();
 	ofSetColor(255);
 
+	if (!m_isStarted)
+	{
+		drawStartup();
+		return;
+	}
+
 	// draw logo with eyes animation
 //	if (!m_setupMappingMode)
 //	{
@@ -822,6 +1142,11 @@ void ofApp::draw() {
         ofSetColor(128);
         ofDrawBitmapString(strmSampleRate.str(), bufferSizeSampleRateDisplayX, textAudioOutY + 11);
     }
+    if (m_performanceMode.isEnabled())
+    {
+        ofSetColor(m_performanceMode.hasFailures() ? m_colorWarning : ofColor(128));
+        ofDrawBitmapString(m_performanceMode.getSummary(), bufferSizeSampleRateDisplayX + 160, textAudioOutY);
+    }
     
     
 //    std::stringstream strmFps;
@@ -1007,22 +1332,17 @@ void ofApp::drawPatches()
         }
         else
         {
-            if (m_songEvents.size() > 0)
+            const PatchTable::Patch& patch = m_song->getPatchTable().get(metronome.getCurrentSongPartIdx(), midiOut->_deviceIndex);
+            if (patch.program >= 0)
             {
-                for (auto patch : m_songEvents[metronome.getCurrentSongPartIdx()].patches)
+                ofSetColor(m_colorNotFocused);
+                if (isWarning)
                 {
-                    if (midiOut->_deviceIndex == patch.midiOutputIndex)
-                    {
-                        ofSetColor(m_colorNotFocused);
-                        if (isWarning)
-                        {
-                            ofSetColor(128);
-                        }
-                        ofDrawRectRounded(baseX + 100, baseY + offsetY + (row + 1) * 15 - 10, 80, 13, 3.0);
-                        ofSetColor(0);
-                        ofDrawBitmapString(patch.name, baseX + 104, baseY + offsetY + (row + 1) * 15);
-                    }
+                    ofSetColor(128);
                 }
+                ofDrawRectRounded(baseX + 100, baseY + offsetY + (row + 1) * 15 - 10, 80, 13, 3.0);
+                ofSetColor(0);
+                ofDrawBitmapString(m_song->getPatchTable().getName(patch), baseX + 104, baseY + offsetY + (row + 1) * 15);
             }
         }
 
@@ -1085,7 +1405,12 @@ void ofApp::drawMixerLine(int i, int x, int y, int w, int h)
     for (int j = 0; j < 40; j++)
     {
         int xBar = x + j * barPeriod + 2;
-        ofDrawRectangle(xBar, lineY + 4, barWidth, TEXT_LIST_SPACING - 4);
+        ofDrawRectangle(xBar, lineY + 4, barWidth, TEXT_LIST_SPACING - 7);
+    }
+    
+    if (i < m_trackMeters.size())
+    {
+        drawLevelMeter(m_trackMeters[i], x + 2, lineY + TEXT_LIST_SPACING - 2, 40 * barPeriod - 3, 2);
     }
 
     ofSetColor(m_colorNotFocused);
@@ -1101,10 +1426,32 @@ void ofApp::drawMixerLine(int i, int x, int y, int w, int h)
     for (int j = 0; j < volumeBars; j++)
     {
         int xBar = x + j * barPeriod + 2;
-        ofDrawRectangle(xBar, lineY + 4, barWidth, TEXT_LIST_SPACING - 4);
+        ofDrawRectangle(xBar, lineY + 4, barWidth, TEXT_LIST_SPACING - 7);
     }
 }
 
+void ofApp::drawLevelMeter(const Tonton::Utils::MeterDisplayState& meter, int x, int y, int w, int h)
+{
+    // -60 dBFS .. +6 dBFS scale
+    auto dbToWidth = [w](float amplitude) {
+        float norm = (Tonton::Utils::amplitudeToDb(amplitude) + 60.0f) / 66.0f;
+        return static_cast<int>(round(w * ofClamp(norm, 0.0f, 1.0f)));
+    };
+    
+    ofSetColor(30);
+    ofDrawRectangle(x, y, w, h);
+    
+    ofSetColor(m_colorNotFocused);
+    ofDrawRectangle(x, y, dbToWidth(meter.rms), h);
+    
+    int xZeroDb = x + dbToWidth(1.0f);
+    ofSetColor(meter.clipped ? m_colorWarning : ofColor(60));
+    ofDrawRectangle(xZeroDb, y, x + w - xZeroDb, h);
+    
+    ofSetColor(meter.peakHold >= 1.0f ? m_colorWarning : ofColor(220));
+    ofDrawRectangle(x + max(0, dbToWidth(meter.peakHold) - 1), y, 1, h);
+}
+
 void ofApp::drawMixer()
 {
     unsigned int baseX = m_areaMixer.x;
@@ -1153,6 +1500,9 @@ void ofApp::drawMixer()
     }
     ofDrawBitmapString("Backing tracks", baseX, baseY);
     
+    // master level, next to the title
+    drawLevelMeter(m_masterMeter, baseX + 150, baseY - 8, 280, 6);
+    
     ofSetColor(255);
         
     unsigned int idxMax = m_mixerPageOffset + m_mixerNbElementsPerPage;
@@ -1169,6 +1519,7 @@ void ofApp::drawMixer()
 
 void ofApp::drawPlayer()
 {
+    const vector<songEvent>& songEvents = m_song->getEvents();
     unsigned int baseY = 430;
     
     unsigned int timelinePosY = 20;
@@ -1245,6 +1596,27 @@ void ofApp::drawPlayer()
         ofDrawBitmapString(metronome.getTickCount() + 1, 104, baseY + buttonsYOffset + 10);
     }
     
+    // rehearsal tempo
+    if (m_tempo != 1.0f)
+    {
+        ofSetColor(m_colorWarning);
+        ofDrawBitmapString("tempo " + ofToString(static_cast<int>(round(m_tempo * 100.0f))) + "%", 150, baseY + buttonsYOffset + 10);
+    }
+    
+    // media memory, against the budget
+    {
+        uint64_t usageMb = m_memoryBudget.getUsage() / (1024 * 1024);
+        uint64_t limitMb = m_memoryBudget.getLimit() / (1024 * 1024);
+        string memory = "mem " + ofToString(usageMb) + "/" + ofToString(limitMb) + " MB";
+        ofSetColor(m_memoryBudget.getExcess() > 0 ? m_colorWarning : ofColor(128));
+        ofDrawBitmapString(memory, ofGetWidth() - 45 - 8 * memory.size(), baseY + buttonsYOffset + 10);
+
+        // songs of the setlist checked at startup, details in the log
+        string preflight = m_preflight.getSummary();
+        ofSetColor(m_preflight.hasProblems() ? m_colorWarning : ofColor(128));
+        ofDrawBitmapString(preflight, ofGetWidth() - 45 - 8 * (memory.size() + 2 + preflight.size()), baseY + buttonsYOffset + 10);
+    }
+
     // mute backings
     ofSetColor(128);
     if (m_muteBackings)
@@ -1300,21 +1672,21 @@ void ofApp::drawPlayer()
     ofDrawRectangle(timelinePosX, baseY + timelinePosY, timelineWidth, timelineHeight);
 
     float songTicks = 0.0f;
-    if (m_songEvents.size() > 0) {
-        songTicks = static_cast<float>(m_songEvents[m_songEvents.size() - 1].tick);
+    if (songEvents.size() > 0) {
+        songTicks = static_cast<float>(songEvents[songEvents.size() - 1].tick);
     }
-    for (int i = 0; i < static_cast<int>(m_songEvents.size())-1; i++)
+    for (int i = 0; i < static_cast<int>(songEvents.size())-1; i++)
     {
-        int x = timelinePosX + static_cast<int>((timelineWidth - 4) * m_songEvents[i].tick / songTicks);
-        int nbTicks = m_songEvents[i + 1].tick - m_songEvents[i].tick;
-        int w = round((timelineWidth - 4) * (m_songEvents[i + 1].tick - m_songEvents[i].tick + 0.5) / songTicks);
+        int x = timelinePosX + static_cast<int>((timelineWidth - 4) * songEvents[i].tick / songTicks);
+        int nbTicks = songEvents[i + 1].tick - songEvents[i].tick;
+        int w = round((timelineWidth - 4) * (songEvents[i + 1].tick - songEvents[i].tick + 0.5) / songTicks);
         
         if (w + x > timelinePosX + timelineWidth)
         {
             w = timelinePosX + timelineWidth - x;
         }
 
-        ofSetColor(m_songEvents[i].color);
+        ofSetColor(m_colorNotFocused);
         if (metronome.getCurrentSongPartIdx() == i && m_isPlaying)
         {
             ofSetColor(m_colorFocused);
@@ -1323,8 +1695,8 @@ void ofApp::drawPlayer()
         if (nbTicks >= 8)  // draw part name only if part is big enough
         {
             ofSetColor(0, 0, 0);
-            int nameSize = m_songEvents[i].name.size();
-            string songPartDisplay = replaceSpacesWithNewline(m_songEvents[i].name);
+            int nameSize = songEvents[i].name.size();
+            string songPartDisplay = replaceSpacesWithNewline(songEvents[i].name);
             auto strSize = estimateStringSize(songPartDisplay);
             float xName = x + 0.5 * w - 0.5 * strSize.x;
             if (xName < x) xName = x;
@@ -1337,6 +1709,15 @@ void ofApp::drawPlayer()
         ofSetColor(50);
         ofDrawRectangle(x, baseY + timelinePosY + 2, 1, timelineHeight - 4);
     }
+
+    // waveform of the tracks, over the song parts
+    if (m_waveformMeshWidth != static_cast<int>(timelineWidth))
+    {
+        updateWaveformMesh(timelinePosX + 2, baseY + timelinePosY + 2, timelineWidth - 4, timelineHeight - 4);
+        m_waveformMeshWidth = timelineWidth;
+    }
+    ofSetColor(0, 0, 0, 90);
+    m_waveformMesh.draw();
     ofSetColor(255);
 
     if (m_loop)
@@ -1401,6 +1782,14 @@ void ofApp::displayList(unsigned int x, unsigned int y, string title, vector<str
 
 //--------------------------------------------------------------
 void ofApp::exit() {
+	m_startup.stop();
+	m_nullAudioDriver.stop();
+	m_preflight.cancel();
+	m_volumeStore.close();
+	// what is still queued is written before the app quits
+	m_settingsWriter.stop();
+	VolumesDb::setWriter(nullptr);
+	Tonton::Utils::Trace::save();
 
 	// clean up
 	if (m_enableMidiIn)
@@ -1415,6 +1804,7 @@ void ofApp::exit() {
 void ofApp::stopPlayback()
 {
     mixer.setMasterVolume(0);
+	transport.stop();
 	metronome.setEnabled(false);
 	for (auto midiOut: _midiOuts)
 	{
@@ -1443,18 +1833,28 @@ void ofApp::stopPlayback()
 
 void ofApp::loadSong()
 {
+	Tonton::Utils::TraceScope trace("loadSong", m_setlist[m_currentSongIndex]);
     // then stop playback
 	m_songSelectorToolIdx = m_currentSongIndex;
     m_setlistView.setSelectedElement(m_songSelectorToolIdx);
+    m_requestedStartBeat = -1;
+	mixer.clearTracks();
+	m_timeStretcher.clear();
+	m_trackAnalyzer.cancel();
+	m_autoGainPending = false;
+	m_waveformMesh.clear();
+	m_waveformMeshWidth = -1;
 	for (int i = 0; i < players.size(); i++) {
 		players[i]->stop();
 		players[i]->unload();
-		players[i]->disconnect();
 	}
 	players.clear();
 	playersNames.clear();
+	m_trackMeters.clear();
+	m_masterMeter = Tonton::Utils::MeterDisplayState();
 
 	m_videoClipSource.closeVideo();
+	m_memoryBudget.release("video", MemoryBudget::VIDEO);
 
 	for (auto midiOut: _midiOuts)
 	{
@@ -1474,190 +1874,78 @@ void ofApp::loadSong()
 		}
 	}
 
-	// load audio
-	ofDirectory dir;
-	dir.allowExt("wav");
-	dir.allowExt("flac");
-    dir.allowExt("mp3");
-
 	string songName = m_setlist[m_currentSongIndex];
+	string nextSongName = m_currentSongIndex + 1 < m_setlist.size() ? m_setlist[m_currentSongIndex + 1] : "";
 
-	dir.listDir(m_songsRootDir + songName + "/audio");
+	// the previous song becomes evictable, the preload of this one completes
+	m_songCache.setSampleRate(m_sampleRate);
+	m_songCache.setProtectedSongs(songName, nextSongName);
+	m_songCache.finishPreload(songName);
 
 	m_videoLoaded = false;
 	if (ofFile(m_songsRootDir + songName + "/clip/clip.mp4").exists())
 	{
 		m_videoClipSource.loadVideo(m_songsRootDir + songName + "/clip/clip.mp4");
 		m_videoLoaded = true;
+		m_memoryBudget.setUsage("video", MemoryBudget::VIDEO, m_videoClipSource.getMemoryBytes());
+	}
+	else
+	{
+		// no clip for this song, the one of the previous song is not counted anymore
+		m_videoClipSource.closeVideo();
+		m_memoryBudget.release("video", MemoryBudget::VIDEO);
 	}
 
-	m_songEvents.clear();
+	const SetlistBundle::CompiledSong& compiledSong = m_setlistBundle.getSong(songName);
+	m_structureWatcher.watch(ofToDataPath(m_songsRootDir + songName + "/structure.xml", true));
+	m_song = compiledSong.song;
 
     bool unknownStructure = true;
-	ofxXmlSettings settings;
-	string filePath = m_songsRootDir + songName + "/structure.xml";
-	if (settings.load(filePath)) {
-        vector<PatchEvent> defaultPatches;  // store previous patch values to redund them at every song part
-		settings.pushTag("structure");
-		settings.pushTag("songparts");
-		int numberOfParts = settings.getNumTags("songpart");
-        uint32_t nextTick = 0;
-        bool tickLenDesc = false;
-        bool tickValDesc = false;
-        // TODO check if tick mode is consistent
-        
-		for (int i = 0; i < numberOfParts; i++) {
-			settings.pushTag("songpart", i);
-			songEvent e;
-			e.bpm = settings.getValue("bpm", 120);
-			e.programName = settings.getValue("program", "F16");
-            e.program = getProgramNumberFromElektronPatternStr(e.programName);
-            if (settings.tagExists("tick_len", 0))
-            {
-                e.tick = nextTick;
-                nextTick += settings.getValue("tick_len", 0);
-            }
-            else if (settings.tagExists("length", 0))
-            {
-                e.tick = nextTick;
-                nextTick += settings.getValue("length", 0);
-            }
-            else
-            {
-                e.tick = settings.getValue("tick", 0);
-            }
-			if (settings.tagExists("shader"))
-			{
-				e.shader = settings.getValue("shader", "");
-			}
-            e.name = settings.getValue("desc", "");
-            
-            bool patchesTag = settings.tagExists("patches");
-            if (patchesTag) {
-                settings.pushTag("patches");
-            }
-
-            for (auto midiOut : _midiOuts)
-            {
-                if (patchesTag && settings.tagExists(midiOut->_deviceName))
-                {
-                    PatchEvent patchEvent;
-                    patchEvent.programNumber = 0;
-                    patchEvent.midiOutputIndex = midiOut->_deviceIndex;
-                    if (midiOut->_patchFormat == PatchFormat::PROGRAM_NUMBER)
-                    {
-                        patchEvent.programNumber = settings.getValue(midiOut->_deviceName, 0);
-                        patchEvent.name = to_string(patchEvent.programNumber);
-                    }
-                    else if (midiOut->_patchFormat == PatchFormat::PATCH_NAME)
-                    {
-                        patchEvent.name = settings.getValue(midiOut->_deviceName, "");
-                        if (midiOut->_patchesMap.count(patchEvent.name))
-                        {
-                            patchEvent.programNumber = midiOut->_patchesMap[patchEvent.name];
-                        }
-                    }
-                    else if (midiOut->_patchFormat == PatchFormat::ELEKTRON_PATTERN)
-                    {
-                        patchEvent.name = settings.getValue(midiOut->_deviceName, "");
-                        patchEvent.programNumber = getProgramNumberFromElektronPatternStr(patchEvent.name);
-                    }
-                    shortenString(patchEvent.name, TEXT_LEN_PATCH_NAME, -1, 0);
-                    
-                    e.patches.push_back(patchEvent);
-                }
-                else if (midiOut->_useLegacyProgram)
-                {
-                    // store default program value from song (legacy from 1st software versions with only 1 midi output)
-                    PatchEvent patchEvent;
-                    patchEvent.programNumber = e.program;
-                    patchEvent.name = e.programName;
-                    patchEvent.midiOutputIndex = midiOut->_deviceIndex;
-                    shortenString(patchEvent.name, TEXT_LEN_PATCH_NAME, -1, 0);
-                    e.patches.push_back(patchEvent);
-                }
-            }
-
-            if (patchesTag) {
-                settings.popTag();
-            }
-            
-            // redund patches from previous iteration
-            for (auto prevPatch : defaultPatches)
-            {
-                bool shouldRedund = true;
-                for (auto patch : e.patches)
-                {
-                    if (prevPatch.midiOutputIndex == patch.midiOutputIndex)
-                    {
-                        shouldRedund = false;
-                        break;
-                    }
-                }
-                
-                if (shouldRedund)
-                {
-                    e.patches.push_back(prevPatch);
-                }
-            }
-            
-            // reset default patches
-            defaultPatches = e.patches;
-            
-			settings.popTag();
-            
-            // set part color
-            e.color = m_colorNotFocused;
-
-            m_songEvents.push_back(e);
-		}
-	}
-	else {
-		ofLogError() << "Impossible de charger " + filePath;
-	}
-    
-    if (m_songEvents.size() > 0)
+    if (m_song->getEvents().size() > 0)
     {
         unknownStructure = false;
     }
 
-	// find suitable audio files
-	vector<string> trackFilesToLoad;
-	for (int i = 0; i < dir.size(); i++) {
-		string trackName = fs::path(dir.getPath(i)).filename().string();
-		bool ignoreFile = false;
-
-		string lowerTrackName = trackName;
-		transform(lowerTrackName.begin(), lowerTrackName.end(), lowerTrackName.begin(), ::tolower);
-		for (auto ignoreString : m_audioFilesIgnoreIfContains)
-		{
-			if (lowerTrackName.find(ignoreString) != string::npos)
-			{
-				ofLog() << "File " + trackName + " ignored";
-				ignoreFile = true;
-				continue;
-			}
-		}
-		if (!ignoreFile)	trackFilesToLoad.push_back(dir.getPath(i));
-	}
+	const vector<string>& trackFilesToLoad = compiledSong.audioFiles;
 
 	// create players
 	players.resize(trackFilesToLoad.size());
 	m_selectedVolumeSetting = 0;
+	vector<string> trackPaths;
 	for (int i = 0; i < trackFilesToLoad.size(); i++)
 	{
+		trackPaths.push_back(ofToDataPath(trackFilesToLoad[i]));
 		string trackName = fs::path(trackFilesToLoad[i]).filename().string();
         string shortTrackName = trackName;
         shortenString(shortTrackName, TEXT_LEN_MIXER_ENTRY, 0, 0);
         playersNames.push_back(std::make_pair(trackName, shortTrackName));
-		players[i] = make_unique<ofxSoundPlayerObject>();
+		players[i] = make_unique<StemPlayer>();
 		players[i]->setLoop(false);
-		players[i]->load(ofToDataPath(trackFilesToLoad[i]));
+		// the time stretcher reads the tracks in memory
+		bool streaming = m_streamAudio && m_tempo == 1.0f;
+		auto cachedData = streaming ? nullptr : m_songCache.find(songName, trackPaths[i]);
+		if (cachedData != nullptr)
+		{
+			players[i]->setAudioData(cachedData);
+		}
+		else if (players[i]->load(trackPaths[i], m_sampleRate, streaming) && !streaming)
+		{
+			m_songCache.insert(songName, trackPaths[i], players[i]->getAudioData());
+		}
+	}
+	if (m_performanceMode.isEnabled())
+	{
+		std::vector<std::shared_ptr<const AudioData>> songBuffers;
+		for (const auto& player : players)
+		{
+			songBuffers.push_back(player->getAudioData());
+		}
+		m_performanceMode.lockSongBuffers(songBuffers);
 	}
     
     if (unknownStructure)
     {
-        m_songEvents.clear();
+        vector<songEvent> inferredEvents;
         // infer structure from players duration
         unsigned long duration = 0;
         for (auto& player : players)
@@ -1673,59 +1961,111 @@ void ofApp::loadSong()
             start.name = songName;
             start.bpm = 120;
             start.tick = 0;
-            start.color = m_colorNotFocused;
-            m_songEvents.push_back(start);
+            inferredEvents.push_back(start);
             songEvent end;
             end.name = "end";
             end.bpm = 120;
             end.tick = beats;
-            end.color = m_colorNotFocused;
-            m_songEvents.push_back(end);
+            inferredEvents.push_back(end);
         }
+        m_song = std::make_shared<const Song>(std::move(inferredEvents));
     }
 
+	m_routing.loadSongRoutes(m_songsRootDir + songName + "/routing.xml");
 	for (int i = 0; i < players.size(); i++) {
-		players[i]->connectTo(mixer);
+		players[i]->setTransport(&transport);
+		players[i]->setTimeStretcher(&m_timeStretcher, i);
+		mixer.addTrack(players[i].get(), m_routing.getTrackSends(playersNames[i].first));
 	}
+	updateTimeStretcher();
 
-	// load volumes from database
-	try
+	// load volumes from the store, a song saved before it is imported from its tracks.xml
+	if (!m_volumeStore.hasSong(songName))
 	{
 		vector<pair<string, float>> storedVolumes;
 		for (int i = 0; i < playersNames.size(); i++)
 		{
-			storedVolumes.push_back(make_pair(playersNames[i].first, 1.0));
+			storedVolumes.push_back(make_pair(playersNames[i].first, -1.0f));
 		}
 		VolumesDb::getStoredSongVolumes(m_songsRootDir, songName, storedVolumes);
-
-		for (int i = 0; i < storedVolumes.size(); i++)
+		for (const auto& stored : storedVolumes)
 		{
-			string stem = storedVolumes[i].first;
-			float volume = storedVolumes[i].second;
-			for (int j = 0; j < playersNames.size(); j++)
+			if (stored.second >= 0.0f)
 			{
-				if (stem == playersNames[j].first && j < players.size())
-				{
-					mixer.setConnectionVolume(j, volume);
-				}
+				m_volumeStore.setVolume(songName, stored.first, stored.second);
 			}
 		}
 	}
-	catch (const std::exception& e) {
-		ofLog() << "could not load song volumes, an error occured: " << e.what();
+	for (int i = 0; i < playersNames.size() && i < players.size(); i++)
+	{
+		float volume = m_volumeStore.getVolume(songName, playersNames[i].first);
+		if (volume >= 0.0f)
+		{
+			mixer.setConnectionVolume(i, volume);
+		}
+	}
+
+	// loudness and waveforms of the tracks, in the background unless cached
+	int songAutoGain = VolumesDb::getStoredAutoGain(m_songsRootDir, songName);
+	m_autoGain = songAutoGain >= 0 ? songAutoGain == 1 : m_defaultAutoGain;
+	vector<shared_ptr<const AudioData>> trackData;
+	for (auto& player : players)
+	{
+		trackData.push_back(player->getAudioData());
 	}
+	m_trackAnalyzer.start(m_songsRootDir, songName, trackPaths, trackData);
+	updateTrackAnalysis();
 
 	// load shaders
-	m_shadersSource.setup(m_songEvents);
+	m_shadersSource.setup(*m_song);
+
+	// decode the next song while this one plays
+	if (!nextSongName.empty() && !(m_streamAudio && m_tempo == 1.0f))
+	{
+		vector<string> nextTrackPaths;
+		for (const auto& trackFile : getSongTrackFiles(nextSongName))
+		{
+			nextTrackPaths.push_back(ofToDataPath(trackFile));
+		}
+		m_songCache.preload(nextSongName, nextTrackPaths);
+	}
 
 	// configure output device and metronome
-	metronome.setNewSong(m_songEvents);
+	metronome.setNewSong(m_song);
 	metronome.sendNextProgramChange();  // envoi du premier pch
     
     // initialize layout (update mixer list view)
     initializeLayout();
 }
 
+void ofApp::reloadSongStructure()
+{
+	string songName = m_setlist[m_currentSongIndex];
+	const SetlistBundle::CompiledSong& compiledSong = m_setlistBundle.getSong(songName);
+	if (compiledSong.song->getEvents().size() < 2)
+	{
+		// saved halfway or broken, the next save is picked up
+		ofLogError() << "structure.xml of " << songName << " could not be read, the current structure is kept";
+		return;
+	}
+	for (const auto& problem : compiledSong.problems)
+	{
+		ofLogWarning() << songName << ": " << problem;
+	}
+
+	// shared with the metronome, which swaps it in at its next buffer
+	m_song = compiledSong.song;
+	metronome.updateSong(m_song);
+	m_shadersSource.setup(*m_song);
+	m_waveformMeshWidth = -1;
+	ofLog() << "structure of " << songName << " reloaded, " << m_song->getEvents().size() << " parts";
+}
+
+vector<string> ofApp::getSongTrackFiles(const string& songName)
+{
+	return m_setlistBundle.getSong(songName).audioFiles;
+}
+
 double ofApp::getCurrentSongTimeMs()
 {
 	return metronome.getPlaybackPositionMs();
@@ -1733,7 +2073,8 @@ double ofApp::getCurrentSongTimeMs()
 
 void ofApp::startPlayback()
 {
-    if (m_songEvents.size() == 0)
+    const vector<songEvent>& songEvents = m_song->getEvents();
+    if (songEvents.size() == 0)
     {
         return;
     }
@@ -1760,20 +2101,23 @@ void ofApp::startPlayback()
 
 	ofSleepMillis(2);
 
-	// chain components
-	mixer.connectTo(metronome).connectTo(output);
+	// chain components, the transport must stay last
+	mixer.connectTo(metronome).connectTo(masterMeter).connectTo(transport).connectTo(output);
 
-	unsigned int currentSongPartIdx = metronome.getCurrentSongPartIdx();
-	double msTime = 0.0;
-	for (int i = 1; i <= currentSongPartIdx; i++)
+	// the part index of the clock follows an edited structure at its next buffer only
+	unsigned int currentSongPartIdx = std::min<unsigned int>(metronome.getCurrentSongPartIdx(), songEvents.size() - 1);
+	long startBeat = songEvents[currentSongPartIdx].tick;
+	if (m_requestedStartBeat >= 0)
 	{
-		int ticks = m_songEvents[i].tick - m_songEvents[i - 1].tick;
-		msTime += ticks * 1000.0 / m_songEvents[i - 1].bpm * 60.0;
+		startBeat = m_requestedStartBeat;
+		m_requestedStartBeat = -1;
 	}
+	double msTime = getSongTimeMs(songEvents, startBeat);
     
     m_lastAudioMidiSyncPositionMs = round(msTime);
 
-	float videoStartTime = (msTime + m_videoStartDelayMs) / 1000.0;  // m_videoStartDelayMs is an offset for latency compensation
+	float videoStartTime = (msTime + m_videoStartDelayMs * m_tempo) / 1000.0;  // m_videoStartDelayMs is an offset for latency compensation
+	m_videoClipSource.setBaseSpeed(m_tempo);
 	m_videoClipSource.playVideo(videoStartTime);
 
 	for (auto midiOut: _midiOuts)
@@ -1784,21 +2128,243 @@ void ofApp::startPlayback()
 		}
 	}
 
-    metronome.setEnabled(true);
-	for (int i = 0; i < players.size(); i++) {
-		players[i]->play();
-		if (currentSongPartIdx > 0)
+	// every track and the midi clock start on the same sample, at the next buffer boundary
+	uint64_t startFrame = static_cast<uint64_t>(round(msTime * m_sampleRate / 1000.0));
+	for (auto& player : players)
+	{
+		player->prepare(startFrame);
+	}
+	for (auto& player : players)
+	{
+		if (!player->waitPrepared(500))
 		{
-			players[i]->setPositionMS(round(msTime), 0);
+			ofLogError() << "audio track not ready in time, it will start late";
 		}
-		
 	}
+	if (m_tempo != 1.0f)
+	{
+		m_timeStretcher.prepare(startFrame, m_tempo);
+		if (!m_timeStretcher.waitPrepared(500))
+		{
+			ofLogError() << "stretched audio not ready in time, it will start late";
+		}
+	}
+	transport.play(startFrame, m_tempo);
 
 	mixer.setMasterVolume(1.0); // TODO config
 
 	m_isPlaying = true;
 }
 
+void ofApp::updateTrackAnalysis()
+{
+    if (m_trackAnalyzer.poll())
+    {
+        m_autoGainPending = true;
+        m_waveformMeshWidth = -1;
+        // streamed tracks skip the decoding of their silent blocks, found in their waveform
+        const auto& waveforms = m_trackAnalyzer.getWaveforms();
+        for (size_t i = 0; i < players.size() && i < waveforms.size(); i++)
+        {
+            if (players[i]->isStreaming() && waveforms[i] != nullptr)
+            {
+                players[i]->setStreamSilence(*waveforms[i]);
+            }
+        }
+    }
+    // the gains do not jump in the middle of a song
+    if (m_autoGainPending && !m_isPlaying)
+    {
+        applyAutoGain();
+    }
+}
+
+void ofApp::updateWaveformMesh(int x, int y, int w, int h)
+{
+    const vector<songEvent>& songEvents = m_song->getEvents();
+    // one vertical line per pixel of the timeline, from the min to the max of all the tracks.
+    // The timeline is in beats: every column covers the audio of its beats, following the tempo of the parts.
+    m_waveformMesh.clear();
+    m_waveformMesh.setMode(OF_PRIMITIVE_LINES);
+    const auto& waveforms = m_trackAnalyzer.getWaveforms();
+    if (waveforms.empty() || songEvents.size() < 2 || w <= 0)
+    {
+        return;
+    }
+
+    double songTicks = songEvents.back().tick;
+    size_t part = 0;
+    auto tickToSeconds = [&](double tick) {
+        while (part + 2 < songEvents.size() && tick >= songEvents[part + 1].tick)
+        {
+            part++;
+        }
+        double partStartMs = getSongTimeMs(songEvents, songEvents[part].tick);
+        return (partStartMs + (tick - songEvents[part].tick) * 60000.0 / songEvents[part].bpm) / 1000.0;
+    };
+
+    float halfHeight = 0.5f * h;
+    float centerY = y + halfHeight;
+    double startSeconds = tickToSeconds(0.0);
+    for (int column = 0; column < w; column++)
+    {
+        double endSeconds = tickToSeconds(songTicks * (column + 1) / w);
+        float columnMin = 0.0f;
+        float columnMax = 0.0f;
+        for (const auto& waveform : waveforms)
+        {
+            float trackMin;
+            float trackMax;
+            if (waveform != nullptr && waveform->getMinMax(startSeconds, endSeconds, trackMin, trackMax))
+            {
+                columnMin = min(columnMin, trackMin);
+                columnMax = max(columnMax, trackMax);
+            }
+        }
+        startSeconds = endSeconds;
+        if (columnMax - columnMin > 0.0f)
+        {
+            m_waveformMesh.addVertex(glm::vec3(x + column + 0.5f, centerY - columnMax * halfHeight, 0.0f));
+            m_waveformMesh.addVertex(glm::vec3(x + column + 0.5f, centerY - columnMin * halfHeight, 0.0f));
+        }
+    }
+}
+
+void ofApp::applyAutoGain()
+{
+    m_autoGainPending = false;
+    const auto& results = m_trackAnalyzer.getLoudness();
+    for (int i = 0; i < players.size(); i++)
+    {
+        float trimDb = 0.0f;
+        if (m_autoGain && i < results.size() && results[i].measured && results[i].integratedLufs > Tonton::Utils::LOUDNESS_SILENCE)
+        {
+            trimDb = m_loudnessTarget - results[i].integratedLufs;
+            trimDb = min(trimDb, m_truePeakCeiling - results[i].truePeakDb);
+            trimDb = ofClamp(trimDb, -24.0f, 12.0f);
+        }
+        mixer.setTrackTrim(i, pow(10.0f, trimDb / 20.0f));
+    }
+}
+
+void ofApp::updateTimeStretcher()
+{
+    if (m_tempo == 1.0f)
+    {
+        m_timeStretcher.clear();
+        return;
+    }
+    std::vector<std::shared_ptr<const AudioData>> tracks;
+    for (auto& player : players)
+    {
+        tracks.push_back(player->getAudioData());
+    }
+    m_timeStretcher.setTracks(tracks, m_sampleRate);
+}
+
+void ofApp::setTempo(float tempo)
+{
+    tempo = ofClamp(round(tempo * 100.0f) / 100.0f, 0.5f, 1.25f);
+    if (tempo == m_tempo)
+    {
+        return;
+    }
+
+    bool playingBeforeAction = m_isPlaying;
+    long beat = metronome.getTickCount();
+    if (playingBeforeAction)
+    {
+        stopPlayback();
+    }
+
+    m_tempo = tempo;
+    bool streamed = players.size() > 0 && players[0]->isStreaming();
+    if (streamed != (m_streamAudio && m_tempo == 1.0f))
+    {
+        // streamed tracks are loaded in memory to be stretched, and back
+        loadSong();
+        metronome.setBeatPosition(beat);
+        if (metronome.getCurrentSongPartIdx() > 0)
+        {
+            metronome.sendNextProgramChange();
+        }
+    }
+    else
+    {
+        updateTimeStretcher();
+    }
+    m_helper = "tempo " + ofToString(static_cast<int>(round(m_tempo * 100.0f))) + "%";
+
+    if (playingBeforeAction)
+    {
+        m_requestedStartBeat = beat;
+        startPlayback();
+    }
+}
+
+void ofApp::renderSong()
+{
+    const vector<songEvent>& songEvents = m_song->getEvents();
+    if (songEvents.size() == 0)
+    {
+        return;
+    }
+    stopPlayback();
+
+    // the device must not pull the chain during the render
+    if (m_isAudioOutOpened)
+    {
+        soundStream.stop();
+    }
+    bool nullDriverRunning = m_nullAudioDriver.isRunning();
+    m_nullAudioDriver.stop();
+
+    MidiRecorder midiRecorder;
+    metronome.setMidiRecorder(&midiRecorder);
+    metronome.setNewSong(m_song);
+    metronome.sendNextProgramChange();  // first program changes, at sample 0
+
+    mixer.connectTo(metronome).connectTo(masterMeter).connectTo(transport).connectTo(output);
+    mixer.setMasterVolume(1.0);
+
+    uint64_t frames = static_cast<uint64_t>(round(getSongTimeMs(songEvents, songEvents.back().tick) * m_sampleRate / 1000.0));
+    for (auto& player : players)
+    {
+        frames = std::max(frames, player->getDurationFrames());
+        player->prepare(0);
+    }
+    for (auto& player : players)
+    {
+        player->waitPrepared(2000);
+    }
+    transport.play(0);
+
+    // one buffer to latch the start, the render then begins exactly on sample 0
+    RenderStats stats;
+    OfflineRenderer::render(transport, m_sampleRate, m_outputChannels, m_bufferSize, m_bufferSize, "", stats);
+
+    string songName = m_setlist[m_currentSongIndex];
+    ofDirectory::createDirectory("renders", true, true);
+    string basePath = "renders/" + songName;
+    if (OfflineRenderer::render(transport, m_sampleRate, m_outputChannels, m_bufferSize, frames, basePath + ".wav", stats))
+    {
+        ofLog() << "rendered " << songName << ": " << stats.frames << " samples in " << stats.seconds << " s (" << stats.realtimeFactor << "x realtime)";
+    }
+    metronome.setMidiRecorder(nullptr);
+    midiRecorder.saveSmf(basePath + ".mid", m_sampleRate);
+
+    stopPlayback();
+    metronome.setNewSong(m_song);
+    if (m_isAudioOutOpened)
+    {
+        soundStream.start();
+    }
+    if (nullDriverRunning)
+    {
+        m_nullAudioDriver.start();
+    }
+}
+
 void ofApp::jumpToNextPart()
 {
 	bool playingBeforeAction = m_isPlaying;
@@ -1809,11 +2375,12 @@ void ofApp::jumpToNextPart()
 	}
 
 	unsigned int currentSongPartIdx = metronome.getCurrentSongPartIdx();
-	if (currentSongPartIdx + 1 < m_songEvents.size())
+	if (currentSongPartIdx + 1 < m_song->getEvents().size())
 	{
 		metronome.setCurrentSongPartIdx(currentSongPartIdx + 1);
 		metronome.sendNextProgramChange();
 	}
+	m_requestedStartBeat = -1;
     
     for (auto midiOut : _midiOuts)
     {
@@ -1850,6 +2417,7 @@ void ofApp::jumpToPreviousPart()
 		metronome.setCurrentSongPartIdx(currentSongPartIdx - 1);
 		metronome.sendNextProgramChange();
 	}
+	m_requestedStartBeat = -1;
     
     for (auto midiOut : _midiOuts)
     {
@@ -1871,6 +2439,50 @@ void ofApp::jumpToPreviousPart()
 	}
 }
 
+void ofApp::jumpBars(int barOffset)
+{
+	const vector<songEvent>& songEvents = m_song->getEvents();
+	if (songEvents.size() == 0)
+	{
+		return;
+	}
+
+	bool playingBeforeAction = m_isPlaying;
+
+	if (playingBeforeAction)
+	{
+		stopPlayback();
+	}
+
+	auto bars = getBarStartBeats(songEvents);
+	if (bars.size() > 0)
+	{
+		long currentBeat = metronome.getTickCount();
+		int currentBar = 0;
+		for (int i = 0; i < bars.size(); i++)
+		{
+			if (bars[i] <= currentBeat)
+			{
+				currentBar = i;
+			}
+		}
+		int targetBar = ofClamp(currentBar + barOffset, 0, static_cast<int>(bars.size()) - 1);
+
+		unsigned int previousSongPartIdx = metronome.getCurrentSongPartIdx();
+		metronome.setBeatPosition(bars[targetBar]);
+		if (metronome.getCurrentSongPartIdx() != previousSongPartIdx)
+		{
+			metronome.sendNextProgramChange();
+		}
+		m_requestedStartBeat = bars[targetBar];
+	}
+
+	if (playingBeforeAction)
+	{
+		startPlayback();
+	}
+}
+
 void ofApp::volumeUp()
 {
 	if (m_selectedVolumeSetting >= players.size())
@@ -1934,11 +2546,14 @@ void ofApp::saveMappingNodes()
         settings.popTag();
     }
     settings.popTag();
-    settings.save("mapping.xml");
+    std::string content;
+    settings.copyXmlToString(content);
+    m_settingsWriter.write(ofToDataPath("mapping.xml", true), content);
 }
 
 void ofApp::loadMappingNodes()
 {
+    Tonton::Utils::TraceScope trace("loadMappingNodes");
     ofxXmlSettings settings;
     if (!settings.load("mapping.xml"))
     {
@@ -1973,19 +2588,20 @@ void ofApp::loadMappingNodes()
 
 void ofApp::saveAudioMixerVolumes()
 {
-    vector<pair<string, float>> volumes;
+    // only the changed volumes are journaled, in the background
     for (int i = 0; i < players.size(); i++)
     {
-        float volume = mixer.getConnectionVolume(i);
-        string stem = playersNames[i].first;
-        volumes.push_back(make_pair(stem, volume));
+        m_volumeStore.setVolume(m_setlist[m_currentSongIndex], playersNames[i].first, mixer.getConnectionVolume(i));
     }
-    VolumesDb::setStoredSongVolumes(m_songsRootDir, m_setlist[m_currentSongIndex], volumes);
 }
 
 //--------------------------------------------------------------
 void ofApp::keyPressed(int key){
     
+    if (!m_isStarted)
+    {
+        return;
+    }
     if (m_audioOutPanelOpened)
     {
         switch(key) {
@@ -1993,10 +2609,19 @@ void ofApp::keyPressed(int key){
                 OF_EXIT_APP(0);
                 break;
             case OF_KEY_RETURN:
+            {
                 m_audioOutPanelOpened = false;
                 confirmAudioOutSelection();
+                unsigned int previousSampleRate = m_sampleRate;
                 openAudioOut();
+                if (m_sampleRate != previousSampleRate)
+                {
+                    // loaded tracks were converted for the previous device rate
+                    stopPlayback();
+                    loadSong();
+                }
                 break;
+            }
             case OF_KEY_ESC:
                 m_audioOutPanelOpened = false;
                 break;
@@ -2153,6 +2778,12 @@ void ofApp::keyPressed(int key){
         case 'N':  // next song part
             jumpToNextPart();
             break;
+        case '[':  // previous bar
+            jumpBars(-1);
+            break;
+        case ']':  // next bar
+            jumpBars(1);
+            break;
         case 's':
             changeSelectedUiElement(MAIN_UI_ELEMENT::SETLIST);
             break;
@@ -2243,12 +2874,36 @@ void ofApp::keyPressed(int key){
 //            VolumesDb::setStoredSongVolumes(m_setlist[m_currentSongIndex], volumes);
 //            break;
 //        }
+        case 'R':
+            renderSong();
+            break;
         case 'l':
             m_loop = !m_loop;
             metronome.setLoopMode(m_loop);
             break;
+        case '-':
+            setTempo(m_tempo - 0.05f);
+            break;
+        case '+':
+        case '=':
+            setTempo(m_tempo + 0.05f);
+            break;
+        case 'c':
+            metronome.setClickEnabled(!metronome.isClickEnabled());
+            m_helper = metronome.isClickEnabled() ? "click on" : "click off";
+            break;
+        case 'g':
+            m_autoGain = !m_autoGain;
+            VolumesDb::setStoredAutoGain(m_songsRootDir, m_setlist[m_currentSongIndex], m_autoGain);
+            applyAutoGain();
+            m_helper = m_autoGain ? "auto gain on, tracks at " + ofToString(m_loudnessTarget) + " LUFS" : "auto gain off";
+            if (m_autoGain && m_trackAnalyzer.isRunning())
+            {
+                m_helper += " (analyzing)";
+            }
+            break;
         case 'h':
-            m_helper = "f:fullscreen video, v:video setup, Q:quit, l:loop (experimental)";
+            m_helper = "f:fullscreen video, v:video setup, [/]:prev/next bar, R:render song, c:click, -/+:tempo, g:auto gain, Q:quit, l:loop (experimental)";
             break;
 //        case 't':
 //        {
@@ -2304,6 +2959,10 @@ void ofApp::mouseDragged(int x, int y, int button){
 
 //--------------------------------------------------------------
 void ofApp::mousePressed(int x, int y, int button){
+	if (!m_isStarted)
+	{
+		return;
+	}
 	if (m_setupMappingMode)
 	{
 		for (int i = 0; i < m_quadSurfaces.size(); i++)
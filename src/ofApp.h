@@ -5,18 +5,35 @@
 #include "ofxMidiClock.h"
 #include "ofSoundStream.h"
 
-#include "ofxSoundMixer.h"
-#include "ofxSoundPlayerObject.h"
-
 #include "ofxXmlSettings.h"
 
 #include "metronome.h"
 
+#include "asyncWriter.h"
+#include "fileWatcher.h"
+#include "levelMeter.h"
 #include "list.h"
+#include "masterMeter.h"
+#include "memoryBudget.h"
+#include "performanceMode.h"
 #include "midiOutput.h"
+#include "midiRecorder.h"
+#include "nullAudioDriver.h"
 #include "shadersSource.h"
+#include "routing.h"
+#include "setlistBundle.h"
+#include "setlistPreflight.h"
 #include "song.h"
+#include "songCache.h"
+#include "stemMixer.h"
+#include "stemPlayer.h"
+#include "taskGraph.h"
+#include "timeStretcher.h"
+#include "trace.h"
+#include "trackAnalyzer.h"
+#include "transport.h"
 #include "videoClipSource.h"
+#include "volumeStore.h"
 #include "QuadSurface.h"
 #include "Vec2.h"
 #include "Vec3.h"
@@ -26,7 +43,6 @@
 #define VOLUME_MAX 2.0
 #define TEXT_LEN_MIXER_ENTRY 30
 #define TEXT_LEN_MIDI_OUTPUT_NAME 10
-#define TEXT_LEN_PATCH_NAME 9
 #define TEXT_LEN_MIDI_OUTPUT_DEVICE 20
 
 enum MAIN_UI_ELEMENT {
@@ -67,19 +83,37 @@ public:
 
 	void stopPlayback();
 	void startPlayback();
+	// bounce the current song to renders/<song>.wav and .mid, without the sound device
+	void renderSong();
+	// rehearsal tempo of the whole song (tracks, midi clock, video), 1 = song tempo
+	void setTempo(float tempo);
 
-	std::vector<songEvent> m_songEvents;
+	std::shared_ptr<const Song> m_song = std::make_shared<const Song>(std::vector<songEvent>());  // never null
 	shared_ptr<ofAppBaseWindow> mappingWindow = nullptr;
+	bool m_renderSetlistAndExit = false;  // --render: bounce every song of the setlist, then quit
+	bool m_isStarted = false;  // every startup task done: the ui and the transport can be used
 
 private:
     void loadSong();
+    // structure.xml of the loaded song edited: new parts for the clock and the shaders, the tracks keep playing
+    void reloadSongStructure();
+    // audio files of a song, without the ignored ones
+    vector<string> getSongTrackFiles(const string& songName);
+	void openMidiIn();
 	int openMidiOut();
 	int openAudioOut();
+	// startup tasks
+	void preloadFirstSong(unsigned int sampleRate);
+	void loadFirstSong();
+	void setupMapping();
+	void drawStartup();
 	void loadHwConfig();
     void loadAudioOutConfig();
     void saveAudioOutConfig();
 	void jumpToNextPart();
 	void jumpToPreviousPart();
+	void jumpBars(int barOffset);
+	long m_requestedStartBeat = -1;  // bar position to start from, instead of current part start
 	unsigned int m_startingSongPart = 1;
 	void drawMappingSetup();
     void drawPatches();
@@ -98,15 +132,31 @@ private:
     void drawLicenseInfo();
     void initializeLayout();
     void drawMixerLine(int i,  int x, int y, int w, int h);
+    void drawLevelMeter(const Tonton::Utils::MeterDisplayState& meter, int x, int y, int w, int h);
+    void updateLevelMeters();
     void drawWarningSign(unsigned int x, unsigned int y);
+    void updateTimeStretcher();
+    void updateTrackAnalysis();
+    void applyAutoGain();
+    void updateWaveformMesh(int x, int y, int w, int h);
 
 	// internal sound and midi handlers
 	ofSoundStream soundStream;
+	NullAudioDriver m_nullAudioDriver;  // drives the chain when no sound device could be opened
 	ofxSoundOutput output;
-	ofxSoundMixer mixer;
-	vector<unique_ptr<ofxSoundPlayerObject>> players;
+	StemMixer mixer;
+	TimeStretcher m_timeStretcher;  // tracks at the rehearsal tempo
+	RoutingConfig m_routing;
+	unsigned int m_outputChannels = 2;  // channels of the opened device
+	MemoryBudget m_memoryBudget;  // decoded tracks, video, textures
+	SongCache m_songCache {m_memoryBudget};  // decoded tracks of the current, next and recent songs
+	vector<unique_ptr<StemPlayer>> players;
 	vector<std::pair<string, string>> playersNames;
+	TrackAnalyzer m_trackAnalyzer;  // loudness and waveforms
 	Metronome metronome;
+	MasterMeter masterMeter;
+	Transport transport;
+	PerformanceMode m_performanceMode;  // opt-in real-time priority, pinning and locked tracks (Linux)
 	ofxMidiIn midiIn;
     std::vector<std::shared_ptr<MidiOutput>> _midiOuts;
 	unsigned int m_sampleRate = 44100;
@@ -132,12 +182,18 @@ private:
 
 	// setlist data and state
 	std::vector<std::string> m_setlist;
+	SetlistBundle m_setlistBundle;
+	Tonton::Utils::FileWatcher m_structureWatcher;  // structure.xml of the loaded song
+	SetlistPreflight m_preflight;  // every song of the setlist checked at startup
+	VolumeStore m_volumeStore;  // stem volumes of every song
+	Tonton::Utils::AsyncWriter m_settingsWriter;  // settings files, saved off the ui thread
 	unsigned int m_currentSongIndex = 0;
 	unsigned int m_songSelectorToolIdx = 0;
 
 	// audio state
 	bool m_isAudioOutOpened = false;
 	bool m_isPlaying = false;
+	float m_tempo = 1.0f;
 
 	// midi input
 	bool m_enableMidiIn = false;
@@ -174,6 +230,14 @@ private:
 
 	// audio files
 	std::vector<std::string> m_audioFilesIgnoreIfContains;
+	bool m_streamAudio = false;
+
+	// loudness auto gain: every stem is trimmed to the target, below the true peak ceiling
+	bool m_defaultAutoGain = false;  // songs without their own setting
+	bool m_autoGain = false;  // current song
+	bool m_autoGainPending = false;  // analysis done while playing, applied at the next stop
+	float m_loudnessTarget = -23.0f;  // LUFS
+	float m_truePeakCeiling = -1.0f;  // dBTP
 
 	// framerate
 	unsigned int m_audioRefreshRate = 60;
@@ -218,6 +282,14 @@ private:
     
     bool m_muteBackings = false;
     
+    // waveform of the song on the timeline, rebuilt when the tracks or the timeline width change
+    ofVboMesh m_waveformMesh;
+    int m_waveformMeshWidth = -1;
+
+    // level meters (post-fader), with peak hold
+    std::vector<Tonton::Utils::MeterDisplayState> m_trackMeters;
+    Tonton::Utils::MeterDisplayState m_masterMeter;
+    
     int m_mixerNbElementsPerPage = 1;
     int m_mixerPageOffset = 0;
     
@@ -245,4 +317,7 @@ private:
     ofTrueTypeFont m_font;
     
     bool m_isWarningStateAudioOut = false;
+
+	// declared last, destroyed first: its tasks use the other members
+	Tonton::Utils::TaskGraph m_startup;
 };
@@ -0,0 +1,44 @@
+#include "offlineRenderer.h"
+
+#include "wavWriter.h"
+
+bool OfflineRenderer::render(ofxSoundObject& chainEnd, unsigned int sampleRate, unsigned int channels, unsigned int bufferSize,
+                             uint64_t frames, const std::string& wavPath, RenderStats& stats)
+{
+    stats = RenderStats();
+    if (sampleRate == 0 || channels == 0 || bufferSize == 0)
+    {
+        return false;
+    }
+
+    WavWriter writer;
+    if (!wavPath.empty() && !writer.open(wavPath, sampleRate, channels))
+    {
+        return false;
+    }
+
+    ofSoundBuffer buffer;
+    buffer.setSampleRate(sampleRate);
+    buffer.allocate(bufferSize, channels);
+
+    uint64_t startTime = ofGetElapsedTimeMicros();
+    while (stats.frames < frames)
+    {
+        buffer.setTickCount(stats.frames / bufferSize);
+        chainEnd.audioOut(buffer);
+        size_t written = static_cast<size_t>(std::min<uint64_t>(bufferSize, frames - stats.frames));
+        if (writer.isOpen())
+        {
+            writer.write(buffer.getBuffer().data(), written);
+        }
+        stats.frames += written;
+    }
+    writer.close();
+
+    stats.seconds = (ofGetElapsedTimeMicros() - startTime) / 1000000.0;
+    if (stats.seconds > 0.0)
+    {
+        stats.realtimeFactor = stats.frames / static_cast<double>(sampleRate) / stats.seconds;
+    }
+    return true;
+}
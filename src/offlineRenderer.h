@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "ofMain.h"
+#include "ofxSoundObject.h"
+
+struct RenderStats {
+    uint64_t frames = 0;
+    double seconds = 0.0;  // wall clock time spent
+    double realtimeFactor = 0.0;  // audio duration / wall clock time
+};
+
+// Runs a sound object chain without a sound device, as fast as the cpu allows.
+// The chain is pulled from its last object buffer by buffer, exactly as the device
+// callback does, so the result matches a live playback sample for sample.
+// Nothing else (sound stream) may pull the chain during the render.
+class OfflineRenderer {
+public:
+    // writes the mix to a 32-bit float wav file, unless wavPath is empty
+    static bool render(ofxSoundObject& chainEnd, unsigned int sampleRate, unsigned int channels, unsigned int bufferSize,
+                       uint64_t frames, const std::string& wavPath, RenderStats& stats);
+};
@@ -0,0 +1,312 @@
+#include "performanceMode.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+# include <sys/mman.h>
+# include <sys/resource.h>
+# include <unistd.h>
+#endif
+
+namespace {
+    thread_local bool t_audioThreadPromoted = false;
+
+    std::string toMb(uint64_t bytes)
+    {
+        return std::to_string(bytes / (1024 * 1024)) + " MB";
+    }
+
+    std::string coresToString(const std::vector<int>& cores)
+    {
+        std::stringstream stream;
+        for (size_t i = 0; i < cores.size(); i++)
+        {
+            stream << (i > 0 ? "," : "") << cores[i];
+        }
+        return stream.str();
+    }
+
+#ifdef __linux__
+    // soft limit up to the hard one set by limits.conf, current soft limit returned
+    rlim_t raiseLimit(int resource)
+    {
+        struct rlimit limit;
+        if (getrlimit(resource, &limit) != 0)
+        {
+            return 0;
+        }
+        if (limit.rlim_cur != RLIM_INFINITY && (limit.rlim_max == RLIM_INFINITY || limit.rlim_cur < limit.rlim_max))
+        {
+            limit.rlim_cur = limit.rlim_max;
+            if (setrlimit(resource, &limit) != 0)
+            {
+                getrlimit(resource, &limit);
+            }
+        }
+        return limit.rlim_cur;
+    }
+#endif
+} // unnamed namespace
+
+void PerformanceMode::setup(const PerformanceSettings& settings)
+{
+    m_settings = settings;
+    m_reportPending = settings.enabled;
+    if (!settings.enabled)
+    {
+        return;
+    }
+#ifdef __linux__
+    raiseLimit(RLIMIT_RTPRIO);
+    rlim_t lockLimit = raiseLimit(RLIMIT_MEMLOCK);
+    m_lockLimit = lockLimit == RLIM_INFINITY ? 0 : static_cast<uint64_t>(lockLimit);
+
+    if (!settings.audioCores.empty())
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t others;
+        CPU_ZERO(&others);
+        for (long cpu = 0; cpu < cpus && cpu < CPU_SETSIZE; cpu++)
+        {
+            if (std::find(settings.audioCores.begin(), settings.audioCores.end(), cpu) == settings.audioCores.end())
+            {
+                CPU_SET(cpu, &others);
+            }
+        }
+        bool validCores = std::all_of(settings.audioCores.begin(), settings.audioCores.end(), [cpus](int core) { return core >= 0 && core < cpus; });
+        m_uiAffinityFailed = true;
+        if (!validCores)
+        {
+            m_uiAffinityResult = "audio cores " + coresToString(settings.audioCores) + " not all available, " + std::to_string(cpus) + " cores online";
+        }
+        else if (CPU_COUNT(&others) == 0)
+        {
+            m_uiAffinityResult = "every core is an audio core, the other threads are not pinned";
+        }
+        else if (int error = pthread_setaffinity_np(pthread_self(), sizeof(others), &others))
+        {
+            m_uiAffinityResult = "keeping the other threads off cores " + coresToString(settings.audioCores) + " failed: " + std::strerror(error);
+        }
+        else
+        {
+            m_uiAffinityFailed = false;
+            m_uiAffinityResult = "ui, video decoding and workers kept off cores " + coresToString(settings.audioCores);
+        }
+    }
+#else
+    m_uiAffinityFailed = true;
+    m_uiAffinityResult = "only available on Linux, nothing changed";
+#endif
+}
+
+bool PerformanceMode::isEnabled() const
+{
+    return m_settings.enabled;
+}
+
+void PerformanceMode::enterAudioThread()
+{
+    if (!m_settings.enabled || t_audioThreadPromoted)
+    {
+        return;
+    }
+    t_audioThreadPromoted = true;
+#ifdef __linux__
+    int policy = SCHED_OTHER;
+    sched_param param;
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    int priority = std::max(sched_get_priority_min(SCHED_FIFO), std::min(sched_get_priority_max(SCHED_FIFO), m_settings.audioPriority));
+    if ((policy == SCHED_FIFO || policy == SCHED_RR) && param.sched_priority >= priority)
+    {
+        // already real-time, set by the audio driver (jack, rtaudio)
+        m_audioPriority = param.sched_priority;
+        m_audioPriorityError = 0;
+    }
+    else
+    {
+        param.sched_priority = priority;
+        int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        m_audioPriority = error == 0 ? priority : 0;
+        m_audioPriorityError = error;
+    }
+
+    if (!m_settings.audioCores.empty())
+    {
+        cpu_set_t cores;
+        CPU_ZERO(&cores);
+        for (int core : m_settings.audioCores)
+        {
+            if (core >= 0 && core < CPU_SETSIZE)
+            {
+                CPU_SET(core, &cores);
+            }
+        }
+        m_audioAffinityError = pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+    }
+#endif
+    m_audioGeneration.fetch_add(1, std::memory_order_release);
+}
+
+void PerformanceMode::lockSongBuffers(const std::vector<std::shared_ptr<const AudioData>>& tracks)
+{
+    if (!m_settings.enabled || !m_settings.lockMemory)
+    {
+        return;
+    }
+#ifdef __linux__
+    for (const auto& lockedTrack : m_lockedTracks)
+    {
+        auto track = lockedTrack.lock();
+        if (track != nullptr)
+        {
+            munlock(track->getSampleData(), track->getSampleBytes());
+        }
+    }
+    m_lockedTracks.clear();
+    m_lockedBytes = 0;
+    m_unlockedBytes = 0;
+    m_lockError = 0;
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    for (const auto& track : tracks)
+    {
+        if (track == nullptr || track->getSampleBytes() == 0)
+        {
+            continue;
+        }
+        const char* data = static_cast<const char*>(track->getSampleData());
+        size_t bytes = track->getSampleBytes();
+        // mlock faults the pages in
+        if (mlock(data, bytes) == 0)
+        {
+            m_lockedTracks.push_back(track);
+            m_lockedBytes += bytes;
+        }
+        else
+        {
+            m_lockError = errno;
+            // still resident at the start of the song, though they can be swapped out later
+            volatile char sink = 0;
+            for (size_t offset = 0; offset < bytes; offset += pageSize)
+            {
+                sink += data[offset];
+            }
+            m_unlockedBytes += bytes;
+        }
+    }
+#endif
+    m_reportPending = true;
+}
+
+bool PerformanceMode::pollReport(std::vector<std::string>& lines)
+{
+    uint32_t generation = m_audioGeneration.load(std::memory_order_acquire);
+    if (!m_reportPending && generation == m_reportedGeneration)
+    {
+        return false;
+    }
+    m_reportPending = false;
+    m_reportedGeneration = generation;
+    lines = buildReport();
+    return true;
+}
+
+std::vector<std::string> PerformanceMode::buildReport() const
+{
+    std::vector<std::string> lines;
+    if (!m_settings.enabled)
+    {
+        return lines;
+    }
+#ifdef __linux__
+    if (m_audioGeneration.load(std::memory_order_acquire) == 0)
+    {
+        lines.push_back("audio thread: not started yet");
+    }
+    else
+    {
+        if (m_audioPriority > 0)
+        {
+            lines.push_back("audio and midi clock thread: SCHED_FIFO priority " + std::to_string(m_audioPriority));
+        }
+        else
+        {
+            lines.push_back(std::string("audio and midi clock thread: real-time priority refused (") + std::strerror(m_audioPriorityError)
+                + "), allow it with 'rtprio' in /etc/security/limits.d for the audio group");
+        }
+        if (!m_settings.audioCores.empty())
+        {
+            if (m_audioAffinityError == 0)
+            {
+                lines.push_back("audio thread pinned to cores " + coresToString(m_settings.audioCores));
+            }
+            else
+            {
+                lines.push_back("pinning the audio thread to cores " + coresToString(m_settings.audioCores) + " failed: " + std::strerror(m_audioAffinityError));
+            }
+        }
+    }
+#endif
+    if (!m_uiAffinityResult.empty())
+    {
+        lines.push_back(m_uiAffinityResult);
+    }
+#ifdef __linux__
+    if (m_settings.lockMemory && (m_lockedBytes > 0 || m_unlockedBytes > 0))
+    {
+        lines.push_back("song tracks locked in ram: " + toMb(m_lockedBytes));
+        if (m_unlockedBytes > 0)
+        {
+            lines.push_back(std::string("locking ") + toMb(m_unlockedBytes) + " failed (" + std::strerror(m_lockError) + "), "
+                + (m_lockLimit > 0 ? "limit " + toMb(m_lockLimit) + ", " : "")
+                + "prefaulted only: raise 'memlock' in /etc/security/limits.d");
+        }
+    }
+#endif
+    for (auto& line : lines)
+    {
+        line = "performance mode: " + line;
+    }
+    return lines;
+}
+
+std::string PerformanceMode::getSummary() const
+{
+    if (!m_settings.enabled)
+    {
+        return "";
+    }
+#ifdef __linux__
+    std::string summary;
+    if (m_audioGeneration.load(std::memory_order_acquire) > 0)
+    {
+        summary = m_audioPriority > 0 ? "RT " + std::to_string(m_audioPriority) : "RT refused";
+    }
+    if (!m_settings.audioCores.empty())
+    {
+        summary += (summary.empty() ? "" : ", ") + std::string("cores ") + coresToString(m_settings.audioCores);
+    }
+    if (m_settings.lockMemory)
+    {
+        summary += (summary.empty() ? "" : ", ") + std::string("locked ") + toMb(m_lockedBytes);
+    }
+    return summary;
+#else
+    return "RT: Linux only";
+#endif
+}
+
+bool PerformanceMode::hasFailures() const
+{
+    if (!m_settings.enabled)
+    {
+        return false;
+    }
+    bool audioFailed = m_audioGeneration.load(std::memory_order_acquire) > 0 && (m_audioPriority == 0 || m_audioAffinityError != 0);
+    return audioFailed || m_uiAffinityFailed || m_unlockedBytes > 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "stemPlayer.h"
+
+struct PerformanceSettings {
+    bool enabled = false;
+    int audioPriority = 70;  // SCHED_FIFO priority of the audio thread (the midi clock is sent from it)
+    std::vector<int> audioCores;  // cores of the audio thread, the other threads are kept off them. Empty: no pinning
+    bool lockMemory = true;  // mlock the decoded tracks of the loaded song
+};
+
+// Opt-in performance mode (Linux): real-time priority and cpu pinning of the audio thread,
+// decoded tracks locked in ram. What could not be obtained is reported, never fatal.
+// The midi clock and program changes are sent from the audio thread, the video is
+// decoded by threads of the ui thread, which inherit its cpu set.
+class PerformanceMode {
+public:
+    // ui thread, before the midi and audio devices are opened: pins the ui thread
+    // (and every thread created after) off the audio cores
+    void setup(const PerformanceSettings& settings);
+    bool isEnabled() const;
+
+    // audio thread, every buffer: promotes a new device thread once
+    void enterAudioThread();
+
+    // ui thread: locks and prefaults the tracks of the loaded song, unlocks those of the previous one
+    void lockSongBuffers(const std::vector<std::shared_ptr<const AudioData>>& tracks);
+
+    // ui thread: report lines, true when they changed since the last call
+    bool pollReport(std::vector<std::string>& lines);
+    // one line for the main window, empty when disabled
+    std::string getSummary() const;
+    bool hasFailures() const;
+
+private:
+    std::vector<std::string> buildReport() const;
+
+    PerformanceSettings m_settings;
+    std::string m_uiAffinityResult;
+    bool m_uiAffinityFailed = false;
+
+    // written by the audio thread
+    std::atomic<uint32_t> m_audioGeneration {0};
+    std::atomic<int> m_audioPriority {0};  // obtained priority, 0 when refused
+    std::atomic<int> m_audioPriorityError {0};
+    std::atomic<int> m_audioAffinityError {0};
+    uint32_t m_reportedGeneration = 0;
+
+    std::vector<std::weak_ptr<const AudioData>> m_lockedTracks;
+    uint64_t m_lockedBytes = 0;
+    uint64_t m_unlockedBytes = 0;  // prefaulted only
+    int m_lockError = 0;
+    uint64_t m_lockLimit = 0;  // RLIMIT_MEMLOCK, 0 when unlimited
+    bool m_reportPending = false;
+};
@@ -0,0 +1,145 @@
+#include "routing.h"
+
+#include <algorithm>
+
+namespace {
+    std::string toLower(std::string value)
+    {
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+        return value;
+    }
+} // unnamed namespace
+
+RoutingConfig::RoutingConfig() {
+    m_buses.push_back({"main", 0, 1});
+}
+
+void RoutingConfig::load(ofxXmlSettings& settings)
+{
+    if (!settings.tagExists("audio_routing"))
+    {
+        return;
+    }
+    settings.pushTag("audio_routing");
+
+    std::vector<OutputBus> buses;
+    int nbBuses = settings.getNumTags("bus");
+    for (int i = 0; i < nbBuses; i++)
+    {
+        settings.pushTag("bus", i);
+        OutputBus bus;
+        bus.name = settings.getValue("name", "bus" + ofToString(i + 1));
+        // channels are numbered from 1 in the settings, as on the sound card
+        bus.leftChannel = std::max(1, settings.getValue("left", 1)) - 1;
+        bus.rightChannel = std::max(1, settings.getValue("right", bus.leftChannel + 1)) - 1;
+        buses.push_back(bus);
+        settings.popTag();
+    }
+    if (buses.size() > 0)
+    {
+        m_buses = buses;
+    }
+    m_defaultBus = settings.getValue("default_bus", m_buses[0].name);
+    m_routes = readRoutes(settings);
+
+    settings.popTag();
+
+    for (const auto& bus : m_buses)
+    {
+        ofLog() << "output bus " << bus.name << " -> channels " << bus.leftChannel + 1 << "/" << bus.rightChannel + 1;
+    }
+}
+
+void RoutingConfig::loadSongRoutes(const std::string& filePath)
+{
+    m_songRoutes.clear();
+    ofxXmlSettings settings;
+    if (!settings.load(filePath))
+    {
+        return;
+    }
+    settings.pushTag("routing");
+    m_songRoutes = readRoutes(settings);
+    settings.popTag();
+}
+
+std::vector<TrackRoute> RoutingConfig::readRoutes(ofxXmlSettings& settings)
+{
+    std::vector<TrackRoute> routes;
+    int nbRoutes = settings.getNumTags("route");
+    for (int i = 0; i < nbRoutes; i++)
+    {
+        settings.pushTag("route", i);
+        TrackRoute route;
+        route.containing = toLower(settings.getValue("containing", ""));
+        int nbBuses = settings.getNumTags("bus");
+        for (int j = 0; j < nbBuses; j++)
+        {
+            route.buses.push_back(settings.getValue("bus", "", j));
+        }
+        routes.push_back(route);
+        settings.popTag();
+    }
+    return routes;
+}
+
+const std::vector<OutputBus>& RoutingConfig::getBuses() const
+{
+    return m_buses;
+}
+
+unsigned int RoutingConfig::getOutputChannels() const
+{
+    int channels = 2;
+    for (const auto& bus : m_buses)
+    {
+        channels = std::max(channels, std::max(bus.leftChannel, bus.rightChannel) + 1);
+    }
+    return static_cast<unsigned int>(channels);
+}
+
+int RoutingConfig::findBus(const std::string& name) const
+{
+    for (int i = 0; i < static_cast<int>(m_buses.size()); i++)
+    {
+        if (m_buses[i].name == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+std::vector<float> RoutingConfig::getTrackSends(const std::string& trackName) const
+{
+    std::vector<float> sends(m_buses.size(), 0.0f);
+    std::string lowerTrackName = toLower(trackName);
+
+    for (const auto* routes : {&m_songRoutes, &m_routes})
+    {
+        for (const auto& route : *routes)
+        {
+            if (route.containing.empty() || lowerTrackName.find(route.containing) == std::string::npos)
+            {
+                continue;
+            }
+            for (const auto& busName : route.buses)
+            {
+                int bus = findBus(busName);
+                if (bus >= 0)
+                {
+                    sends[bus] = 1.0f;
+                }
+                else
+                {
+                    ofLogError() << "unknown output bus " << busName << " for track " << trackName;
+                }
+            }
+            return sends;
+        }
+    }
+
+    int bus = findBus(m_defaultBus);
+    sends[bus >= 0 ? bus : 0] = 1.0f;
+    return sends;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ofxXmlSettings.h"
+
+// stereo output bus, sent to two channels of the sound device
+struct OutputBus {
+    std::string name;
+    int leftChannel = 0;  // device channels, 0-based
+    int rightChannel = 1;  // same as left for a mono bus
+};
+
+// tracks whose file name contains a string are sent to a list of buses
+struct TrackRoute {
+    std::string containing;  // lower case
+    std::vector<std::string> buses;
+};
+
+// Routing matrix: tracks -> output buses -> device channels.
+// Buses and default routes are global (settings.xml, <audio_routing>), a song can
+// add its own routes in <song>/routing.xml, they are checked first.
+// Without configuration, every track goes to a single bus on channels 1/2.
+class RoutingConfig {
+public:
+    RoutingConfig();
+
+    // reads <audio_routing> at the current level of settings.xml
+    void load(ofxXmlSettings& settings);
+    // routes of a song, replaced at every call
+    void loadSongRoutes(const std::string& filePath);
+
+    const std::vector<OutputBus>& getBuses() const;
+    unsigned int getOutputChannels() const;
+    // send level of a track to every bus
+    std::vector<float> getTrackSends(const std::string& trackName) const;
+    // index in getBuses(), -1 if there is no bus with this name
+    int findBus(const std::string& name) const;
+
+private:
+    static std::vector<TrackRoute> readRoutes(ofxXmlSettings& settings);
+
+    std::vector<OutputBus> m_buses;
+    std::vector<TrackRoute> m_routes;
+    std::vector<TrackRoute> m_songRoutes;
+    std::string m_defaultBus = "main";
+};
@@ -0,0 +1,433 @@
+#include "setlistBundle.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "ofxXmlSettings.h"
+
+#include "asyncWriter.h"
+#include "midiOutput.h"
+#include "stringUtils.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    const char BUNDLE_MAGIC[4] = {'T', 'S', 'L', 'B'};
+    const uint32_t BUNDLE_VERSION = 4;
+    // sanity bound of the counts read from the file
+    const uint32_t MAX_BUNDLE_COUNT = 1 << 20;
+
+    template<typename T>
+    void writeValue(std::ostream& stream, T value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool readValue(std::ifstream& stream, T& value)
+    {
+        stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return stream.good();
+    }
+
+    void writeString(std::ostream& stream, const std::string& value)
+    {
+        writeValue<uint32_t>(stream, static_cast<uint32_t>(value.size()));
+        stream.write(value.data(), value.size());
+    }
+
+    bool readString(std::ifstream& stream, std::string& value)
+    {
+        uint32_t size = 0;
+        if (!readValue(stream, size) || size > MAX_BUNDLE_COUNT)
+        {
+            return false;
+        }
+        value.resize(size);
+        stream.read(&value[0], size);
+        return stream.good();
+    }
+
+    void writeStamp(std::ostream& stream, const SetlistBundle::FileStamp& stamp)
+    {
+        writeValue<int64_t>(stream, stamp.modified);
+        writeValue<uint64_t>(stream, stamp.size);
+    }
+
+    bool readStamp(std::ifstream& stream, SetlistBundle::FileStamp& stamp)
+    {
+        return readValue(stream, stamp.modified) && readValue(stream, stamp.size);
+    }
+} // unnamed namespace
+
+void SetlistBundle::setup(const std::string& songsRootDir, const std::vector<std::shared_ptr<MidiOutput>>& midiOuts,
+    const std::vector<std::string>& ignoredAudioFiles)
+{
+    m_songsRootDir = songsRootDir;
+    m_midiOuts = midiOuts;
+    m_ignoredAudioFiles = ignoredAudioFiles;
+}
+
+void SetlistBundle::setWriter(Tonton::Utils::AsyncWriter* writer)
+{
+    m_writer = writer;
+}
+
+SetlistBundle::FileStamp SetlistBundle::getFileStamp(const std::string& path)
+{
+    FileStamp stamp;
+    std::error_code error;
+    fs::path filePath(ofToDataPath(path));
+    auto modified = fs::last_write_time(filePath, error);
+    if (error)
+    {
+        return stamp;
+    }
+    stamp.modified = static_cast<int64_t>(modified.time_since_epoch().count());
+    if (fs::is_regular_file(filePath, error))
+    {
+        stamp.size = static_cast<uint64_t>(fs::file_size(filePath, error));
+    }
+    return stamp;
+}
+
+void SetlistBundle::load(const std::string& bundlePath, const std::string& setlistPath, const std::string& settingsPath)
+{
+    uint64_t startTime = ofGetElapsedTimeMillis();
+    m_bundlePath = bundlePath;
+    FileStamp setlistStamp = getFileStamp(setlistPath);
+    FileStamp settingsStamp = getFileStamp(settingsPath);
+    bool upToDate = read(bundlePath, settingsStamp);
+    if (!upToDate)
+    {
+        m_songs.clear();
+    }
+    if (!upToDate || setlistStamp != m_setlistStamp || setlistStamp == FileStamp())
+    {
+        m_setlistStamp = setlistStamp;
+        compileSetlist(setlistPath);
+        upToDate = false;
+    }
+    m_settingsStamp = settingsStamp;
+
+    size_t compiled = 0;
+    for (const auto& songName : m_setlist)
+    {
+        CompiledSong& song = m_songs[songName];
+        if (isStale(songName, song))
+        {
+            compileSong(songName, song);
+            compiled++;
+        }
+    }
+    // songs removed from the setlist
+    for (auto song = m_songs.begin(); song != m_songs.end();)
+    {
+        if (std::find(m_setlist.begin(), m_setlist.end(), song->first) == m_setlist.end())
+        {
+            song = m_songs.erase(song);
+            upToDate = false;
+        }
+        else
+        {
+            ++song;
+        }
+    }
+
+    if ((!upToDate || compiled > 0) && !save(bundlePath))
+    {
+        ofLogWarning() << "could not write " << bundlePath << ", the setlist will be compiled again at the next start";
+    }
+    ofLog() << "setlist bundle: " << m_setlist.size() << " songs, " << compiled << " compiled, in " << (ofGetElapsedTimeMillis() - startTime) << " ms";
+}
+
+const std::vector<std::string>& SetlistBundle::getSetlist() const
+{
+    return m_setlist;
+}
+
+const SetlistBundle::CompiledSong& SetlistBundle::getSong(const std::string& songName)
+{
+    CompiledSong& song = m_songs[songName];
+    if (isStale(songName, song))
+    {
+        compileSong(songName, song);
+        if (!m_bundlePath.empty() && m_writer != nullptr)
+        {
+            m_writer->write(ofToDataPath(m_bundlePath, true), serialize());
+        }
+        else if (!m_bundlePath.empty())
+        {
+            save(m_bundlePath);
+        }
+    }
+    return song;
+}
+
+SetlistBundle::CompiledSong SetlistBundle::getSongCopy(const std::string& songName) const
+{
+    CompiledSong song;
+    auto compiled = m_songs.find(songName);
+    if (compiled != m_songs.end())
+    {
+        song = compiled->second;
+    }
+    if (isStale(songName, song))
+    {
+        compileSong(songName, song);
+    }
+    return song;
+}
+
+bool SetlistBundle::isStale(const std::string& songName, const CompiledSong& song) const
+{
+    FileStamp structureStamp = getFileStamp(m_songsRootDir + songName + "/structure.xml");
+    FileStamp audioDirStamp = getFileStamp(m_songsRootDir + songName + "/audio");
+    return !song.compiled || structureStamp != song.structureStamp || audioDirStamp != song.audioDirStamp;
+}
+
+void SetlistBundle::compileSetlist(const std::string& setlistPath)
+{
+    m_setlist.clear();
+    ofxXmlSettings settings;
+    if (settings.load(setlistPath)) {
+        settings.pushTag("setlist");
+        int numberOfSongs = settings.getNumTags("song");
+        for (int i = 0; i < numberOfSongs; i++) {
+            settings.pushTag("song", i);
+            std::string songName = settings.getValue("name", "");
+            // TODO verifications
+            shortenString(songName, 20, -1, 0);
+            m_setlist.push_back(songName);
+            settings.popTag();
+        }
+    }
+    else {
+        ofLogError() << "setlist.xml not found, creating a default setlist";
+        ofDirectory dir;
+        dir.listDir(m_songsRootDir);
+        for (int i = 0; i < dir.size(); i++) {
+            m_setlist.push_back(dir.getName(i));
+        }
+    }
+}
+
+void SetlistBundle::compileSong(const std::string& songName, CompiledSong& song) const
+{
+    std::string structurePath = m_songsRootDir + songName + "/structure.xml";
+    std::string audioDir = m_songsRootDir + songName + "/audio";
+    // stamped before reading, a file changed meanwhile is compiled again next time
+    song.structureStamp = getFileStamp(structurePath);
+    song.audioDirStamp = getFileStamp(audioDir);
+    song.compiled = true;
+
+    song.problems.clear();
+    song.song = std::make_shared<const Song>(loadSongStructure(structurePath, m_midiOuts, &song.problems));
+    if (song.song->getEvents().empty())
+    {
+        ofLogError() << "Impossible de charger " + structurePath;
+    }
+
+    ofDirectory dir;
+    dir.allowExt("wav");
+    dir.allowExt("flac");
+    dir.allowExt("mp3");
+    dir.listDir(audioDir);
+
+    // find suitable audio files
+    song.audioFiles.clear();
+    for (int i = 0; i < dir.size(); i++) {
+        string trackName = fs::path(dir.getPath(i)).filename().string();
+        bool ignoreFile = false;
+
+        string lowerTrackName = trackName;
+        transform(lowerTrackName.begin(), lowerTrackName.end(), lowerTrackName.begin(), ::tolower);
+        for (auto ignoreString : m_ignoredAudioFiles)
+        {
+            if (lowerTrackName.find(ignoreString) != string::npos)
+            {
+                ofLog() << "File " + trackName + " ignored";
+                ignoreFile = true;
+                continue;
+            }
+        }
+        if (!ignoreFile)    song.audioFiles.push_back(dir.getPath(i));
+    }
+}
+
+bool SetlistBundle::save(const std::string& bundlePath) const
+{
+    // replaced, not truncated: a crash while writing leaves the previous bundle
+    return Tonton::Utils::replaceFile(ofToDataPath(bundlePath, true), serialize());
+}
+
+std::string SetlistBundle::serialize() const
+{
+    std::ostringstream stream(std::ios::binary);
+    stream.write(BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    writeValue<uint32_t>(stream, BUNDLE_VERSION);
+    writeStamp(stream, m_settingsStamp);
+    writeStamp(stream, m_setlistStamp);
+    writeString(stream, m_songsRootDir);
+
+    writeValue<uint32_t>(stream, static_cast<uint32_t>(m_setlist.size()));
+    for (const auto& songName : m_setlist)
+    {
+        writeString(stream, songName);
+    }
+
+    writeValue<uint32_t>(stream, static_cast<uint32_t>(m_songs.size()));
+    for (const auto& entry : m_songs)
+    {
+        const CompiledSong& song = entry.second;
+        writeString(stream, entry.first);
+        writeStamp(stream, song.structureStamp);
+        writeStamp(stream, song.audioDirStamp);
+        const std::vector<songEvent>& events = song.song->getEvents();
+        writeValue<uint32_t>(stream, static_cast<uint32_t>(events.size()));
+        for (const auto& event : events)
+        {
+            writeValue<int64_t>(stream, event.tick);
+            writeValue<int32_t>(stream, event.program);
+            writeString(stream, event.programName);
+            writeValue<float>(stream, event.bpm);
+            writeString(stream, event.shader);
+            writeString(stream, event.name);
+            writeValue<uint32_t>(stream, static_cast<uint32_t>(event.patches.size()));
+            for (const auto& patch : event.patches)
+            {
+                writeValue<uint32_t>(stream, patch.programNumber);
+                writeValue<uint32_t>(stream, patch.midiOutputIndex);
+                writeString(stream, patch.name);
+            }
+        }
+        writeValue<uint32_t>(stream, static_cast<uint32_t>(song.audioFiles.size()));
+        for (const auto& audioFile : song.audioFiles)
+        {
+            writeString(stream, audioFile);
+        }
+        writeValue<uint32_t>(stream, static_cast<uint32_t>(song.problems.size()));
+        for (const auto& problem : song.problems)
+        {
+            writeString(stream, problem);
+        }
+    }
+    return stream.str();
+}
+
+bool SetlistBundle::read(const std::string& bundlePath, const FileStamp& settingsStamp)
+{
+    std::ifstream stream(ofToDataPath(bundlePath), std::ios::binary);
+    if (!stream.is_open())
+    {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    FileStamp storedSettingsStamp;
+    std::string songsRootDir;
+    stream.read(magic, sizeof(magic));
+    if (!stream.good() || std::memcmp(magic, BUNDLE_MAGIC, sizeof(magic)) != 0
+        || !readValue(stream, version) || version != BUNDLE_VERSION
+        || !readStamp(stream, storedSettingsStamp) || !readStamp(stream, m_setlistStamp)
+        || !readString(stream, songsRootDir))
+    {
+        return false;
+    }
+    // patches and ignored files come from settings.xml
+    if (storedSettingsStamp != settingsStamp || songsRootDir != m_songsRootDir)
+    {
+        return false;
+    }
+
+    uint32_t count = 0;
+    if (!readValue(stream, count) || count > MAX_BUNDLE_COUNT)
+    {
+        return false;
+    }
+    std::vector<std::string> setlist(count);
+    for (auto& songName : setlist)
+    {
+        if (!readString(stream, songName))
+        {
+            return false;
+        }
+    }
+
+    std::map<std::string, CompiledSong> songs;
+    if (!readValue(stream, count) || count > MAX_BUNDLE_COUNT)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        std::string songName;
+        CompiledSong song;
+        song.compiled = true;
+        uint32_t eventCount = 0;
+        if (!readString(stream, songName) || !readStamp(stream, song.structureStamp) || !readStamp(stream, song.audioDirStamp)
+            || !readValue(stream, eventCount) || eventCount > MAX_BUNDLE_COUNT)
+        {
+            return false;
+        }
+        std::vector<songEvent> events(eventCount);
+        for (auto& event : events)
+        {
+            int64_t tick = 0;
+            int32_t program = 0;
+            uint32_t patchCount = 0;
+            if (!readValue(stream, tick) || !readValue(stream, program) || !readString(stream, event.programName)
+                || !readValue(stream, event.bpm) || !readString(stream, event.shader) || !readString(stream, event.name)
+                || !readValue(stream, patchCount) || patchCount > MAX_BUNDLE_COUNT)
+            {
+                return false;
+            }
+            event.tick = static_cast<long>(tick);
+            event.program = program;
+            event.patches.resize(patchCount);
+            for (auto& patch : event.patches)
+            {
+                if (!readValue(stream, patch.programNumber) || !readValue(stream, patch.midiOutputIndex) || !readString(stream, patch.name))
+                {
+                    return false;
+                }
+            }
+        }
+        song.song = std::make_shared<const Song>(std::move(events));
+        uint32_t audioFileCount = 0;
+        if (!readValue(stream, audioFileCount) || audioFileCount > MAX_BUNDLE_COUNT)
+        {
+            return false;
+        }
+        song.audioFiles.resize(audioFileCount);
+        for (auto& audioFile : song.audioFiles)
+        {
+            if (!readString(stream, audioFile))
+            {
+                return false;
+            }
+        }
+        uint32_t problemCount = 0;
+        if (!readValue(stream, problemCount) || problemCount > MAX_BUNDLE_COUNT)
+        {
+            return false;
+        }
+        song.problems.resize(problemCount);
+        for (auto& problem : song.problems)
+        {
+            if (!readString(stream, problem))
+            {
+                return false;
+            }
+        }
+        songs.emplace(songName, std::move(song));
+    }
+
+    m_setlist = std::move(setlist);
+    m_songs = std::move(songs);
+    return true;
+}
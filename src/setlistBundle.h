@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "song.h"
+
+class MidiOutput;
+namespace Tonton { namespace Utils { class AsyncWriter; } }
+
+// Compiled setlist: song names, parsed structures and audio file lists of the whole setlist,
+// in one binary file next to setlist.xml. Each part records the modification time and size of
+// the files it was compiled from and is recompiled only when they changed, so starting the
+// app and loading a song read no xml once the bundle is up to date.
+// The patches are resolved for the midi outputs of settings.xml, which also lists the ignored
+// audio files: a change of settings.xml recompiles every song.
+class SetlistBundle {
+public:
+    struct FileStamp {
+        int64_t modified = 0;
+        uint64_t size = 0;  // 0 for directories
+
+        bool operator==(const FileStamp& other) const { return modified == other.modified && size == other.size; }
+        bool operator!=(const FileStamp& other) const { return !(*this == other); }
+    };
+
+    struct CompiledSong {
+        // no parts when the song has no structure.xml. The patch table is built when read, not stored
+        std::shared_ptr<const Song> song = std::make_shared<const Song>(std::vector<songEvent>());
+        std::vector<std::string> audioFiles;  // paths of the audio files, ignored ones excluded
+        std::vector<std::string> problems;  // unknown patches and inconsistent parts of structure.xml
+        FileStamp structureStamp;
+        FileStamp audioDirStamp;
+        bool compiled = false;
+    };
+
+    void setup(const std::string& songsRootDir, const std::vector<std::shared_ptr<MidiOutput>>& midiOuts,
+        const std::vector<std::string>& ignoredAudioFiles);
+    // the bundle saved by getSong() is written by writer, off the ui thread. nullptr: written by getSong()
+    void setWriter(Tonton::Utils::AsyncWriter* writer);
+
+    // reads the bundle, recompiles what changed since it was written and saves it back
+    void load(const std::string& bundlePath, const std::string& setlistPath, const std::string& settingsPath);
+    const std::vector<std::string>& getSetlist() const;
+    // compiled song, recompiled first if its files changed
+    const CompiledSong& getSong(const std::string& songName);
+    // any thread, the bundle left unchanged: a copy of the song, recompiled if its files changed
+    CompiledSong getSongCopy(const std::string& songName) const;
+
+    static FileStamp getFileStamp(const std::string& path);
+
+private:
+    // false when settings.xml changed since it was written. The setlist.xml stamp is read into
+    // m_setlistStamp, load() compares it
+    bool read(const std::string& bundlePath, const FileStamp& settingsStamp);
+    bool save(const std::string& bundlePath) const;
+    std::string serialize() const;
+    void compileSetlist(const std::string& setlistPath);
+    void compileSong(const std::string& songName, CompiledSong& song) const;
+    bool isStale(const std::string& songName, const CompiledSong& song) const;
+
+    std::string m_songsRootDir;
+    std::vector<std::shared_ptr<MidiOutput>> m_midiOuts;
+    std::vector<std::string> m_ignoredAudioFiles;
+    Tonton::Utils::AsyncWriter* m_writer = nullptr;
+
+    std::string m_bundlePath;
+    FileStamp m_setlistStamp;
+    FileStamp m_settingsStamp;
+    std::vector<std::string> m_setlist;
+    std::map<std::string, CompiledSong> m_songs;
+};
@@ -0,0 +1,305 @@
+#include "setlistPreflight.h"
+
+#include <algorithm>
+#include <set>
+
+#include "ofMain.h"
+
+#include "audioFileReader.h"
+#include "midiOutput.h"
+
+namespace {
+    std::string formatDuration(double seconds)
+    {
+        int total = static_cast<int>(seconds + 0.5);
+        char text[16];
+        if (total >= 3600)
+        {
+            snprintf(text, sizeof(text), "%d:%02d:%02d", total / 3600, (total / 60) % 60, total % 60);
+        }
+        else
+        {
+            snprintf(text, sizeof(text), "%d:%02d", total / 60, total % 60);
+        }
+        return text;
+    }
+} // unnamed namespace
+
+SetlistPreflight::~SetlistPreflight()
+{
+    cancel();
+}
+
+void SetlistPreflight::start(const SetlistBundle& bundle, const std::vector<std::shared_ptr<MidiOutput>>& midiOuts)
+{
+    cancel();
+    m_cancel = false;
+    m_done = false;
+    m_checked = false;
+    m_nextSong = 0;
+    m_checkedSongs = 0;
+    m_shaders.clear();
+    m_compiledShaders.clear();
+    m_startTime = ofGetElapsedTimeMillis();
+    m_bundle = bundle;
+    m_outputNames.clear();
+    for (const auto& midiOut : midiOuts)
+    {
+        if (midiOut->_deviceIndex >= 0)
+        {
+            m_outputNames.resize(std::max<size_t>(m_outputNames.size(), midiOut->_deviceIndex + 1));
+            m_outputNames[midiOut->_deviceIndex] = midiOut->_deviceName;
+        }
+    }
+    const std::vector<std::string>& setlist = m_bundle.getSetlist();
+    m_reports.clear();
+    m_reports.resize(setlist.size());
+    for (size_t i = 0; i < m_reports.size(); i++)
+    {
+        m_reports[i].name = setlist[i];
+    }
+    if (m_reports.empty())
+    {
+        m_done = true;
+        return;
+    }
+
+    // one core left to the ui thread, which loads the first song meanwhile
+    size_t workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    workers = std::min(m_reports.size(), std::max<size_t>(1, workers));
+    for (size_t i = 0; i < workers; i++)
+    {
+        m_workers.emplace_back(&SetlistPreflight::runWorker, this);
+    }
+}
+
+void SetlistPreflight::cancel()
+{
+    m_cancel = true;
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+}
+
+void SetlistPreflight::runWorker()
+{
+    while (!m_cancel)
+    {
+        size_t index = m_nextSong.fetch_add(1);
+        if (index >= m_reports.size())
+        {
+            return;
+        }
+        checkSong(m_reports[index], m_bundle.getSongCopy(m_reports[index].name));
+        m_checkedSongs.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void SetlistPreflight::checkSong(SongReport& report, const SetlistBundle::CompiledSong& song) const
+{
+    // structure and patches, as resolved when the bundle was compiled
+    report.warnings = song.problems;
+    const std::vector<songEvent>& events = song.song->getEvents();
+    if (events.empty())
+    {
+        report.warnings.push_back("no structure.xml, a 120 bpm structure is inferred from the audio");
+    }
+    else if (events.size() == 1)
+    {
+        report.warnings.push_back("a single part, the last part of the structure marks the end of the song");
+    }
+    else
+    {
+        report.durationSeconds = getSongTimeMs(events, events.back().tick) / 1000.0;
+    }
+
+    // program changes as the metronome sends them, once per change
+    const PatchTable& patchTable = song.song->getPatchTable();
+    for (size_t output = 0; output < patchTable.getOutputCount(); output++)
+    {
+        for (size_t part = 0; part < patchTable.getPartCount(); part++)
+        {
+            int program = patchTable.get(part, output).program;
+            if (program > 127 && (part == 0 || patchTable.get(part - 1, output).program != program))
+            {
+                std::string outputName = output < m_outputNames.size() ? m_outputNames[output] : ofToString(output);
+                report.errors.push_back("part " + ofToString(part + 1) + ": program " + ofToString(program) + " for "
+                    + outputName + " is out of the midi range 0-127");
+            }
+        }
+    }
+
+    std::set<std::string> shaders;
+    for (const auto& event : events)
+    {
+        if (!event.shader.empty() && shaders.insert(event.shader).second)
+        {
+            if (!ofFile::doesFileExist("shaders/" + event.shader + ".frag"))
+            {
+                report.errors.push_back("shader file shaders/" + event.shader + ".frag not found");
+            }
+            else
+            {
+                report.shaders.push_back(event.shader);
+            }
+        }
+    }
+
+    // audio headers
+    if (song.audioFiles.empty())
+    {
+        report.errors.push_back("no audio files");
+    }
+    double audioSeconds = 0.0;
+    for (const auto& audioFile : song.audioFiles)
+    {
+        if (m_cancel)
+        {
+            return;
+        }
+        std::string fileName = ofFilePath::getFileName(audioFile);
+        AudioFileReader reader;
+        if (!reader.open(ofToDataPath(audioFile)))
+        {
+            report.errors.push_back("cannot open " + fileName);
+            continue;
+        }
+        if (reader.getTotalFrames() == 0 || reader.getSampleRate() == 0)
+        {
+            report.errors.push_back(fileName + " is empty");
+            continue;
+        }
+        if (reader.getChannels() > 2)
+        {
+            report.warnings.push_back(fileName + ": " + ofToString(reader.getChannels()) + " channels, only the first two are played");
+        }
+        audioSeconds = std::max(audioSeconds, static_cast<double>(reader.getTotalFrames()) / reader.getSampleRate());
+    }
+    if (report.durationSeconds == 0.0)
+    {
+        report.durationSeconds = audioSeconds;
+    }
+}
+
+void SetlistPreflight::update(bool playing)
+{
+    if (m_done || m_reports.empty())
+    {
+        return;
+    }
+    if (!m_checked)
+    {
+        if (m_checkedSongs.load(std::memory_order_acquire) < m_reports.size())
+        {
+            return;
+        }
+        cancel();
+        queueShaders();
+        m_checked = true;
+    }
+    // a compilation stalls the frame it runs in
+    if (m_compiledShaders.size() < m_shaders.size())
+    {
+        if (!playing)
+        {
+            const std::string& shaderName = m_shaders[m_compiledShaders.size()];
+            ofShader shader;
+            m_compiledShaders[shaderName] = shader.load("shaders/default_150.vert", "shaders/" + shaderName + ".frag");
+        }
+        return;
+    }
+    finish();
+}
+
+void SetlistPreflight::queueShaders()
+{
+    for (const auto& report : m_reports)
+    {
+        for (const auto& shaderName : report.shaders)
+        {
+            if (std::find(m_shaders.begin(), m_shaders.end(), shaderName) == m_shaders.end())
+            {
+                m_shaders.push_back(shaderName);
+            }
+        }
+    }
+}
+
+void SetlistPreflight::finish()
+{
+    m_done = true;
+    for (auto& report : m_reports)
+    {
+        for (const auto& shaderName : report.shaders)
+        {
+            if (!m_compiledShaders[shaderName])
+            {
+                report.errors.push_back("shader " + shaderName + " does not compile");
+            }
+        }
+        report.status = !report.errors.empty() ? Status::ERROR : !report.warnings.empty() ? Status::WARNING : Status::OK;
+        for (const auto& error : report.errors)
+        {
+            ofLogError() << "preflight " << report.name << ": " << error;
+        }
+        for (const auto& warning : report.warnings)
+        {
+            ofLogWarning() << "preflight " << report.name << ": " << warning;
+        }
+    }
+    ofLog() << getSummary() << ", in " << (ofGetElapsedTimeMillis() - m_startTime) << " ms";
+}
+
+bool SetlistPreflight::isDone() const
+{
+    return m_done;
+}
+
+const std::vector<SetlistPreflight::SongReport>& SetlistPreflight::getReports() const
+{
+    return m_reports;
+}
+
+double SetlistPreflight::getShowDurationSeconds() const
+{
+    double duration = 0.0;
+    for (const auto& report : m_reports)
+    {
+        duration += report.durationSeconds;
+    }
+    return duration;
+}
+
+std::string SetlistPreflight::getSummary() const
+{
+    if (m_reports.empty())
+    {
+        return "";
+    }
+    if (m_checked && !m_done)
+    {
+        return "preflight shaders " + ofToString(m_compiledShaders.size()) + "/" + ofToString(m_shaders.size());
+    }
+    if (!m_done)
+    {
+        return "preflight " + ofToString(m_checkedSongs.load()) + "/" + ofToString(m_reports.size());
+    }
+    size_t warnings = 0;
+    size_t errors = 0;
+    for (const auto& report : m_reports)
+    {
+        warnings += report.status == Status::WARNING ? 1 : 0;
+        errors += report.status == Status::ERROR ? 1 : 0;
+    }
+    return "preflight: " + ofToString(m_reports.size() - warnings - errors) + " ok, " + ofToString(warnings) + " warn, "
+        + ofToString(errors) + " err, show " + formatDuration(getShowDurationSeconds());
+}
+
+bool SetlistPreflight::hasProblems() const
+{
+    return std::any_of(m_reports.begin(), m_reports.end(), [](const SongReport& report) {
+        return report.status == Status::WARNING || report.status == Status::ERROR;
+    });
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "setlistBundle.h"
+
+// Checks every song of the setlist when the app starts, so a missing stem, an unknown patch
+// or a broken shader shows up before the show, not when the song is loaded on stage.
+// The songs are checked in worker threads: structure, patch resolution, audio files and
+// their headers, shader files. The shaders are then compiled on the ui thread, which owns
+// the gl context: one per frame, none while the transport plays.
+class SetlistPreflight {
+public:
+    enum class Status {
+        PENDING,
+        OK,
+        WARNING,
+        ERROR
+    };
+
+    struct SongReport {
+        std::string name;
+        Status status = Status::PENDING;
+        double durationSeconds = 0.0;  // structure duration, audio duration without structure
+        std::vector<std::string> errors;  // the song cannot be played as written
+        std::vector<std::string> warnings;
+        std::vector<std::string> shaders;
+    };
+
+    virtual ~SetlistPreflight();
+
+    // ui thread: the songs of the setlist, as compiled by the bundle. The workers recompile
+    // the songs whose files changed, in a copy of the bundle
+    void start(const SetlistBundle& bundle, const std::vector<std::shared_ptr<MidiOutput>>& midiOuts);
+    // ui thread, every frame: once the songs are checked, compiles one of their shaders when
+    // not playing, then logs the report
+    void update(bool playing);
+    void cancel();
+    bool isDone() const;
+
+    const std::vector<SongReport>& getReports() const;  // complete once done
+    double getShowDurationSeconds() const;
+    // one line for the main window
+    std::string getSummary() const;
+    bool hasProblems() const;
+
+private:
+    void runWorker();
+    void checkSong(SongReport& report, const SetlistBundle::CompiledSong& song) const;
+    void queueShaders();
+    void finish();
+
+    std::vector<SongReport> m_reports;
+    SetlistBundle m_bundle;
+    std::vector<std::string> m_outputNames;  // by midi output index
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_nextSong {0};
+    std::atomic<size_t> m_checkedSongs {0};
+    std::atomic<bool> m_cancel {false};
+    // ui thread, once the songs are checked
+    bool m_checked = false;
+    std::vector<std::string> m_shaders;  // each shader once, as ShadersSource loads them
+    std::map<std::string, bool> m_compiledShaders;  // shader, compiles
+    bool m_done = false;
+    uint64_t m_startTime = 0;
+};
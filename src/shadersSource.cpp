@@ -1,13 +1,15 @@
 #include "shadersSource.h"
 #include "metronome.h"
+#include "trace.h"
 
-void ShadersSource::setup(std::vector<songEvent> songEvents)
+void ShadersSource::setup(const Song& song)
 {
+    Tonton::Utils::TraceScope trace("shaders setup");
     m_currentSongPartIndex = 0;
     m_shaders.clear();
     m_events.clear();
 
-    for (auto event : songEvents) {
+    for (const auto& event : song.getEvents()) {
         shaderEvent e;
         e.tick = event.tick;
         e.bpm = event.bpm;
@@ -21,6 +23,7 @@ void ShadersSource::setup(std::vector<songEvent> songEvents)
             try
             {
                 ofShader shader;
+                Tonton::Utils::TraceScope traceCompile("shader compile", event.shader);
 				bool success = shader.load("shaders/default_150.vert", "shaders/" + event.shader + ".frag");
                 if (success)
                 {
@@ -12,7 +12,7 @@ struct shaderEvent {
 
 class ShadersSource {
 public:
-	void setup(std::vector<songEvent> songEvents);
+	void setup(const Song& song);
 	void draw(int targetWidth, int targetHeight, int ticks, float time, int screenId);
 
 private:
@@ -0,0 +1,422 @@
+#include "song.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <unordered_map>
+
+#include "midiOutput.h"
+#include "stringUtils.h"
+#include "xmlPullParser.h"
+
+double getSongTimeMs(const std::vector<songEvent>& songEvents, long beat)
+{
+    double msTime = 0.0;
+    for (int i = 0; i < static_cast<int>(songEvents.size()) - 1; i++)
+    {
+        if (beat <= songEvents[i].tick)
+        {
+            break;
+        }
+        long partBeats = std::min(beat, songEvents[i + 1].tick) - songEvents[i].tick;
+        msTime += partBeats * 1000.0 / songEvents[i].bpm * 60.0;
+    }
+    return msTime;
+}
+
+std::vector<long> getBarStartBeats(const std::vector<songEvent>& songEvents, unsigned int beatsPerBar)
+{
+    std::vector<long> bars;
+    for (int i = 0; i < static_cast<int>(songEvents.size()) - 1; i++)
+    {
+        for (long beat = songEvents[i].tick; beat < songEvents[i + 1].tick; beat += beatsPerBar)
+        {
+            bars.push_back(beat);
+        }
+    }
+    return bars;
+}
+
+void PatchTable::build(const std::vector<songEvent>& songEvents)
+{
+    m_partCount = songEvents.size();
+    m_outputCount = 0;
+    for (const auto& event : songEvents)
+    {
+        for (const auto& patch : event.patches)
+        {
+            m_outputCount = std::max<size_t>(m_outputCount, patch.midiOutputIndex + 1);
+        }
+    }
+    m_patches.assign(m_partCount * m_outputCount, Patch());
+    m_names.assign(1, "");
+
+    std::unordered_map<std::string, uint16_t> nameIds;
+    for (size_t part = 0; part < m_partCount; part++)
+    {
+        Patch* row = m_patches.data() + part * m_outputCount;
+        if (part > 0)
+        {
+            // carried over from the previous part
+            std::copy(row - m_outputCount, row, row);
+        }
+        for (const auto& patchEvent : songEvents[part].patches)
+        {
+            auto nameId = nameIds.find(patchEvent.name);
+            if (nameId == nameIds.end())
+            {
+                nameId = nameIds.emplace(patchEvent.name, static_cast<uint16_t>(m_names.size())).first;
+                m_names.push_back(patchEvent.name);
+            }
+            Patch& patch = row[patchEvent.midiOutputIndex];
+            patch.program = static_cast<int16_t>(std::min<unsigned int>(patchEvent.programNumber, INT16_MAX));
+            patch.nameId = nameId->second;
+        }
+    }
+}
+
+void PatchTable::clear()
+{
+    m_patches.clear();
+    m_names.clear();
+    m_partCount = 0;
+    m_outputCount = 0;
+}
+
+size_t PatchTable::getPartCount() const
+{
+    return m_partCount;
+}
+
+size_t PatchTable::getOutputCount() const
+{
+    return m_outputCount;
+}
+
+const PatchTable::Patch& PatchTable::get(size_t part, size_t midiOutputIndex) const
+{
+    static const Patch noPatch;
+    if (part >= m_partCount || midiOutputIndex >= m_outputCount)
+    {
+        return noPatch;
+    }
+    return m_patches[part * m_outputCount + midiOutputIndex];
+}
+
+const std::string& PatchTable::getName(const Patch& patch) const
+{
+    static const std::string noName;
+    return patch.nameId < m_names.size() ? m_names[patch.nameId] : noName;
+}
+
+Song::Song(std::vector<songEvent> events) :
+    m_events(std::move(events))
+{
+    m_patchTable.build(m_events);
+}
+
+const std::vector<songEvent>& Song::getEvents() const
+{
+    return m_events;
+}
+
+const PatchTable& Song::getPatchTable() const
+{
+    return m_patchTable;
+}
+
+namespace {
+    // value of a tag of a songpart, the first one when the tag is repeated
+    struct PartValue {
+        std::string text;
+        size_t line = 0;
+        bool present = false;
+    };
+
+    // reads the value of the current element into a part value, duplicates are skipped
+    template <typename Report>
+    bool readPartValue(Tonton::Utils::XmlPullParser& parser, PartValue& value, const Report& report)
+    {
+        size_t line = parser.getLine();
+        std::string name = parser.getName();
+        if (value.present)
+        {
+            report(line, "duplicate <" + name + ">, the first one is used");
+            return parser.skipElement();
+        }
+        value.present = true;
+        value.line = line;
+        if (!parser.readElementText(value.text))
+        {
+            report(line, "<" + name + "> should only contain a value");
+        }
+        return parser.getError().empty();
+    }
+} // unnamed namespace
+
+std::vector<songEvent> loadSongStructure(const std::string& filePath, const std::vector<std::shared_ptr<MidiOutput>>& midiOuts,
+    std::vector<std::string>* problems)
+{
+    using Tonton::Utils::XmlPullParser;
+
+    std::vector<songEvent> songEvents;
+    XmlPullParser parser;
+    if (!parser.loadFile(ofToDataPath(filePath)))
+    {
+        return songEvents;
+    }
+
+    std::string partName;
+    auto report = [problems, &partName](size_t line, const std::string& problem) {
+        if (problems != nullptr)
+        {
+            std::string location = partName.empty() ? "" : partName + ", ";
+            location += line > 0 ? "line " + to_string(line) + ": " : "";
+            problems->push_back(location + problem);
+        }
+    };
+    auto syntaxError = [&]() {
+        partName.clear();
+        if (problems != nullptr)
+        {
+            problems->push_back(parser.getError());
+        }
+        songEvents.clear();
+        return songEvents;
+    };
+    auto toInteger = [&report](const PartValue& value, long defaultValue) {
+        long result = defaultValue;
+        if (value.present && !Tonton::Utils::parseXmlInteger(value.text, result))
+        {
+            report(value.line, "'" + value.text + "' is not an integer");
+            result = defaultValue;
+        }
+        return result;
+    };
+
+    // <structure><songparts><songpart>..., one pass: the values of a part are gathered then resolved
+    if (parser.next() != XmlPullParser::Event::START_ELEMENT)
+    {
+        return syntaxError();
+    }
+    if (parser.getName() != "structure")
+    {
+        report(parser.getLine(), "root element is <" + parser.getName() + ">, not <structure>");
+        return songEvents;
+    }
+
+    uint32_t nextTick = 0;
+    bool hasPartLength = false;
+    bool hasPartTick = false;
+    for (XmlPullParser::Event event = parser.next(); event != XmlPullParser::Event::END_DOCUMENT; event = parser.next())
+    {
+        if (event == XmlPullParser::Event::ERROR)
+        {
+            return syntaxError();
+        }
+        if (event != XmlPullParser::Event::START_ELEMENT)
+        {
+            continue;
+        }
+        size_t depth = parser.getDepth() - 1;  // 1: in <structure>, 2: in <songparts>
+        if (depth == 1 && parser.getName() == "songparts")
+        {
+            continue;
+        }
+        if (depth != 2 || parser.getName() != "songpart")
+        {
+            report(parser.getLine(), "unknown element <" + parser.getName() + ">");
+            if (!parser.skipElement())
+            {
+                return syntaxError();
+            }
+            continue;
+        }
+
+        partName = "part " + to_string(songEvents.size() + 1);
+        size_t partLine = parser.getLine();
+        PartValue bpm, program, tickLength, length, tick, shader, desc;
+        std::vector<std::pair<std::string, PartValue>> patches;
+        const std::pair<const char*, PartValue*> partValues[] = {
+            {"bpm", &bpm}, {"program", &program}, {"tick_len", &tickLength}, {"length", &length},
+            {"tick", &tick}, {"shader", &shader}, {"desc", &desc}
+        };
+        bool patchesTag = false;
+        for (event = parser.next(); event == XmlPullParser::Event::START_ELEMENT || event == XmlPullParser::Event::TEXT; event = parser.next())
+        {
+            if (event == XmlPullParser::Event::TEXT)
+            {
+                continue;
+            }
+            auto partValue = std::find_if(std::begin(partValues), std::end(partValues), [&parser](const std::pair<const char*, PartValue*>& value) {
+                return parser.getName() == value.first;
+            });
+            bool success = true;
+            if (partValue != std::end(partValues))
+            {
+                success = readPartValue(parser, *partValue->second, report);
+            }
+            else if (parser.getName() == "patches" && !patchesTag)
+            {
+                // a tag per midi output, named after it
+                patchesTag = true;
+                for (event = parser.next(); success && event != XmlPullParser::Event::END_ELEMENT; event = parser.next())
+                {
+                    if (event == XmlPullParser::Event::ERROR)
+                    {
+                        success = false;
+                    }
+                    else if (event == XmlPullParser::Event::START_ELEMENT)
+                    {
+                        std::string deviceName = parser.getName();
+                        auto patch = std::find_if(patches.begin(), patches.end(), [&deviceName](const std::pair<std::string, PartValue>& patch) {
+                            return patch.first == deviceName;
+                        });
+                        if (patch == patches.end())
+                        {
+                            patch = patches.emplace(patches.end(), deviceName, PartValue());
+                        }
+                        success = readPartValue(parser, patch->second, report);
+                    }
+                }
+            }
+            else
+            {
+                report(parser.getLine(), (parser.getName() == "patches" ? "duplicate" : "unknown element") + std::string(" <") + parser.getName() + ">");
+                success = parser.skipElement();
+            }
+            if (!success)
+            {
+                return syntaxError();
+            }
+        }
+        if (event != XmlPullParser::Event::END_ELEMENT)
+        {
+            return syntaxError();
+        }
+
+        songEvent e;
+        e.bpm = 120;
+        double bpmValue;
+        if (bpm.present && !Tonton::Utils::parseXmlNumber(bpm.text, bpmValue))
+        {
+            report(bpm.line, "'" + bpm.text + "' is not a tempo");
+        }
+        else if (bpm.present)
+        {
+            e.bpm = static_cast<float>(bpmValue);
+        }
+        e.programName = program.present ? program.text : "F16";
+        e.program = getProgramNumberFromElektronPatternStr(e.programName);
+        if (tickLength.present || length.present)
+        {
+            hasPartLength = true;
+            e.tick = nextTick;
+            const PartValue& partLength = tickLength.present ? tickLength : length;
+            long ticks = toInteger(partLength, 0);
+            if (ticks <= 0)
+            {
+                report(partLength.line, "length " + to_string(ticks) + ", a part lasts at least one tick");
+            }
+            else
+            {
+                nextTick += static_cast<uint32_t>(ticks);
+            }
+        }
+        else
+        {
+            hasPartTick = true;
+            e.tick = toInteger(tick, 0);
+            if (!songEvents.empty() && e.tick <= songEvents.back().tick)
+            {
+                report(tick.present ? tick.line : partLine, "tick " + to_string(e.tick) + " does not follow the previous part");
+            }
+        }
+        if (e.bpm <= 0)
+        {
+            report(bpm.line, "tempo " + ofToString(e.bpm) + " bpm");
+        }
+        e.shader = shader.text;
+        e.name = desc.text;
+
+        for (auto& patch : patches)
+        {
+            bool known = std::any_of(midiOuts.begin(), midiOuts.end(), [&patch](const std::shared_ptr<MidiOutput>& midiOut) {
+                return midiOut->_deviceName == patch.first;
+            });
+            if (!known)
+            {
+                report(patch.second.line, "no midi output named " + patch.first + " in settings.xml");
+            }
+        }
+
+        for (const auto& midiOut : midiOuts)
+        {
+            auto patch = std::find_if(patches.begin(), patches.end(), [&midiOut](const std::pair<std::string, PartValue>& patch) {
+                return patch.first == midiOut->_deviceName;
+            });
+            if (patch != patches.end())
+            {
+                const PartValue& value = patch->second;
+                PatchEvent patchEvent;
+                patchEvent.programNumber = 0;
+                patchEvent.midiOutputIndex = midiOut->_deviceIndex;
+                if (midiOut->_patchFormat == PatchFormat::PROGRAM_NUMBER)
+                {
+                    patchEvent.programNumber = toInteger(value, 0);
+                    patchEvent.name = to_string(patchEvent.programNumber);
+                }
+                else if (midiOut->_patchFormat == PatchFormat::PATCH_NAME)
+                {
+                    patchEvent.name = value.text;
+                    if (midiOut->_patchesMap.count(patchEvent.name))
+                    {
+                        patchEvent.programNumber = midiOut->_patchesMap[patchEvent.name];
+                    }
+                    else
+                    {
+                        report(value.line, "unknown patch '" + patchEvent.name + "' for " + midiOut->_deviceName + ", program 0 sent");
+                    }
+                }
+                else if (midiOut->_patchFormat == PatchFormat::ELEKTRON_PATTERN)
+                {
+                    patchEvent.name = value.text;
+                    patchEvent.programNumber = getProgramNumberFromElektronPatternStr(patchEvent.name);
+                    if (!isValidElektronPatternStr(patchEvent.name))
+                    {
+                        report(value.line, "bad elektron pattern '" + patchEvent.name + "' for " + midiOut->_deviceName + ", program 0 sent");
+                    }
+                }
+                shortenString(patchEvent.name, TEXT_LEN_PATCH_NAME, -1, 0);
+
+                e.patches.push_back(patchEvent);
+            }
+            else if (midiOut->_useLegacyProgram)
+            {
+                // store default program value from song (legacy from 1st software versions with only 1 midi output)
+                if (!isValidElektronPatternStr(e.programName))
+                {
+                    report(program.present ? program.line : partLine, "bad program '" + e.programName + "' for " + midiOut->_deviceName + ", program 0 sent");
+                }
+                PatchEvent patchEvent;
+                patchEvent.programNumber = e.program;
+                patchEvent.name = e.programName;
+                patchEvent.midiOutputIndex = midiOut->_deviceIndex;
+                shortenString(patchEvent.name, TEXT_LEN_PATCH_NAME, -1, 0);
+                e.patches.push_back(patchEvent);
+            }
+        }
+
+        songEvents.push_back(std::move(e));
+        partName.clear();
+    }
+    if (hasPartLength && hasPartTick)
+    {
+        report(0, "parts mix absolute ticks and lengths");
+    }
+    if (problems != nullptr)
+    {
+        problems->insert(problems->end(), parser.getWarnings().begin(), parser.getWarnings().end());
+    }
+    return songEvents;
+}
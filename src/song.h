@@ -2,6 +2,10 @@
 
 #include "ofMain.h"
 
+#define TEXT_LEN_PATCH_NAME 9
+
+class MidiOutput;
+
 enum PatchFormat {
     PROGRAM_NUMBER,
     PATCH_NAME,
@@ -9,9 +13,8 @@ enum PatchFormat {
 };
 
 struct PatchEvent {
-    unsigned int programNumber;
-    unsigned int channel;
-    unsigned int midiOutputIndex;
+    unsigned int programNumber = 0;
+    unsigned int midiOutputIndex = 0;
     std::string name;
 };
 
@@ -23,5 +26,58 @@ struct songEvent {
     string shader;
     string name;
     std::vector<PatchEvent> patches;
-    ofColor color;
 };
+
+// Patch of every midi output at every part of a song, resolved once when the song is compiled:
+// a flat part x output array, where a part without a patch for an output keeps the previous one
+class PatchTable {
+public:
+    struct Patch {
+        int16_t program = -1;  // -1: no patch for the output up to this part
+        uint16_t nameId = 0;  // 0: no name
+    };
+
+    void build(const std::vector<songEvent>& songEvents);
+    void clear();
+
+    size_t getPartCount() const;
+    size_t getOutputCount() const;
+    // an empty patch outside of the table
+    const Patch& get(size_t part, size_t midiOutputIndex) const;
+    const std::string& getName(const Patch& patch) const;
+
+private:
+    std::vector<Patch> m_patches;  // part * m_outputCount + midi output index
+    std::vector<std::string> m_names;
+    size_t m_partCount = 0;
+    size_t m_outputCount = 0;
+};
+
+// Parts of a song with their patch table, as played. Never modified once built: the ui, the
+// clock, the shaders and the preflight share one instance through shared_ptr<const Song>, and
+// loading a song or reloading its structure swaps the pointer instead of copying the parts.
+class Song {
+public:
+    // builds the patch table of the parts
+    explicit Song(std::vector<songEvent> events);
+
+    const std::vector<songEvent>& getEvents() const;
+    const PatchTable& getPatchTable() const;
+
+private:
+    std::vector<songEvent> m_events;
+    PatchTable m_patchTable;
+};
+
+// position in ms of a beat of the song, following the tempo of each part
+double getSongTimeMs(const std::vector<songEvent>& songEvents, long beat);
+
+// beats at which every bar starts, bars are counted from the start of each part
+std::vector<long> getBarStartBeats(const std::vector<songEvent>& songEvents, unsigned int beatsPerBar = 4);
+
+// parts of a structure.xml, with the patches of each part resolved for the midi outputs
+// (carried over to the next parts by PatchTable), read in one pass. Empty when the file cannot be read or is not well formed.
+// Syntax errors, unknown tags, values that are not numbers, unknown patches and inconsistent
+// parts are added to problems with their line, the parts are loaded anyway
+std::vector<songEvent> loadSongStructure(const std::string& filePath, const std::vector<std::shared_ptr<MidiOutput>>& midiOuts,
+    std::vector<std::string>* problems = nullptr);
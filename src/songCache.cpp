@@ -0,0 +1,174 @@
+#include "songCache.h"
+
+#include "ofMain.h"
+
+SongCache::SongCache(MemoryBudget& budget):
+    m_budget(budget)
+{
+
+}
+
+SongCache::~SongCache() {
+    finishPreload("");
+}
+
+void SongCache::setSampleRate(unsigned int sampleRate)
+{
+    if (sampleRate != m_sampleRate)
+    {
+        clear();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sampleRate = sampleRate;
+    }
+}
+
+std::shared_ptr<const AudioData> SongCache::find(const std::string& song, const std::string& filePath)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto cachedSong = m_songs.find(song);
+    if (cachedSong == m_songs.end())
+    {
+        return nullptr;
+    }
+    cachedSong->second.lastUse = ++m_useCounter;
+    auto track = cachedSong->second.tracks.find(filePath);
+    return track != cachedSong->second.tracks.end() ? track->second : nullptr;
+}
+
+void SongCache::insert(const std::string& song, const std::string& filePath, std::shared_ptr<const AudioData> data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    add(song, filePath, data);
+    trim();
+}
+
+void SongCache::add(const std::string& song, const std::string& filePath, std::shared_ptr<const AudioData> data)
+{
+    if (data == nullptr)
+    {
+        return;
+    }
+    CachedSong& cachedSong = m_songs[song];
+    auto& track = cachedSong.tracks[filePath];
+    if (track != nullptr)
+    {
+        cachedSong.bytes -= track->getSampleBytes();
+    }
+    track = data;
+    cachedSong.bytes += data->getSampleBytes();
+    cachedSong.lastUse = ++m_useCounter;
+    m_budget.setUsage(song, MemoryBudget::AUDIO, cachedSong.bytes);
+}
+
+void SongCache::setProtectedSongs(const std::string& current, const std::string& next)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_currentSong = current;
+    m_nextSong = next;
+    trim();
+}
+
+void SongCache::trim()
+{
+    while (m_budget.getExcess() > 0)
+    {
+        auto oldest = m_songs.end();
+        for (auto song = m_songs.begin(); song != m_songs.end(); ++song)
+        {
+            if (song->first != m_currentSong && song->first != m_nextSong
+                && (oldest == m_songs.end() || song->second.lastUse < oldest->second.lastUse))
+            {
+                oldest = song;
+            }
+        }
+        if (oldest == m_songs.end())
+        {
+            return;
+        }
+        ofLog() << "memory budget: " << oldest->first << " evicted from the song cache";
+        evict(oldest->first);
+    }
+}
+
+void SongCache::evict(const std::string& song)
+{
+    m_songs.erase(song);
+    m_budget.release(song, MemoryBudget::AUDIO);
+}
+
+void SongCache::preload(const std::string& song, const std::vector<std::string>& filePaths)
+{
+    if (m_preloadThread.joinable() && song == m_preloadingSong)
+    {
+        return;
+    }
+    finishPreload("");
+    m_preloadingSong = song;
+    m_preloadThread = std::thread(&SongCache::runPreload, this, song, filePaths, m_sampleRate);
+}
+
+void SongCache::finishPreload(const std::string& song)
+{
+    if (!m_preloadThread.joinable())
+    {
+        return;
+    }
+    // the remaining tracks of a song about to be loaded would be decoded by the loader anyway
+    m_cancelPreload = song != m_preloadingSong;
+    m_preloadThread.join();
+    m_cancelPreload = false;
+    m_preloadingSong.clear();
+}
+
+void SongCache::runPreload(std::string song, std::vector<std::string> filePaths, unsigned int sampleRate)
+{
+    uint64_t startTime = ofGetElapsedTimeMillis();
+    size_t decoded = 0;
+    for (const auto& filePath : filePaths)
+    {
+        if (m_cancelPreload)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto cachedSong = m_songs.find(song);
+            if (cachedSong != m_songs.end() && cachedSong->second.tracks.count(filePath) > 0)
+            {
+                continue;
+            }
+        }
+
+        // a switch to another song does not wait for the end of this track
+        auto data = StemPlayer::decode(filePath, sampleRate, &m_cancelPreload);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_cancelPreload)
+        {
+            return;
+        }
+        add(song, filePath, data);
+        trim();
+        if (m_budget.getExcess() > 0)
+        {
+            ofLogWarning() << "memory budget too small to preload " << song << ", it will be decoded when loaded";
+            evict(song);
+            return;
+        }
+        decoded++;
+    }
+    if (decoded > 0)
+    {
+        ofLog() << "preloaded " << decoded << " tracks of " << song << " in " << (ofGetElapsedTimeMillis() - startTime) << " ms";
+    }
+}
+
+void SongCache::clear()
+{
+    finishPreload("");
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& song : m_songs)
+    {
+        m_budget.release(song.first, MemoryBudget::AUDIO);
+    }
+    m_songs.clear();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "memoryBudget.h"
+#include "stemPlayer.h"
+
+// Decoded tracks of the songs of the setlist, at the device rate.
+// A song stays cached after it is left, so going back to it does not decode it again,
+// and the next song is decoded in a background thread while the current one plays.
+// Songs are evicted least recently used first to stay within the memory budget,
+// the current and next songs never are (the next one is only preloaded if it fits).
+class SongCache {
+public:
+    explicit SongCache(MemoryBudget& budget);
+    virtual ~SongCache();
+
+    // the cache is emptied when the device rate changes
+    void setSampleRate(unsigned int sampleRate);
+    // ui thread: decoded track of a song, null when it is not cached
+    std::shared_ptr<const AudioData> find(const std::string& song, const std::string& filePath);
+    void insert(const std::string& song, const std::string& filePath, std::shared_ptr<const AudioData> data);
+    void setProtectedSongs(const std::string& current, const std::string& next);
+
+    // decodes the tracks of a song in the background
+    void preload(const std::string& song, const std::vector<std::string>& filePaths);
+    // before loading a song: waits for its preload, or cancels the preload of another song
+    void finishPreload(const std::string& song);
+    void clear();
+
+private:
+    struct CachedSong {
+        std::map<std::string, std::shared_ptr<const AudioData>> tracks;
+        uint64_t bytes = 0;
+        uint64_t lastUse = 0;
+    };
+
+    void runPreload(std::string song, std::vector<std::string> filePaths, unsigned int sampleRate);
+    // m_mutex locked
+    void add(const std::string& song, const std::string& filePath, std::shared_ptr<const AudioData> data);
+    void trim();
+    void evict(const std::string& song);
+
+    MemoryBudget& m_budget;
+    std::mutex m_mutex;
+    std::map<std::string, CachedSong> m_songs;
+    std::string m_currentSong;
+    std::string m_nextSong;
+    unsigned int m_sampleRate = 0;
+    uint64_t m_useCounter = 0;
+
+    std::thread m_preloadThread;
+    std::string m_preloadingSong;
+    std::atomic<bool> m_cancelPreload {false};
+};
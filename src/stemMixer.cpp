@@ -0,0 +1,246 @@
+#include "stemMixer.h"
+
+#include <thread>
+
+#include "interleave.h"
+#include "retireQueue.h"
+
+StemMixer::StemMixer():ofxSoundObject(OFX_SOUND_OBJECT_SOURCE) {
+    setName("StemMixer");
+    for (auto& volume : m_volumes)
+    {
+        volume = 1.0f;
+    }
+    for (auto& trim : m_trims)
+    {
+        trim = 1.0f;
+    }
+    auto setup = std::make_shared<Setup>();
+    setup->buses.push_back({"main", 0, 1});
+    setup->playedBuses.push_back(true);
+    m_setup = setup;
+}
+
+StemMixer::~StemMixer() {
+
+}
+
+std::shared_ptr<StemMixer::Setup> StemMixer::copySetup() const
+{
+    return std::make_shared<Setup>(*std::atomic_load(&m_setup));
+}
+
+void StemMixer::publish(std::shared_ptr<Setup> setup)
+{
+    setup->stereoPairs = true;
+    std::vector<bool> usedPairs(setup->outputChannels / 2 + 1, false);
+    for (size_t b = 0; b < setup->buses.size(); b++)
+    {
+        if (!setup->playedBuses[b])
+        {
+            continue;
+        }
+        const OutputBus& bus = setup->buses[b];
+        bool ownPair = bus.leftChannel % 2 == 0 && bus.rightChannel == bus.leftChannel + 1 && !usedPairs[bus.leftChannel / 2];
+        if (ownPair)
+        {
+            usedPairs[bus.leftChannel / 2] = true;
+        }
+        setup->stereoPairs = setup->stereoPairs && ownPair;
+    }
+    setup->stereoPairs = setup->stereoPairs && setup->outputChannels % 2 == 0;
+
+    // freed by the ui thread, the audio thread may hold it until the end of its buffer
+    Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_setup, std::shared_ptr<const Setup>(setup)));
+
+    // a buffer started with the previous setup may still use its players
+    while (m_inProcess)
+    {
+        std::this_thread::yield();
+    }
+}
+
+void StemMixer::setBuses(const std::vector<OutputBus>& buses, unsigned int outputChannels)
+{
+    auto setup = copySetup();
+    setup->outputChannels = std::max(1u, outputChannels);
+    setup->buses = buses;
+    setup->playedBuses.clear();
+    for (const auto& bus : buses)
+    {
+        bool played = bus.leftChannel < static_cast<int>(setup->outputChannels) && bus.rightChannel < static_cast<int>(setup->outputChannels);
+        if (!played)
+        {
+            ofLogWarning() << "output bus " << bus.name << " is beyond the " << setup->outputChannels << " channels of the device, it is not played";
+        }
+        setup->playedBuses.push_back(played);
+    }
+    // sends follow the bus list
+    for (auto& track : setup->tracks)
+    {
+        track.sends.resize(setup->buses.size(), 0.0f);
+    }
+    publish(setup);
+}
+
+void StemMixer::addTrack(StemPlayer* player, const std::vector<float>& sends)
+{
+    auto setup = copySetup();
+    if (setup->tracks.size() >= MAX_TRACKS)
+    {
+        ofLogError() << "too many tracks, the mixer accepts " << MAX_TRACKS;
+        return;
+    }
+    m_volumes[setup->tracks.size()] = 1.0f;
+    m_trims[setup->tracks.size()] = 1.0f;
+    Track track;
+    track.player = player;
+    track.sends = sends;
+    track.sends.resize(setup->buses.size(), 0.0f);
+    setup->tracks.push_back(track);
+    publish(setup);
+}
+
+void StemMixer::clearTracks()
+{
+    auto setup = copySetup();
+    setup->tracks.clear();
+    publish(setup);
+}
+
+size_t StemMixer::getNumTracks() const
+{
+    return std::atomic_load(&m_setup)->tracks.size();
+}
+
+float StemMixer::getConnectionVolume(size_t track) const
+{
+    return track < MAX_TRACKS ? m_volumes[track].load() : 0.0f;
+}
+
+void StemMixer::setConnectionVolume(size_t track, float volume)
+{
+    if (track < MAX_TRACKS)
+    {
+        m_volumes[track] = volume;
+    }
+}
+
+float StemMixer::getTrackTrim(size_t track) const
+{
+    return track < MAX_TRACKS ? m_trims[track].load() : 1.0f;
+}
+
+void StemMixer::setTrackTrim(size_t track, float gain)
+{
+    if (track < MAX_TRACKS)
+    {
+        m_trims[track] = gain;
+    }
+}
+
+float StemMixer::getMasterVolume() const
+{
+    return m_masterVolume;
+}
+
+void StemMixer::setMasterVolume(float volume)
+{
+    m_masterVolume = volume;
+}
+
+void StemMixer::setTimeStretcher(TimeStretcher* stretcher)
+{
+    m_timeStretcher = stretcher;
+}
+
+void StemMixer::process(ofSoundBuffer& input, ofSoundBuffer& output)
+{
+    m_inProcess = true;
+    auto setup = std::atomic_load(&m_setup);
+
+    size_t nFrames = output.getNumFrames();
+    size_t nChannels = output.getNumChannels();
+    auto& out = output.getBuffer();
+
+    if (m_trackBuffer.getNumFrames() != nFrames || m_trackBuffer.getNumChannels() != 2)
+    {
+        m_trackBuffer.allocate(nFrames, 2);
+        m_silence.allocate(nFrames, 2);
+    }
+    m_busBuffers.resize(setup->buses.size());
+    for (auto& busBuffer : m_busBuffers)
+    {
+        busBuffer.assign(nFrames * 2, 0.0f);
+    }
+
+    TimeStretcher* stretcher = m_timeStretcher;
+    if (stretcher != nullptr)
+    {
+        stretcher->process(nFrames);
+    }
+
+    float masterVolume = m_masterVolume;
+    for (size_t t = 0; t < setup->tracks.size(); t++)
+    {
+        const Track& track = setup->tracks[t];
+        // players are always pulled, so that they follow the transport even when muted
+        track.player->process(m_silence, m_trackBuffer);
+        if (track.player->isBufferSilent())
+        {
+            continue;
+        }
+        float volume = m_trims[t] * m_volumes[t] * masterVolume;
+        const float* samples = m_trackBuffer.getBuffer().data();
+        for (size_t b = 0; b < track.sends.size(); b++)
+        {
+            float gain = track.sends[b] * volume;
+            if (gain != 0.0f && setup->playedBuses[b])
+            {
+                Tonton::Utils::mixAdd(m_busBuffers[b].data(), samples, gain, nFrames * 2);
+            }
+        }
+    }
+
+    if (setup->stereoPairs && nChannels == setup->outputChannels)
+    {
+        m_pairs.assign(nChannels / 2, nullptr);
+        for (size_t b = 0; b < setup->buses.size(); b++)
+        {
+            if (setup->playedBuses[b])
+            {
+                m_pairs[setup->buses[b].leftChannel / 2] = m_busBuffers[b].data();
+            }
+        }
+        Tonton::Utils::interleaveStereoPairs(m_pairs.data(), static_cast<unsigned int>(m_pairs.size()), nFrames, out.data());
+    }
+    else
+    {
+        // mono buses, shared or odd channels
+        std::fill(out.begin(), out.end(), 0.0f);
+        for (size_t b = 0; b < setup->buses.size(); b++)
+        {
+            const OutputBus& bus = setup->buses[b];
+            const float* busSamples = m_busBuffers[b].data();
+            if (!setup->playedBuses[b] || static_cast<size_t>(std::max(bus.leftChannel, bus.rightChannel)) >= nChannels)
+            {
+                continue;
+            }
+            bool mono = bus.leftChannel == bus.rightChannel;
+            for (size_t f = 0; f < nFrames; f++)
+            {
+                if (mono)
+                {
+                    out[f * nChannels + bus.leftChannel] += 0.5f * (busSamples[2 * f] + busSamples[2 * f + 1]);
+                }
+                else
+                {
+                    out[f * nChannels + bus.leftChannel] += busSamples[2 * f];
+                    out[f * nChannels + bus.rightChannel] += busSamples[2 * f + 1];
+                }
+            }
+        }
+    }
+
+    m_inProcess = false;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "ofMain.h"
+#include "ofxSoundObject.h"
+
+#include "routing.h"
+#include "stemPlayer.h"
+#include "timeStretcher.h"
+
+// Mixer of the stem players.
+// Every track is sent to one or more stereo buses (routing matrix), the buses are
+// then written to their channels of the sound device.
+// The players are pulled directly by the mixer, they are not connected to it.
+class StemMixer : public ofxSoundObject {
+public:
+    static const size_t MAX_TRACKS = 256;
+
+    StemMixer();
+    virtual ~StemMixer();
+
+    // ui thread. The outputChannels of the device, buses beyond it are not played but keep
+    // their index, so that the sends of the tracks stay aligned with the routing
+    void setBuses(const std::vector<OutputBus>& buses, unsigned int outputChannels);
+    // sends: level of the track to every bus
+    void addTrack(StemPlayer* player, const std::vector<float>& sends);
+    // returns once the audio thread does not use the previous tracks anymore,
+    // they can be destroyed after this call
+    void clearTracks();
+    size_t getNumTracks() const;
+
+    float getConnectionVolume(size_t track) const;
+    void setConnectionVolume(size_t track, float volume);
+    // gain applied before the fader (loudness auto gain), reset to 1 when a track is added
+    float getTrackTrim(size_t track) const;
+    void setTrackTrim(size_t track, float gain);
+    float getMasterVolume() const;
+    void setMasterVolume(float volume);
+
+    // stretched once per buffer, before the players read their track from it
+    void setTimeStretcher(TimeStretcher* stretcher);
+
+    void process(ofSoundBuffer& input, ofSoundBuffer& output) override;
+
+private:
+    struct Track {
+        StemPlayer* player = nullptr;
+        std::vector<float> sends;
+    };
+
+    // immutable once published to the audio thread
+    struct Setup {
+        std::vector<OutputBus> buses;
+        std::vector<bool> playedBuses;  // by bus, false beyond the channels of the device
+        std::vector<Track> tracks;
+        unsigned int outputChannels = 2;
+        bool stereoPairs = true;  // every bus on its own pair of channels (1/2, 3/4...)
+    };
+
+    void publish(std::shared_ptr<Setup> setup);
+    std::shared_ptr<Setup> copySetup() const;
+
+    std::shared_ptr<const Setup> m_setup;
+    std::array<std::atomic<float>, MAX_TRACKS> m_volumes;
+    std::array<std::atomic<float>, MAX_TRACKS> m_trims;
+    std::atomic<float> m_masterVolume {1.0f};
+    std::atomic<bool> m_inProcess {false};
+    std::atomic<TimeStretcher*> m_timeStretcher {nullptr};
+
+    // audio thread only
+    ofSoundBuffer m_silence;
+    ofSoundBuffer m_trackBuffer;
+    std::vector<std::vector<float>> m_busBuffers;
+    std::vector<const float*> m_pairs;
+};
@@ -0,0 +1,705 @@
+#include "stemPlayer.h"
+
+#include <chrono>
+#include <numeric>
+#include <thread>
+
+#include "audioFileReader.h"
+#include "chunkPipeline.h"
+#include "resampler.h"
+#include "retireQueue.h"
+#include "sampleFormat.h"
+#include "timeStretcher.h"
+
+namespace {
+    const size_t STREAM_CHUNK_FRAMES = 4096;
+    const size_t STREAM_CHUNK_COUNT = 48;  // about 4 s ahead at 48 kHz
+    const size_t STREAM_PREFILL_CHUNKS = 4;  // decoded ahead before a prepared track is ready
+    const size_t STREAM_DECODE_FRAMES = 4096;
+    const uint64_t STREAM_PREROLL_FRAMES = 64;  // fills the resampler history after a seek
+    const size_t PLAYBACK_BLOCK_SAMPLES = 1024;  // converted from the stored format at once
+} // unnamed namespace
+
+void AudioData::readFrames(size_t first, size_t count, float* output) const
+{
+    if (format == SampleFormat::INT16)
+    {
+        Tonton::Utils::int16ToFloat(&samples16[first * channels], output, count * channels);
+    }
+    else
+    {
+        std::copy(&samples[first * channels], &samples[(first + count) * channels], output);
+    }
+}
+
+const void* AudioData::getSampleData() const
+{
+    return format == SampleFormat::INT16 ? static_cast<const void*>(samples16.data()) : static_cast<const void*>(samples.data());
+}
+
+size_t AudioData::getSampleBytes() const
+{
+    return samples.capacity() * sizeof(float) + samples16.capacity() * sizeof(int16_t);
+}
+
+struct StreamChunk {
+    uint32_t epoch = 0;
+    uint64_t startFrame = 0;  // output frame index of the first frame
+    size_t frames = 0;
+    std::vector<float> samples;
+};
+
+// Decoded audio travels from the reader thread to the audio thread in chunks,
+// every seek request gets a new epoch (see ChunkPipeline).
+struct StemStream {
+    StemStream():pipeline(STREAM_CHUNK_COUNT) {}
+
+    void run();
+    uint64_t seekSource(uint64_t frame);
+    void stop();
+
+    AudioFileReader reader;
+    std::unique_ptr<Tonton::Utils::Resampler> resampler;  // null if the file is at the device rate
+    unsigned int channels = 0;
+    unsigned int sampleRate = 0;  // output rate
+    uint64_t frames = 0;  // output frames
+
+    Tonton::Utils::ChunkPipeline<StreamChunk> pipeline;  // reader -> audio thread
+    std::atomic<bool> running {false};
+    const std::atomic<bool>* loop = nullptr;
+    std::thread thread;
+    std::shared_ptr<const Tonton::Utils::SilenceMap> silence;  // atomic access, null until the track is analyzed
+};
+
+uint64_t StemStream::seekSource(uint64_t frame)
+{
+    if (!resampler)
+    {
+        reader.seek(frame);
+        return 0;
+    }
+    // start a little earlier, on a source frame that falls exactly on an output frame
+    // so that the filter phases match a decode from the beginning, and drop the output until frame
+    uint64_t divisor = std::gcd(reader.getSampleRate(), sampleRate);
+    uint64_t up = sampleRate / divisor;
+    uint64_t down = reader.getSampleRate() / divisor;
+    uint64_t sourceFrame = frame * down / up;
+    uint64_t startFrame = sourceFrame > STREAM_PREROLL_FRAMES ? sourceFrame - STREAM_PREROLL_FRAMES : 0;
+    startFrame -= startFrame % down;
+    reader.seek(startFrame);
+    resampler->reset();
+    uint64_t startOutputFrame = startFrame / down * up;
+    return frame > startOutputFrame ? frame - startOutputFrame : 0;
+}
+
+void StemStream::run()
+{
+    std::vector<float> decoded(STREAM_DECODE_FRAMES * channels);
+    std::vector<float> pending;  // output frames not yet handed over in a chunk
+    size_t pendingOffset = 0;
+    uint64_t discardFrames = 0;
+    uint64_t nextFrame = 0;
+    uint32_t epoch = 0;
+    size_t queuedChunks = 0;
+    bool endOfFile = true;
+    bool skippedSilence = false;  // the source must be seeked before decoding again
+
+    while (running)
+    {
+        Tonton::Utils::ChunkRequest request = pipeline.getRequest();
+        if (request.epoch != epoch)
+        {
+            epoch = request.epoch;
+            nextFrame = std::min(request.frame, frames);
+            discardFrames = seekSource(nextFrame);
+            pending.clear();
+            pendingOffset = 0;
+            queuedChunks = 0;
+            endOfFile = false;
+            skippedSilence = false;
+            continue;
+        }
+
+        size_t pendingFrames = pending.size() / channels - pendingOffset;
+        if (pendingFrames < STREAM_CHUNK_FRAMES && !endOfFile)
+        {
+            pending.erase(pending.begin(), pending.begin() + pendingOffset * channels);
+            pendingOffset = 0;
+
+            uint64_t decodeFrame = nextFrame + pending.size() / channels;
+            auto silenceMap = std::atomic_load(&silence);
+            if (discardFrames == 0 && silenceMap != nullptr && silenceMap->isSilent(decodeFrame, STREAM_DECODE_FRAMES))
+            {
+                // digital silence is not decoded, the source is seeked past it
+                size_t count = static_cast<size_t>(std::min<uint64_t>(STREAM_DECODE_FRAMES, frames - decodeFrame));
+                pending.resize(pending.size() + count * channels, 0.0f);
+                skippedSilence = true;
+                endOfFile = decodeFrame + count >= frames;
+                continue;
+            }
+            if (skippedSilence)
+            {
+                skippedSilence = false;
+                discardFrames = seekSource(decodeFrame);
+            }
+
+            size_t read = reader.read(decoded.data(), STREAM_DECODE_FRAMES);
+            if (resampler)
+            {
+                resampler->process(decoded.data(), read, pending);
+                if (read < STREAM_DECODE_FRAMES)
+                {
+                    resampler->flush(pending);
+                }
+            }
+            else
+            {
+                pending.insert(pending.end(), decoded.begin(), decoded.begin() + read * channels);
+            }
+            endOfFile = read < STREAM_DECODE_FRAMES;
+
+            size_t discarded = static_cast<size_t>(std::min<uint64_t>(discardFrames, pending.size() / channels));
+            pending.erase(pending.begin(), pending.begin() + discarded * channels);
+            discardFrames -= discarded;
+            continue;
+        }
+
+        if (pendingFrames == 0)
+        {
+            if (loop != nullptr && *loop && frames > 0)
+            {
+                nextFrame = 0;
+                discardFrames = seekSource(0);
+                endOfFile = false;
+                skippedSilence = false;
+                continue;
+            }
+            pipeline.readyEpoch = epoch;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+
+        StreamChunk* chunk = nullptr;
+        if (!pipeline.freeChunks.pop(chunk))
+        {
+            // far enough ahead, or waiting for the audio thread to give back older chunks
+            if (queuedChunks > 0)
+            {
+                pipeline.readyEpoch = epoch;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        size_t count = std::min(pendingFrames, STREAM_CHUNK_FRAMES);
+        auto first = pending.begin() + pendingOffset * channels;
+        std::copy(first, first + count * channels, chunk->samples.begin());
+        chunk->epoch = epoch;
+        chunk->startFrame = nextFrame;
+        chunk->frames = count;
+        pipeline.filledChunks.push(chunk);
+        pendingOffset += count;
+        nextFrame += count;
+        if (++queuedChunks >= STREAM_PREFILL_CHUNKS)
+        {
+            pipeline.readyEpoch = epoch;
+        }
+    }
+}
+
+void StemStream::stop()
+{
+    running = false;
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+StemPlayer::StemPlayer():ofxSoundObject(OFX_SOUND_OBJECT_SOURCE) {
+    setName("StemPlayer");
+}
+
+StemPlayer::~StemPlayer() {
+    unload();
+}
+
+bool StemPlayer::load(std::string filePath, unsigned int outputSampleRate, bool streaming)
+{
+    unload();
+
+    if (streaming)
+    {
+        auto stream = std::make_shared<StemStream>();
+        if (!stream->reader.open(filePath))
+        {
+            ofLogError() << "could not open audio file " << filePath;
+            return false;
+        }
+        m_sourceSampleRate = stream->reader.getSampleRate();
+        stream->channels = stream->reader.getChannels();
+        stream->sampleRate = outputSampleRate > 0 ? outputSampleRate : m_sourceSampleRate;
+        stream->frames = stream->reader.getTotalFrames();
+        if (stream->sampleRate != m_sourceSampleRate)
+        {
+            stream->resampler = std::make_unique<Tonton::Utils::Resampler>(m_sourceSampleRate, stream->sampleRate, stream->channels);
+            stream->frames = stream->resampler->getOutputFrameCount(static_cast<size_t>(stream->frames));
+        }
+        for (auto& chunk : stream->pipeline.chunks)
+        {
+            chunk.samples.resize(STREAM_CHUNK_FRAMES * stream->channels);
+            stream->pipeline.freeChunks.push(&chunk);
+        }
+        stream->loop = &m_loop;
+        stream->pipeline.request(0);
+        stream->running = true;
+        stream->thread = std::thread(&StemStream::run, stream.get());
+
+        m_position = 0;
+        m_meter.setup(stream->sampleRate);
+        Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_stream, stream));
+        return true;
+    }
+
+    auto data = decode(filePath, outputSampleRate);
+    if (data == nullptr)
+    {
+        return false;
+    }
+    m_sourceSampleRate = data->sourceSampleRate;
+    m_position = 0;
+    m_meter.setup(data->sampleRate);
+    Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_data, std::shared_ptr<const AudioData>(data)));
+    return true;
+}
+
+std::shared_ptr<AudioData> StemPlayer::decode(const std::string& filePath, unsigned int outputSampleRate, const std::atomic<bool>* cancel)
+{
+    std::vector<float> samples;
+    unsigned int channels = 0;
+    unsigned int sourceSampleRate = 0;
+    unsigned int bitsPerSample = 0;
+    if (!AudioFileReader::decodeFile(filePath, samples, channels, sourceSampleRate, bitsPerSample, cancel))
+    {
+        if (cancel == nullptr || !*cancel)
+        {
+            ofLogError() << "could not decode audio file " << filePath;
+        }
+        return nullptr;
+    }
+    if (cancel != nullptr && *cancel)
+    {
+        return nullptr;
+    }
+
+    auto data = std::make_shared<AudioData>();
+    data->sourceChannels = channels;
+    data->sourceSampleRate = sourceSampleRate;
+    size_t sourceFrames = samples.size() / channels;
+
+    // the same signal on both channels: kept once, before resampling it twice
+    if (channels == 2 && Tonton::Utils::isDualMono(samples.data(), sourceFrames))
+    {
+        for (size_t f = 0; f < sourceFrames; f++)
+        {
+            samples[f] = samples[2 * f];
+        }
+        samples.resize(sourceFrames);
+        samples.shrink_to_fit();
+        channels = 1;
+    }
+    data->channels = channels;
+
+    if (outputSampleRate > 0 && sourceSampleRate != outputSampleRate)
+    {
+        uint64_t startTime = ofGetElapsedTimeMillis();
+        data->samples = Tonton::Utils::Resampler::resample(samples.data(), sourceFrames, data->channels, sourceSampleRate, outputSampleRate);
+        data->sampleRate = outputSampleRate;
+        ofLog() << "resampled " << filePath << " from " << sourceSampleRate << " Hz to " << outputSampleRate << " Hz in " << (ofGetElapsedTimeMillis() - startTime) << " ms";
+    }
+    else
+    {
+        data->samples = std::move(samples);
+        data->sampleRate = sourceSampleRate;
+    }
+    data->frames = data->samples.size() / std::max(1u, data->channels);
+
+    if (bitsPerSample > 0 && bitsPerSample <= 16)
+    {
+        // resampled 16-bit sources are rounded back to 16 bits, below the noise floor of the source
+        data->samples16.resize(data->samples.size());
+        Tonton::Utils::floatToInt16(data->samples.data(), data->samples16.data(), data->samples.size());
+        data->samples = std::vector<float>();
+        data->format = SampleFormat::INT16;
+    }
+    // blocks of digital silence, as stored (after resampling and rounding)
+    const size_t blockFrames = Tonton::Utils::SilenceMap::BLOCK_FRAMES;
+    data->silence.setup(data->channels);
+    std::vector<float> block(blockFrames * data->channels);
+    for (size_t frame = 0; frame < data->frames; frame += blockFrames)
+    {
+        size_t count = std::min(blockFrames, data->frames - frame);
+        data->readFrames(frame, count, block.data());
+        data->silence.addFrames(block.data(), count);
+    }
+    data->silence.finish();
+
+    if (data->format != SampleFormat::FLOAT32 || data->channels != data->sourceChannels)
+    {
+        ofLog() << filePath << " stored as " << (data->format == SampleFormat::INT16 ? "int16" : "float")
+            << (data->channels != data->sourceChannels ? " mono (dual-mono file)" : "")
+            << ", " << data->getSampleBytes() / 1024 << " KB instead of " << data->frames * data->sourceChannels * sizeof(float) / 1024 << " KB";
+    }
+    return data;
+}
+
+void StemPlayer::setAudioData(std::shared_ptr<const AudioData> data)
+{
+    unload();
+    if (!data)
+    {
+        return;
+    }
+    m_sourceSampleRate = data->sourceSampleRate > 0 ? data->sourceSampleRate : data->sampleRate;
+    m_meter.setup(data->sampleRate);
+    Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_data, data));
+}
+
+std::shared_ptr<const AudioData> StemPlayer::getAudioData() const
+{
+    return std::atomic_load(&m_data);
+}
+
+void StemPlayer::unload()
+{
+    m_playing = false;
+    auto stream = std::atomic_load(&m_stream);
+    if (stream)
+    {
+        // the audio thread may still hold the stream for one buffer, only the reader is stopped here
+        stream->stop();
+    }
+    Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_stream, std::shared_ptr<StemStream>()));
+    Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_data, std::shared_ptr<const AudioData>()));
+    m_position = 0;
+}
+
+bool StemPlayer::isLoaded() const
+{
+    return std::atomic_load(&m_data) != nullptr || std::atomic_load(&m_stream) != nullptr;
+}
+
+void StemPlayer::play()
+{
+    m_playing = true;
+}
+
+void StemPlayer::stop()
+{
+    m_playing = false;
+    m_position = 0;
+}
+
+bool StemPlayer::isPlaying() const
+{
+    return m_playing;
+}
+
+void StemPlayer::setLoop(bool loop)
+{
+    m_loop = loop;
+}
+
+void StemPlayer::setPositionMS(int positionMs)
+{
+    setPositionFrames(static_cast<uint64_t>(std::max(0, positionMs)) * getSampleRate() / 1000);
+}
+
+int StemPlayer::getPositionMS() const
+{
+    unsigned int sampleRate = getSampleRate();
+    if (sampleRate == 0)
+    {
+        return 0;
+    }
+    return static_cast<int>(m_position * 1000 / sampleRate);
+}
+
+unsigned long StemPlayer::getDurationMS() const
+{
+    unsigned int sampleRate = getSampleRate();
+    if (sampleRate == 0)
+    {
+        return 0;
+    }
+    return static_cast<unsigned long>(getDurationFrames() * 1000 / sampleRate);
+}
+
+void StemPlayer::setTransport(const Transport* transport)
+{
+    m_transport = transport;
+    if (m_transport != nullptr)
+    {
+        m_appliedTransportGeneration = m_transport->getLatchedGeneration();
+    }
+}
+
+void StemPlayer::setTimeStretcher(const TimeStretcher* stretcher, size_t track)
+{
+    m_timeStretcher = stretcher;
+    m_timeStretcherTrack = track;
+}
+
+void StemPlayer::prepare(uint64_t frame)
+{
+    auto stream = std::atomic_load(&m_stream);
+    if (stream)
+    {
+        stream->pipeline.request(frame);
+    }
+}
+
+bool StemPlayer::waitPrepared(unsigned int timeoutMs) const
+{
+    auto stream = std::atomic_load(&m_stream);
+    if (!stream)
+    {
+        return true;
+    }
+    return stream->pipeline.waitReady(timeoutMs);
+}
+
+bool StemPlayer::isStreaming() const
+{
+    return std::atomic_load(&m_stream) != nullptr;
+}
+
+void StemPlayer::setStreamSilence(const Tonton::Utils::PeakPyramid& peaks)
+{
+    auto stream = std::atomic_load(&m_stream);
+    if (!stream)
+    {
+        return;
+    }
+    // the resampling filter spreads the first samples after a silence a little before it
+    auto silence = std::make_shared<Tonton::Utils::SilenceMap>();
+    silence->buildFromPeaks(peaks, stream->sampleRate, static_cast<double>(STREAM_PREROLL_FRAMES) / m_sourceSampleRate);
+    Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&stream->silence, std::shared_ptr<const Tonton::Utils::SilenceMap>(silence)));
+}
+
+void StemPlayer::setSkipSilence(bool skip)
+{
+    m_skipSilence = skip;
+}
+
+bool StemPlayer::isBufferSilent() const
+{
+    return m_bufferSilent;
+}
+
+void StemPlayer::setPositionFrames(uint64_t frame)
+{
+    m_position = std::min<uint64_t>(frame, getDurationFrames());
+    prepare(m_position);
+}
+
+uint64_t StemPlayer::getPositionFrames() const
+{
+    return m_position;
+}
+
+uint64_t StemPlayer::getDurationFrames() const
+{
+    auto stream = std::atomic_load(&m_stream);
+    if (stream)
+    {
+        return stream->frames;
+    }
+    auto data = std::atomic_load(&m_data);
+    return data ? data->frames : 0;
+}
+
+unsigned int StemPlayer::getSampleRate() const
+{
+    auto stream = std::atomic_load(&m_stream);
+    if (stream)
+    {
+        return stream->sampleRate;
+    }
+    auto data = std::atomic_load(&m_data);
+    return data ? data->sampleRate : 0;
+}
+
+unsigned int StemPlayer::getSourceSampleRate() const
+{
+    return m_sourceSampleRate;
+}
+
+Tonton::Utils::LevelMeter& StemPlayer::getMeter()
+{
+    return m_meter;
+}
+
+void StemPlayer::process(ofSoundBuffer& input, ofSoundBuffer& output)
+{
+    auto& out = output.getBuffer();
+    std::fill(out.begin(), out.end(), 0.0f);
+
+    size_t nFrames = output.getNumFrames();
+    size_t nChannels = output.getNumChannels();
+
+    auto data = std::atomic_load(&m_data);
+    auto stream = std::atomic_load(&m_stream);
+    if (m_transport != nullptr)
+    {
+        const TransportCommand& command = m_transport->getCommand();
+        if (command.generation != m_appliedTransportGeneration)
+        {
+            m_appliedTransportGeneration = command.generation;
+            m_position = std::min<uint64_t>(command.frame, getDurationFrames());
+            m_playing = command.play;
+            if (stream && command.play && command.tempo == 1.0f)
+            {
+                stream->pipeline.play(command.frame);
+            }
+        }
+    }
+    bool skipSilence = m_skipSilence;
+    m_bufferSilent = skipSilence && !m_playing;
+    if (m_timeStretcher != nullptr && m_timeStretcher->isActive())
+    {
+        // the stretcher follows the transport for every track of the song
+        if (m_playing)
+        {
+            m_timeStretcher->readTrack(m_timeStretcherTrack, out, nFrames, nChannels);
+            m_position = std::min<uint64_t>(m_timeStretcher->getSourcePosition(), getDurationFrames());
+            m_playing = m_position < getDurationFrames();
+        }
+        m_meter.analyze(out.data(), out.size(), nChannels);
+        return;
+    }
+    if (stream)
+    {
+        if (skipSilence && m_playing)
+        {
+            auto silence = std::atomic_load(&stream->silence);
+            m_bufferSilent = silence != nullptr && silence->isSilent(m_position, nFrames);
+        }
+        processStream(*stream, out, nFrames, nChannels);
+        m_meter.analyze(out.data(), out.size(), nChannels);
+        return;
+    }
+    if (!m_playing || !data || data->frames == 0 || data->channels == 0)
+    {
+        m_meter.analyze(out.data(), out.size(), nChannels);
+        return;
+    }
+
+    bool skipBlocks = skipSilence && !data->silence.empty();
+    m_bufferSilent = skipBlocks;
+    uint64_t position = m_position;
+    float block[PLAYBACK_BLOCK_SAMPLES];
+    size_t blockFrames = std::max<size_t>(1, PLAYBACK_BLOCK_SAMPLES / data->channels);
+    for (size_t i = 0; i < nFrames;)
+    {
+        if (position >= data->frames)
+        {
+            if (!m_loop)
+            {
+                m_playing = false;
+                break;
+            }
+            position = 0;
+        }
+        size_t count = std::min<size_t>(std::min<size_t>(nFrames - i, blockFrames), data->frames - position);
+        if (skipBlocks && data->silence.isSilent(position, count))
+        {
+            // the buffer is already zeroed
+            i += count;
+            position += count;
+            continue;
+        }
+        m_bufferSilent = false;
+        data->readFrames(position, count, block);
+        for (size_t f = 0; f < count; f++)
+        {
+            const float* frame = &block[f * data->channels];
+            for (size_t c = 0; c < nChannels; c++)
+            {
+                // mono files are sent to every channel
+                out[(i + f) * nChannels + c] = frame[c % data->channels];
+            }
+        }
+        i += count;
+        position += count;
+    }
+    m_position = position;
+
+    m_meter.analyze(out.data(), out.size(), nChannels);
+}
+
+void StemPlayer::processStream(StemStream& stream, std::vector<float>& out, size_t nFrames, size_t nChannels)
+{
+    // chunks of the played request are kept until the transport switches to the prepared one
+    auto& pipeline = stream.pipeline;
+    uint32_t epoch = pipeline.getRequest().epoch;
+    pipeline.dropStale(epoch, m_playing);
+
+    if (!m_playing)
+    {
+        pipeline.keepPending(epoch);
+        return;
+    }
+
+    uint64_t position = m_position;
+    size_t i = 0;
+    while (i < nFrames)
+    {
+        if (position >= stream.frames)
+        {
+            if (!m_loop)
+            {
+                m_playing = false;
+                break;
+            }
+            position = 0;
+        }
+        if (pipeline.current == nullptr && !pipeline.filledChunks.pop(pipeline.current))
+        {
+            // the reader is late: play silence but keep following the transport clock
+            position += nFrames - i;
+            break;
+        }
+        const StreamChunk* chunk = pipeline.current;
+        if (chunk->epoch != pipeline.playedEpoch && chunk->epoch == epoch)
+        {
+            // prepared for the next start or seek, keep it for then
+            position += nFrames - i;
+            break;
+        }
+        if (chunk->epoch != pipeline.playedEpoch || chunk->startFrame > position || chunk->startFrame + chunk->frames <= position)
+        {
+            pipeline.releaseCurrent();
+            continue;
+        }
+
+        size_t offset = static_cast<size_t>(position - chunk->startFrame);
+        size_t count = std::min(chunk->frames - offset, nFrames - i);
+        count = static_cast<size_t>(std::min<uint64_t>(count, stream.frames - position));
+        for (size_t f = 0; f < count; f++)
+        {
+            const float* frame = &chunk->samples[(offset + f) * stream.channels];
+            for (size_t c = 0; c < nChannels; c++)
+            {
+                // mono files are sent to every channel
+                out[(i + f) * nChannels + c] = frame[c % stream.channels];
+            }
+        }
+        i += count;
+        position += count;
+        if (offset + count == chunk->frames)
+        {
+            pipeline.releaseCurrent();
+        }
+    }
+    m_position = position;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ofMain.h"
+#include "ofxSoundObject.h"
+
+#include "levelMeter.h"
+#include "peakPyramid.h"
+#include "silenceMap.h"
+#include "transport.h"
+
+enum class SampleFormat {
+    FLOAT32,
+    INT16  // 16-bit sources, half the memory
+};
+
+// decoded audio of a stem, already converted to the output device sample rate.
+// Stored compact: 16-bit sources as int16, dual-mono files as one channel (sent to
+// every channel like mono files). Converted to float when mixed.
+struct AudioData {
+    SampleFormat format = SampleFormat::FLOAT32;
+    std::vector<float> samples;  // interleaved, FLOAT32
+    std::vector<int16_t> samples16;  // interleaved, INT16
+    unsigned int channels = 0;  // stored channels
+    unsigned int sampleRate = 0;
+    size_t frames = 0;
+    unsigned int sourceSampleRate = 0;  // of the file, before resampling
+    unsigned int sourceChannels = 0;  // of the file, before the dual-mono collapse
+    Tonton::Utils::SilenceMap silence;  // empty for synthetic stems
+
+    // frames [first, first + count) as float, interleaved with the stored channels
+    void readFrames(size_t first, size_t count, float* output) const;
+    const void* getSampleData() const;
+    size_t getSampleBytes() const;
+};
+
+struct StemStream;
+class TimeStretcher;
+
+// Backing track player.
+// In memory (default): the file is decoded and resampled to the device rate when
+// loaded, so playback is a plain copy and positions are exact sample indexes.
+// Streaming: a reader thread decodes and resamples ahead of the playback position
+// into chunks handed to the audio thread, so only a few seconds are kept in memory.
+class StemPlayer : public ofxSoundObject {
+public:
+    StemPlayer();
+    virtual ~StemPlayer();
+
+    bool load(std::string filePath, unsigned int outputSampleRate, bool streaming = false);
+    // decodes a whole file, resampled to outputSampleRate (0: rate of the file). Any thread.
+    // cancel: checked between chunks of the file, null is returned once set
+    static std::shared_ptr<AudioData> decode(const std::string& filePath, unsigned int outputSampleRate, const std::atomic<bool>* cancel = nullptr);
+    // play audio that is already decoded, at the device rate (synthetic stems of the benchmark)
+    void setAudioData(std::shared_ptr<const AudioData> data);
+    // decoded audio, null when streaming
+    std::shared_ptr<const AudioData> getAudioData() const;
+    void unload();
+    bool isLoaded() const;
+
+    void play();
+    void stop();
+    bool isPlaying() const;
+    void setLoop(bool loop);
+
+    void setPositionMS(int positionMs);
+    int getPositionMS() const;
+    unsigned long getDurationMS() const;
+
+    // start, stop and seeks armed on the transport are applied at a buffer boundary
+    void setTransport(const Transport* transport);
+    // at a rehearsal tempo, the track is read from its stretched audio
+    void setTimeStretcher(const TimeStretcher* stretcher, size_t track);
+
+    // streaming: decode ahead from frame before a start / seek is armed on the transport,
+    // so that the track has audio on the first buffer. No-op in memory.
+    void prepare(uint64_t frame);
+    bool waitPrepared(unsigned int timeoutMs) const;
+    bool isStreaming() const;
+    // streaming: blocks of digital silence in the waveform of the track are not decoded
+    void setStreamSilence(const Tonton::Utils::PeakPyramid& peaks);
+
+    // silent blocks are not converted, and not mixed (on by default, benchmark)
+    void setSkipSilence(bool skip);
+    // audio thread: the last buffer is digital silence, the mixer skips it
+    bool isBufferSilent() const;
+
+    void setPositionFrames(uint64_t frame);
+    uint64_t getPositionFrames() const;
+    uint64_t getDurationFrames() const;
+    unsigned int getSampleRate() const;
+    unsigned int getSourceSampleRate() const;
+
+    // pre-fader level of the last buffers, fed by the audio thread
+    Tonton::Utils::LevelMeter& getMeter();
+
+    void process(ofSoundBuffer& input, ofSoundBuffer& output) override;
+
+private:
+    void processStream(StemStream& stream, std::vector<float>& out, size_t nFrames, size_t nChannels);
+
+    std::shared_ptr<const AudioData> m_data;
+    std::shared_ptr<StemStream> m_stream;
+    std::atomic<uint64_t> m_position {0};
+    std::atomic<bool> m_playing {false};
+    std::atomic<bool> m_loop {false};
+    unsigned int m_sourceSampleRate = 0;
+    Tonton::Utils::LevelMeter m_meter;
+    const Transport* m_transport = nullptr;
+    uint32_t m_appliedTransportGeneration = 0;
+    const TimeStretcher* m_timeStretcher = nullptr;
+    size_t m_timeStretcherTrack = 0;
+    std::atomic<bool> m_skipSilence {true};
+    bool m_bufferSilent = true;  // audio thread only
+};
@@ -0,0 +1,366 @@
+#include "timeStretcher.h"
+
+#include <chrono>
+#include <thread>
+
+#include "chunkPipeline.h"
+#include "retireQueue.h"
+#include "wsola.h"
+
+namespace {
+    const size_t STRETCH_CHUNK_FRAMES = 2048;
+    const size_t STRETCH_CHUNK_COUNT = 48;  // about 2 s ahead at 48 kHz
+    const size_t STRETCH_PREFILL_CHUNKS = 4;  // stretched ahead before a prepared start is ready
+
+    // the tempo travels with the start frame in the request value, in thousandths
+    uint32_t tempoToValue(float tempo) { return static_cast<uint32_t>(round(tempo * 1000.0f)); }
+    double valueToTempo(uint32_t value) { return value / 1000.0; }
+} // unnamed namespace
+
+struct StretchChunk {
+    uint32_t epoch = 0;
+    double sourceStart = 0.0;  // song frame of the first frame
+    double tempo = 1.0;
+    size_t frames = 0;
+    std::vector<std::vector<float>> tracks;  // interleaved, per track
+};
+
+// Same handoff as the streamed stems: chunks go from the worker to the audio thread
+// and back, every start request gets a new epoch (see ChunkPipeline).
+struct StretchSession {
+    StretchSession():pipeline(STRETCH_CHUNK_COUNT) {}
+
+    void run();
+    void stop();
+    void readSource(size_t track, int64_t frame, size_t count, float* output) const;
+
+    std::vector<std::shared_ptr<const AudioData>> tracks;
+    std::vector<unsigned int> channels;
+    unsigned int sampleRate = 0;
+    uint64_t frames = 0;  // longest track
+
+    Tonton::Utils::ChunkPipeline<StretchChunk> pipeline;  // worker -> audio thread, value: tempo
+    std::atomic<bool> running {false};
+    std::thread thread;
+
+    // audio thread only
+    size_t currentOffset = 0;
+    std::vector<std::vector<float>> buffers;  // stretched frames of the current buffer, per track
+};
+
+void StretchSession::readSource(size_t track, int64_t frame, size_t count, float* output) const
+{
+    const AudioData& data = *tracks[track];
+    unsigned int nChannels = channels[track];
+    std::fill(output, output + count * nChannels, 0.0f);
+    int64_t first = std::max<int64_t>(frame, 0);
+    int64_t last = std::min<int64_t>(frame + static_cast<int64_t>(count), static_cast<int64_t>(data.frames));
+    if (first < last)
+    {
+        data.readFrames(first, last - first, output + (first - frame) * nChannels);
+    }
+}
+
+void StretchSession::run()
+{
+    Tonton::Utils::Wsola wsola(sampleRate, channels);
+    auto reader = [this](size_t track, int64_t frame, size_t count, float* output) {
+        readSource(track, frame, count, output);
+    };
+    std::vector<std::vector<float>> pending(tracks.size());  // stretched frames not yet handed over in a chunk
+    size_t pendingOffset = 0;
+    double startFrame = 0.0;
+    double tempo = 1.0;
+    uint64_t handedFrames = 0;
+    uint32_t epoch = 0;
+    size_t queuedChunks = 0;
+    bool endOfSong = true;  // idle until the first request
+
+    while (running)
+    {
+        Tonton::Utils::ChunkRequest request = pipeline.getRequest();
+        if (request.epoch != epoch)
+        {
+            epoch = request.epoch;
+            tempo = valueToTempo(request.value);
+            startFrame = static_cast<double>(std::min(request.frame, frames));
+            wsola.reset(startFrame, tempo);
+            for (auto& track : pending)
+            {
+                track.clear();
+            }
+            pendingOffset = 0;
+            handedFrames = 0;
+            queuedChunks = 0;
+            endOfSong = false;
+            continue;
+        }
+
+        size_t pendingFrames = pending[0].size() / channels[0] - pendingOffset;
+        if (pendingFrames < STRETCH_CHUNK_FRAMES && !endOfSong)
+        {
+            for (size_t t = 0; t < pending.size(); t++)
+            {
+                pending[t].erase(pending[t].begin(), pending[t].begin() + pendingOffset * channels[t]);
+            }
+            pendingOffset = 0;
+            wsola.process(reader, pending);
+            endOfSong = wsola.getSourcePosition() >= frames;
+            continue;
+        }
+
+        if (pendingFrames == 0)
+        {
+            pipeline.readyEpoch = epoch;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+
+        StretchChunk* chunk = nullptr;
+        if (!pipeline.freeChunks.pop(chunk))
+        {
+            // far enough ahead, or waiting for the audio thread to give back older chunks
+            if (queuedChunks > 0)
+            {
+                pipeline.readyEpoch = epoch;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        size_t count = std::min(pendingFrames, STRETCH_CHUNK_FRAMES);
+        for (size_t t = 0; t < pending.size(); t++)
+        {
+            auto first = pending[t].begin() + pendingOffset * channels[t];
+            std::copy(first, first + count * channels[t], chunk->tracks[t].begin());
+        }
+        chunk->epoch = epoch;
+        chunk->sourceStart = startFrame + handedFrames * tempo;
+        chunk->tempo = tempo;
+        chunk->frames = count;
+        pipeline.filledChunks.push(chunk);
+        pendingOffset += count;
+        handedFrames += count;
+        if (++queuedChunks >= STRETCH_PREFILL_CHUNKS)
+        {
+            pipeline.readyEpoch = epoch;
+        }
+    }
+}
+
+void StretchSession::stop()
+{
+    running = false;
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+TimeStretcher::TimeStretcher() {
+
+}
+
+TimeStretcher::~TimeStretcher() {
+    clear();
+}
+
+void TimeStretcher::setTracks(const std::vector<std::shared_ptr<const AudioData>>& tracks, unsigned int sampleRate)
+{
+    clear();
+
+    auto session = std::make_shared<StretchSession>();
+    for (const auto& track : tracks)
+    {
+        if (!track || track->channels == 0)
+        {
+            // keep the track indexes of the song, a missing track is silent
+            auto silent = std::make_shared<AudioData>();
+            silent->channels = 1;
+            silent->sampleRate = sampleRate;
+            session->tracks.push_back(silent);
+        }
+        else
+        {
+            session->tracks.push_back(track);
+        }
+        session->channels.push_back(session->tracks.back()->channels);
+        session->frames = std::max<uint64_t>(session->frames, session->tracks.back()->frames);
+    }
+    if (session->tracks.empty())
+    {
+        return;
+    }
+    session->sampleRate = sampleRate;
+    session->buffers.resize(session->tracks.size());
+    for (auto& chunk : session->pipeline.chunks)
+    {
+        chunk.tracks.resize(session->tracks.size());
+        for (size_t t = 0; t < session->tracks.size(); t++)
+        {
+            chunk.tracks[t].resize(STRETCH_CHUNK_FRAMES * session->channels[t]);
+        }
+        session->pipeline.freeChunks.push(&chunk);
+    }
+    session->running = true;
+    session->thread = std::thread(&StretchSession::run, session.get());
+    Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_session, session));
+}
+
+void TimeStretcher::clear()
+{
+    auto session = std::atomic_load(&m_session);
+    if (session)
+    {
+        // the audio thread may still hold the session for one buffer, only the worker is stopped here
+        session->stop();
+    }
+    Tonton::Utils::RetireQueue::retire(std::atomic_exchange(&m_session, std::shared_ptr<StretchSession>()));
+}
+
+void TimeStretcher::setTransport(const Transport* transport)
+{
+    m_transport = transport;
+    if (m_transport != nullptr)
+    {
+        m_appliedTransportGeneration = m_transport->getLatchedGeneration();
+    }
+}
+
+void TimeStretcher::prepare(uint64_t frame, float tempo)
+{
+    auto session = std::atomic_load(&m_session);
+    if (session)
+    {
+        session->pipeline.request(frame, tempoToValue(tempo));
+    }
+}
+
+bool TimeStretcher::waitPrepared(unsigned int timeoutMs) const
+{
+    auto session = std::atomic_load(&m_session);
+    if (!session)
+    {
+        return true;
+    }
+    return session->pipeline.waitReady(timeoutMs);
+}
+
+void TimeStretcher::process(size_t nFrames)
+{
+    m_playingSession = std::atomic_load(&m_session);
+    StretchSession* session = m_playingSession.get();
+
+    bool applyStart = false;
+    uint64_t startFrame = 0;
+    if (m_transport != nullptr)
+    {
+        const TransportCommand& command = m_transport->getCommand();
+        if (command.generation != m_appliedTransportGeneration)
+        {
+            m_appliedTransportGeneration = command.generation;
+            m_active = command.play && command.tempo != 1.0f;
+            applyStart = m_active;
+            startFrame = command.frame;
+            m_tempo = command.tempo;
+        }
+    }
+    if (session == nullptr)
+    {
+        m_active = false;
+        return;
+    }
+
+    auto& pipeline = session->pipeline;
+    uint32_t epoch = pipeline.getRequest().epoch;
+    if (applyStart)
+    {
+        // the prepared chunks are used if they start at this frame and tempo
+        epoch = pipeline.play(startFrame, tempoToValue(m_tempo));
+        m_sourcePosition = static_cast<double>(startFrame);
+    }
+    pipeline.dropStale(epoch, m_active);
+
+    if (!m_active)
+    {
+        if (pipeline.keepPending(epoch))
+        {
+            session->currentOffset = 0;
+        }
+        return;
+    }
+
+    for (size_t t = 0; t < session->buffers.size(); t++)
+    {
+        session->buffers[t].assign(nFrames * session->channels[t], 0.0f);
+    }
+
+    size_t i = 0;
+    while (i < nFrames)
+    {
+        if (pipeline.current == nullptr)
+        {
+            if (!pipeline.filledChunks.pop(pipeline.current))
+            {
+                // the worker is late: play silence but keep following the transport clock
+                m_sourcePosition += (nFrames - i) * static_cast<double>(m_tempo);
+                break;
+            }
+            session->currentOffset = 0;
+        }
+        const StretchChunk* chunk = pipeline.current;
+        if (chunk->epoch != pipeline.playedEpoch && chunk->epoch == epoch)
+        {
+            // prepared for the next start, keep it for then
+            m_sourcePosition += (nFrames - i) * static_cast<double>(m_tempo);
+            break;
+        }
+        if (chunk->epoch != pipeline.playedEpoch)
+        {
+            pipeline.releaseCurrent();
+            continue;
+        }
+
+        size_t count = std::min(chunk->frames - session->currentOffset, nFrames - i);
+        for (size_t t = 0; t < session->buffers.size(); t++)
+        {
+            unsigned int channels = session->channels[t];
+            const float* first = &chunk->tracks[t][session->currentOffset * channels];
+            std::copy(first, first + count * channels, &session->buffers[t][i * channels]);
+        }
+        i += count;
+        session->currentOffset += count;
+        m_sourcePosition = chunk->sourceStart + session->currentOffset * chunk->tempo;
+        if (session->currentOffset == chunk->frames)
+        {
+            pipeline.releaseCurrent();
+        }
+    }
+}
+
+bool TimeStretcher::isActive() const
+{
+    return m_active && m_playingSession != nullptr;
+}
+
+void TimeStretcher::readTrack(size_t track, std::vector<float>& out, size_t nFrames, size_t nChannels) const
+{
+    if (!isActive() || track >= m_playingSession->buffers.size())
+    {
+        return;
+    }
+    const std::vector<float>& buffer = m_playingSession->buffers[track];
+    unsigned int channels = m_playingSession->channels[track];
+    for (size_t i = 0; i < nFrames; i++)
+    {
+        for (size_t c = 0; c < nChannels; c++)
+        {
+            // mono files are sent to every channel
+            out[i * nChannels + c] = buffer[i * channels + c % channels];
+        }
+    }
+}
+
+uint64_t TimeStretcher::getSourcePosition() const
+{
+    return static_cast<uint64_t>(m_sourcePosition);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "stemPlayer.h"
+#include "transport.h"
+
+struct StretchSession;
+
+// Rehearsal tempo: plays every track of the song slower or faster, without
+// changing the pitch.
+// A worker thread time-stretches all the tracks together (WSOLA, same segments for
+// every track) ahead of the playback position, the audio thread reads the result.
+// It is used when the transport starts with a tempo other than 1, the tracks are
+// then read from here instead of their own data.
+class TimeStretcher {
+public:
+    TimeStretcher();
+    virtual ~TimeStretcher();
+
+    // ui thread: decoded tracks of the song, at the device rate
+    void setTracks(const std::vector<std::shared_ptr<const AudioData>>& tracks, unsigned int sampleRate);
+    void clear();
+    void setTransport(const Transport* transport);
+
+    // stretch ahead from frame at tempo before a start is armed on the transport
+    void prepare(uint64_t frame, float tempo);
+    bool waitPrepared(unsigned int timeoutMs) const;
+
+    // audio thread, once per buffer before the tracks are read:
+    // applies the transport command and gathers the stretched frames of the buffer
+    void process(size_t nFrames);
+    // the transport plays at a tempo other than 1, the tracks must read from here
+    bool isActive() const;
+    // copies the buffer of a track, mono tracks are sent to every channel
+    void readTrack(size_t track, std::vector<float>& out, size_t nFrames, size_t nChannels) const;
+    // song position (source frames) at the end of the buffer
+    uint64_t getSourcePosition() const;
+
+private:
+    std::shared_ptr<StretchSession> m_session;
+    const Transport* m_transport = nullptr;
+    uint32_t m_appliedTransportGeneration = 0;
+
+    // audio thread only
+    std::shared_ptr<StretchSession> m_playingSession;
+    bool m_active = false;
+    float m_tempo = 1.0f;
+    double m_sourcePosition = 0.0;
+};
@@ -0,0 +1,239 @@
+#include "trackAnalyzer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "audioFileReader.h"
+#include "loudness.h"
+
+namespace {
+    const size_t ANALYSIS_CHUNK_FRAMES = 65536;  // cancellation is checked between chunks
+} // unnamed namespace
+
+struct TrackAnalysisJob {
+    std::string songsRootDir;
+    std::string songName;
+    std::vector<std::string> filePaths;
+    std::vector<std::shared_ptr<const AudioData>> tracks;
+    // an entry is only written by the thread analyzing its track
+    std::vector<TrackLoudness> loudness;
+    std::vector<std::shared_ptr<const Tonton::Utils::PeakPyramid>> waveforms;
+    std::atomic<size_t> nextTrack {0};
+    std::atomic<size_t> decodedTracks {0};
+    std::atomic<size_t> finishedThreads {0};
+    std::atomic<bool> cancelled {false};
+    std::vector<std::thread> threads;
+    uint64_t startTime = 0;
+
+    void run();
+    void analyze(size_t track);
+};
+
+void TrackAnalysisJob::run()
+{
+    for (;;)
+    {
+        size_t track = nextTrack++;
+        if (track >= filePaths.size() || cancelled)
+        {
+            break;
+        }
+        analyze(track);
+    }
+    finishedThreads++;
+}
+
+void TrackAnalysisJob::analyze(size_t track)
+{
+    TrackLoudness& result = loudness[track];
+    auto waveform = std::make_shared<Tonton::Utils::PeakPyramid>();
+    bool waveformCached = waveform->load(TrackAnalyzer::getWaveformPath(filePaths[track]), result.fileSize);
+    if (waveformCached)
+    {
+        waveforms[track] = waveform;
+    }
+    if (waveformCached && result.measured)
+    {
+        return;
+    }
+
+    // one pass over the audio for whatever is missing from the caches
+    std::unique_ptr<Tonton::Utils::LoudnessMeter> meter;
+    auto analyzeFrames = [&](const float* samples, size_t frames) {
+        if (meter != nullptr)
+        {
+            meter->addFrames(samples, frames);
+        }
+        if (!waveformCached)
+        {
+            waveform->addFrames(samples, frames);
+        }
+    };
+    auto setup = [&](unsigned int sampleRate, unsigned int channels) {
+        if (!result.measured)
+        {
+            meter = std::make_unique<Tonton::Utils::LoudnessMeter>(sampleRate, channels);
+        }
+        if (!waveformCached)
+        {
+            waveform->setup(sampleRate, channels);
+        }
+    };
+
+    const auto& data = tracks[track];
+    if (data != nullptr)
+    {
+        setup(data->sampleRate, data->channels);
+        std::vector<float> buffer(ANALYSIS_CHUNK_FRAMES * data->channels);
+        for (size_t frame = 0; frame < data->frames && !cancelled; frame += ANALYSIS_CHUNK_FRAMES)
+        {
+            size_t count = std::min(ANALYSIS_CHUNK_FRAMES, data->frames - frame);
+            data->readFrames(frame, count, buffer.data());
+            analyzeFrames(buffer.data(), count);
+        }
+    }
+    else
+    {
+        AudioFileReader reader;
+        if (!reader.open(filePaths[track]))
+        {
+            ofLogError() << "could not decode " << filePaths[track] << " for analysis";
+            return;
+        }
+        setup(reader.getSampleRate(), reader.getChannels());
+        std::vector<float> chunk(ANALYSIS_CHUNK_FRAMES * reader.getChannels());
+        while (!cancelled)
+        {
+            size_t read = reader.read(chunk.data(), ANALYSIS_CHUNK_FRAMES);
+            analyzeFrames(chunk.data(), read);
+            if (read < ANALYSIS_CHUNK_FRAMES)
+            {
+                break;
+            }
+        }
+    }
+    if (cancelled)
+    {
+        return;
+    }
+    decodedTracks++;
+
+    if (meter != nullptr)
+    {
+        result.integratedLufs = static_cast<float>(meter->getIntegratedLoudness());
+        result.truePeakDb = static_cast<float>(meter->getTruePeak());
+        result.measured = true;
+    }
+    if (!waveformCached)
+    {
+        waveform->finish();
+        if (!waveform->save(TrackAnalyzer::getWaveformPath(filePaths[track]), result.fileSize))
+        {
+            ofLogError() << "could not write " << TrackAnalyzer::getWaveformPath(filePaths[track]);
+        }
+        waveforms[track] = waveform;
+    }
+}
+
+TrackAnalyzer::TrackAnalyzer() {
+
+}
+
+TrackAnalyzer::~TrackAnalyzer() {
+    cancel();
+}
+
+std::string TrackAnalyzer::getWaveformPath(const std::string& filePath)
+{
+    return filePath + ".peaks";
+}
+
+void TrackAnalyzer::start(const std::string& songsRootDir, const std::string& songName, const std::vector<std::string>& filePaths,
+                          const std::vector<std::shared_ptr<const AudioData>>& tracks)
+{
+    cancel();
+    m_loudness.clear();
+    m_waveforms.clear();
+
+    auto job = std::make_shared<TrackAnalysisJob>();
+    job->songsRootDir = songsRootDir;
+    job->songName = songName;
+    job->filePaths = filePaths;
+    job->tracks = tracks;
+    job->tracks.resize(filePaths.size());
+    job->loudness.resize(filePaths.size());
+    job->waveforms.resize(filePaths.size());
+    for (size_t i = 0; i < filePaths.size(); i++)
+    {
+        job->loudness[i].file = ofFilePath::getFileName(filePaths[i]);
+        job->loudness[i].fileSize = ofFile(filePaths[i], ofFile::Reference).getSize();
+    }
+    VolumesDb::getStoredLoudness(songsRootDir, songName, job->loudness);
+
+    unsigned int cores = std::thread::hardware_concurrency();
+    size_t threadCount = std::min<size_t>(filePaths.size(), cores > 1 ? cores - 1 : 1);
+    job->startTime = ofGetElapsedTimeMillis();
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        job->threads.push_back(std::thread(&TrackAnalysisJob::run, job.get()));
+    }
+    m_job = job;
+}
+
+void TrackAnalyzer::cancel()
+{
+    if (m_job == nullptr)
+    {
+        return;
+    }
+    m_job->cancelled = true;
+    for (auto& thread : m_job->threads)
+    {
+        thread.join();
+    }
+    m_job.reset();
+}
+
+bool TrackAnalyzer::poll()
+{
+    if (m_job == nullptr || m_job->finishedThreads < m_job->threads.size())
+    {
+        return false;
+    }
+    for (auto& thread : m_job->threads)
+    {
+        thread.join();
+    }
+    m_loudness = m_job->loudness;
+    m_waveforms = m_job->waveforms;
+    if (m_job->decodedTracks > 0)
+    {
+        ofLog() << m_job->decodedTracks << " tracks analyzed in " << (ofGetElapsedTimeMillis() - m_job->startTime) << " ms";
+        VolumesDb::setStoredLoudness(m_job->songsRootDir, m_job->songName, m_loudness);
+    }
+    for (const auto& result : m_loudness)
+    {
+        if (result.measured)
+        {
+            ofLog() << result.file << ": " << result.integratedLufs << " LUFS, true peak " << result.truePeakDb << " dBTP";
+        }
+    }
+    m_job.reset();
+    return true;
+}
+
+bool TrackAnalyzer::isRunning() const
+{
+    return m_job != nullptr;
+}
+
+const std::vector<TrackLoudness>& TrackAnalyzer::getLoudness() const
+{
+    return m_loudness;
+}
+
+const std::vector<std::shared_ptr<const Tonton::Utils::PeakPyramid>>& TrackAnalyzer::getWaveforms() const
+{
+    return m_waveforms;
+}
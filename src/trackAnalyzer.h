@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ofMain.h"
+
+#include "peakPyramid.h"
+#include "stemPlayer.h"
+#include "volumesDb.h"
+
+struct TrackAnalysisJob;
+
+// Analysis of the tracks of a song, run in background threads after it is loaded:
+// loudness (EBU R128 integrated loudness and true peak) and waveform overview.
+// The tracks are spread over the cores, one core is left to the ui and the audio thread.
+// Both results are cached, a track is only decoded again when its file changes:
+// loudness with the song volumes (VolumesDb), waveforms next to the audio files (<file>.peaks).
+class TrackAnalyzer {
+public:
+    TrackAnalyzer();
+    virtual ~TrackAnalyzer();
+
+    // ui thread. Decoded tracks are analyzed in memory, streamed tracks (null data)
+    // are decoded again from their file.
+    void start(const std::string& songsRootDir, const std::string& songName, const std::vector<std::string>& filePaths,
+               const std::vector<std::shared_ptr<const AudioData>>& tracks);
+    // stops the analysis of the previous song, returns once its threads are done
+    void cancel();
+
+    // ui thread: true once, when every track has been analyzed or read from the caches
+    bool poll();
+    bool isRunning() const;
+    // one entry per track of start(), valid after poll() returned true
+    const std::vector<TrackLoudness>& getLoudness() const;
+    // null for a track that could not be decoded
+    const std::vector<std::shared_ptr<const Tonton::Utils::PeakPyramid>>& getWaveforms() const;
+
+    static std::string getWaveformPath(const std::string& filePath);
+
+private:
+    std::shared_ptr<TrackAnalysisJob> m_job;
+    std::vector<TrackLoudness> m_loudness;
+    std::vector<std::shared_ptr<const Tonton::Utils::PeakPyramid>> m_waveforms;
+};
@@ -0,0 +1,89 @@
+#include "transport.h"
+
+#include "performanceMode.h"
+
+namespace {
+    const uint64_t FRAME_BITS = 40;
+    const uint64_t FRAME_MASK = (uint64_t(1) << FRAME_BITS) - 1;
+    const uint64_t PLAY_FLAG = uint64_t(1) << FRAME_BITS;
+    // tempo in thousandths, up to 2.047
+    const uint64_t TEMPO_SHIFT = FRAME_BITS + 1;
+    const uint64_t TEMPO_BITS = 11;
+    const uint64_t TEMPO_MASK = (uint64_t(1) << TEMPO_BITS) - 1;
+    const uint64_t GENERATION_SHIFT = TEMPO_SHIFT + TEMPO_BITS;
+    const uint64_t GENERATION_MASK = (uint64_t(1) << (64 - GENERATION_SHIFT)) - 1;
+} // unnamed namespace
+
+Transport::Transport():ofxSoundObject(OFX_SOUND_OBJECT_PROCESSOR) {
+    setName("Transport");
+}
+
+Transport::~Transport() {
+
+}
+
+void Transport::arm(bool play, uint64_t frame, float tempo)
+{
+    m_generation = (m_generation + 1) & GENERATION_MASK;
+    if (m_generation == 0)
+    {
+        m_generation = 1;  // 0 is the initial state, never re-armed
+    }
+    uint64_t tempoValue = std::min<uint64_t>(static_cast<uint64_t>(round(std::max(tempo, 0.001f) * 1000.0f)), TEMPO_MASK);
+    uint64_t packed = (static_cast<uint64_t>(m_generation) << GENERATION_SHIFT) | (tempoValue << TEMPO_SHIFT) | (frame & FRAME_MASK);
+    if (play)
+    {
+        packed |= PLAY_FLAG;
+    }
+    m_pendingCommand.store(packed, std::memory_order_release);
+}
+
+void Transport::play(uint64_t frame, float tempo)
+{
+    arm(true, frame, tempo);
+}
+
+void Transport::stop()
+{
+    arm(false, 0, 1.0f);
+}
+
+uint32_t Transport::getLatchedGeneration() const
+{
+    return m_latchedGeneration.load(std::memory_order_acquire);
+}
+
+const TransportCommand& Transport::getCommand() const
+{
+    return m_latchedCommand;
+}
+
+uint64_t Transport::getBufferCount() const
+{
+    return m_bufferCount;
+}
+
+void Transport::setPerformanceMode(PerformanceMode* performanceMode)
+{
+    m_performanceMode = performanceMode;
+}
+
+void Transport::process(ofSoundBuffer& input, ofSoundBuffer& output)
+{
+    output = input;
+
+    if (m_performanceMode != nullptr)
+    {
+        m_performanceMode->enterAudioThread();
+    }
+
+    // the command becomes visible to the whole chain for the next buffer only
+    uint64_t packed = m_pendingCommand.load(std::memory_order_acquire);
+    m_latchedCommand.generation = static_cast<uint32_t>(packed >> GENERATION_SHIFT);
+    m_latchedCommand.play = (packed & PLAY_FLAG) != 0;
+    m_latchedCommand.frame = packed & FRAME_MASK;
+    uint64_t tempoValue = (packed >> TEMPO_SHIFT) & TEMPO_MASK;
+    m_latchedCommand.tempo = tempoValue > 0 ? tempoValue / 1000.0f : 1.0f;  // 0: nothing armed yet
+    m_latchedGeneration.store(m_latchedCommand.generation, std::memory_order_release);
+    m_bufferCount += 1;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "ofMain.h"
+#include "ofxSoundObject.h"
+
+class PerformanceMode;
+
+struct TransportCommand {
+    uint32_t generation = 0;
+    bool play = false;
+    uint64_t frame = 0;  // song position to start from, in samples at the device rate
+    float tempo = 1.0f;  // playback speed of the song, without pitch change (rehearsals)
+};
+
+// Sample-synchronous start / seek of all the tracks and the midi clock.
+// The ui thread arms a command, the transport latches it at the end of an audio
+// buffer and every track and the metronome apply it at the beginning of the next
+// one. They all switch at the same buffer boundary, on the same sample.
+// Must be the last object of the chain, so that everything it feeds is processed
+// before the command is latched.
+class Transport : public ofxSoundObject {
+public:
+    Transport();
+    virtual ~Transport();
+
+    // ui thread
+    void play(uint64_t frame, float tempo = 1.0f);
+    void stop();
+    // any thread: generation of the last latched command, already applied by the chain.
+    // Objects attached later ignore it and apply the next one, even if it is armed already
+    uint32_t getLatchedGeneration() const;
+
+    // audio thread: command to apply in the current buffer
+    const TransportCommand& getCommand() const;
+
+    uint64_t getBufferCount() const;
+
+    // promotes the device thread, seen first here (set before the device is opened)
+    void setPerformanceMode(PerformanceMode* performanceMode);
+
+    void process(ofSoundBuffer& input, ofSoundBuffer& output) override;
+
+private:
+    void arm(bool play, uint64_t frame, float tempo);
+
+    // packed command written by the ui thread, read at once by the audio thread:
+    // frame (40 bits), play flag, tempo (11 bits), generation (12 bits)
+    std::atomic<uint64_t> m_pendingCommand {0};
+    TransportCommand m_latchedCommand;  // audio thread only
+    std::atomic<uint32_t> m_latchedGeneration {0};
+    std::atomic<uint64_t> m_bufferCount {0};
+    uint32_t m_generation = 0;
+    PerformanceMode* m_performanceMode = nullptr;
+};
@@ -18,9 +18,15 @@ void VideoClipSource::setSpeedChangeDelay(float speedChangeDelay)
 	}
 }
 
+void VideoClipSource::setBaseSpeed(float speed)
+{
+	m_baseSpeed = speed;
+}
+
 void VideoClipSource::closeVideo() {
 	m_videoPlayer.close();
 	m_isPlaying = false;
+	m_isLoaded = false;
 }
 
 void VideoClipSource::update(bool resync, float currentSongTimeMs, float& measuredDelayMs) {
@@ -37,9 +43,9 @@ void VideoClipSource::update(bool resync, float currentSongTimeMs, float& measur
 		{
 			if (measuredDelayMs > -40 && measuredDelayMs < 40)
 			{
-				if (m_videoPlayer.getSpeed() != 1.0)
+				if (m_videoPlayer.getSpeed() != m_baseSpeed)
 				{
-					m_videoPlayer.setSpeed(1.0);
+					m_videoPlayer.setSpeed(m_baseSpeed);
 				}
 				ofLog() << "sync ok: " << measuredDelayMs << " cd=" << m_speedChangeDelayMs;
 				m_NextPlaybackTimeSpeedCheck = currentSongTimeMs + 20000.0;  // longer check delay
@@ -57,6 +63,7 @@ void VideoClipSource::update(bool resync, float currentSongTimeMs, float& measur
 				{
 					newSpeed = 0.99;
 				}
+				newSpeed *= m_baseSpeed;
 
 				m_nextTheoreticalPlaybackTime = videoTimeMs + newSpeed * 3000.0;
 
@@ -66,9 +73,9 @@ void VideoClipSource::update(bool resync, float currentSongTimeMs, float& measur
 		}
 	}
 
-	if (!resync && m_videoPlayer.getSpeed() != 1.0)
+	if (!resync && m_videoPlayer.getSpeed() != m_baseSpeed)
 	{
-		m_videoPlayer.setSpeed(1.0);
+		m_videoPlayer.setSpeed(m_baseSpeed);
 	}
 
 	m_videoPlayer.update();
@@ -76,7 +83,7 @@ void VideoClipSource::update(bool resync, float currentSongTimeMs, float& measur
 
 void VideoClipSource::loadVideo(std::string videoPath) {
 	m_videoPlayer.setSpeed(1.0);
-	m_videoPlayer.load(videoPath);
+	m_isLoaded = m_videoPlayer.load(videoPath);
 	m_videoPlayer.setVolume(0.0);
 	m_videoWidth = m_videoPlayer.getWidth();
 	m_videoHeight = m_videoPlayer.getHeight();
@@ -87,6 +94,7 @@ void VideoClipSource::playVideo(float initTime) {
 	float pct = initTime / duration;
 	ofLogError() << "duration:" << duration << ", pct:" << pct;
 	m_videoPlayer.play();
+	m_videoPlayer.setSpeed(m_baseSpeed);
 	if (pct > 0.0)
 	{
 		m_videoPlayer.setPosition(pct);
@@ -107,6 +115,16 @@ void VideoClipSource::draw(int targetWidth, int targetHeight) {
 	}
 }
 
+uint64_t VideoClipSource::getMemoryBytes() const
+{
+	if (!m_isLoaded)
+	{
+		return 0;
+	}
+	// rgba pixels of the decoded frame, and the same in the texture
+	return 2 * 4 * static_cast<uint64_t>(m_videoWidth) * m_videoHeight;
+}
+
 ofTexture& VideoClipSource::getTexture()
 {
 	return m_videoPlayer.getTextureReference();
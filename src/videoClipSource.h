@@ -13,15 +13,21 @@ public:
 	void playVideo(float initTime);
 	ofTexture& getTexture();
 	void setSpeedChangeDelay(float speedChangeDelay);
+	// speed of the song (rehearsal tempo), resync corrections are applied around it
+	void setBaseSpeed(float speed);
+	// decoded frame and texture of the loaded video, 0 without video
+	uint64_t getMemoryBytes() const;
 
 private:
 	int m_videoWidth;
 	int m_videoHeight;
+	bool m_isLoaded = false;
 	ofVideoPlayer m_videoPlayer;
 	ofTexture m_videoTexture;
 	bool m_isPlaying;
 	float m_NextPlaybackTimeSpeedCheck = 0;
 	float m_speedChangeDelayMs = 30.0;
 	float m_nextTheoreticalPlaybackTime = 0.0;
+	float m_baseSpeed = 1.0;
 };
 
@@ -0,0 +1,237 @@
+#include "volumeStore.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include "ofMain.h"
+#include "asyncWriter.h"
+
+namespace {
+    const char STORE_HEADER[] = "# tonton volumes 1\n";
+    // journal entries written before the store is compacted
+    const size_t COMPACT_ENTRIES = 256;
+
+    // song <tab> stem <tab> volume, one line per entry in the store and in the journal
+    std::string formatEntry(const std::string& song, const std::string& stem, float volume)
+    {
+        char value[32];
+        snprintf(value, sizeof(value), "%.4f", volume);
+        return song + '\t' + stem + '\t' + value + '\n';
+    }
+
+    bool isStorable(const std::string& name)
+    {
+        return name.find_first_of("\t\n") == std::string::npos;
+    }
+} // unnamed namespace
+
+VolumeStore::VolumeStore()
+{
+
+}
+
+VolumeStore::~VolumeStore()
+{
+    close();
+}
+
+void VolumeStore::load(const std::string& storePath, const std::string& journalPath)
+{
+    close();
+    m_storePath = storePath;
+    m_journalPath = journalPath;
+    m_volumes.clear();
+    readFile(m_storePath, m_volumes);
+    m_journalEntries = readFile(m_journalPath, m_volumes);
+
+    m_stop = false;
+    m_writer = std::thread(&VolumeStore::runWriter, this);
+    if (m_journalEntries > 0)
+    {
+        // the show starts from an empty journal
+        compactLater();
+    }
+    ofLog() << "volume store: " << m_volumes.size() << " songs";
+}
+
+void VolumeStore::close()
+{
+    if (!m_writer.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wakeUp.notify_one();
+    m_writer.join();
+}
+
+size_t VolumeStore::readFile(const std::string& path, Volumes& volumes) const
+{
+    std::ifstream stream(path, std::ios::binary);
+    size_t entries = 0;
+    std::string line;
+    // a last line without its end was cut while being written
+    while (std::getline(stream, line) && !stream.eof())
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        size_t stemStart = line.find('\t');
+        size_t volumeStart = stemStart == std::string::npos ? stemStart : line.find('\t', stemStart + 1);
+        if (volumeStart == std::string::npos)
+        {
+            continue;
+        }
+        char* end = nullptr;
+        float volume = strtof(line.c_str() + volumeStart + 1, &end);
+        if (end == line.c_str() + volumeStart + 1 || *end != '\0')
+        {
+            continue;
+        }
+        volumes[line.substr(0, stemStart)][line.substr(stemStart + 1, volumeStart - stemStart - 1)] = volume;
+        entries++;
+    }
+    return entries;
+}
+
+bool VolumeStore::hasSong(const std::string& song) const
+{
+    return m_volumes.count(song) > 0;
+}
+
+float VolumeStore::getVolume(const std::string& song, const std::string& stem) const
+{
+    auto stems = m_volumes.find(song);
+    if (stems == m_volumes.end())
+    {
+        return -1.0f;
+    }
+    auto volume = stems->second.find(stem);
+    return volume != stems->second.end() ? volume->second : -1.0f;
+}
+
+void VolumeStore::setVolume(const std::string& song, const std::string& stem, float volume)
+{
+    auto& stems = m_volumes[song];
+    auto stored = stems.find(stem);
+    if (stored != stems.end() && stored->second == volume)
+    {
+        return;
+    }
+    stems[stem] = volume;
+    if (!m_writer.joinable())
+    {
+        return;
+    }
+    if (!isStorable(song) || !isStorable(stem))
+    {
+        ofLogWarning() << "volume of " << song << " / " << stem << " not saved: tab or line break in the name";
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingLines += formatEntry(song, stem, volume);
+    }
+    m_wakeUp.notify_one();
+    if (++m_journalEntries >= COMPACT_ENTRIES)
+    {
+        compactLater();
+    }
+}
+
+void VolumeStore::compactLater()
+{
+    auto snapshot = std::make_shared<const Volumes>(m_volumes);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingSnapshot = snapshot;
+        // already in the snapshot
+        m_pendingLines.clear();
+    }
+    m_journalEntries = 0;
+    m_wakeUp.notify_one();
+}
+
+void VolumeStore::flush()
+{
+    if (!m_writer.joinable())
+    {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_written.wait(lock, [this]() {
+        return !m_writing && m_pendingLines.empty() && m_pendingSnapshot == nullptr;
+    });
+}
+
+void VolumeStore::runWriter()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wakeUp.wait(lock, [this]() {
+            return m_stop || !m_pendingLines.empty() || m_pendingSnapshot != nullptr;
+        });
+        if (m_pendingLines.empty() && m_pendingSnapshot == nullptr)
+        {
+            return;
+        }
+        std::shared_ptr<const Volumes> snapshot;
+        snapshot.swap(m_pendingSnapshot);
+        std::string lines;
+        lines.swap(m_pendingLines);
+        m_writing = true;
+        lock.unlock();
+
+        // the lines were set after the snapshot, they go to the emptied journal
+        if (snapshot != nullptr)
+        {
+            compact(*snapshot);
+        }
+        if (!lines.empty() && !appendJournal(lines))
+        {
+            ofLogError() << "volume store: could not write " << m_journalPath;
+        }
+
+        lock.lock();
+        m_writing = false;
+        m_written.notify_all();
+    }
+}
+
+bool VolumeStore::appendJournal(const std::string& lines)
+{
+    return Tonton::Utils::writeFileSynced(m_journalPath, lines, true);
+}
+
+bool VolumeStore::compact(const Volumes& volumes)
+{
+    std::string content = STORE_HEADER;
+    std::string entries;
+    for (const auto& song : volumes)
+    {
+        for (const auto& stem : song.second)
+        {
+            if (isStorable(song.first) && isStorable(stem.first))
+            {
+                entries += formatEntry(song.first, stem.first, stem.second);
+            }
+        }
+    }
+    content += entries;
+
+    // a new file renamed over the store, which is never seen half written
+    if (!Tonton::Utils::replaceFile(m_storePath, content))
+    {
+        // the journal keeps the entries instead, replayed at the next start
+        ofLogError() << "volume store: could not replace " << m_storePath;
+        return appendJournal(entries);
+    }
+    // only emptied once the store holds its entries
+    return Tonton::Utils::writeFileSynced(m_journalPath, "");
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Volumes of the stems of every song of the setlist, in one store keyed by song and stem.
+// A change is appended to a journal by a background thread, the ui thread never waits for
+// the disk. When the journal grows, the whole store is written to a new file renamed over
+// the previous one, then the journal is emptied: a crash at any point leaves a readable
+// store, and the journal replayed over it gives the last saved volumes.
+class VolumeStore {
+public:
+    VolumeStore();
+    virtual ~VolumeStore();
+
+    // ui thread, at startup: reads the store, replays the journal and starts the writer
+    void load(const std::string& storePath, const std::string& journalPath);
+    // writes what is pending and stops the writer
+    void close();
+
+    bool hasSong(const std::string& song) const;
+    // -1 when the stem of the song has no stored volume
+    float getVolume(const std::string& song, const std::string& stem) const;
+    // ui thread: journaled in the background, nothing is written when the volume is unchanged
+    void setVolume(const std::string& song, const std::string& stem, float volume);
+    // returns once the changes set so far are on disk
+    void flush();
+
+private:
+    typedef std::unordered_map<std::string, std::unordered_map<std::string, float>> Volumes;
+
+    // complete lines only, a line cut by a crash is ignored. Returns the number of entries
+    size_t readFile(const std::string& path, Volumes& volumes) const;
+    void compactLater();
+    void runWriter();
+    bool appendJournal(const std::string& lines);
+    bool compact(const Volumes& volumes);
+
+    Volumes m_volumes;
+    std::string m_storePath;
+    std::string m_journalPath;
+    size_t m_journalEntries = 0;
+
+    std::thread m_writer;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::condition_variable m_written;
+    // m_mutex locked
+    std::string m_pendingLines;
+    std::shared_ptr<const Volumes> m_pendingSnapshot;  // compaction, older than m_pendingLines
+    bool m_writing = false;
+    bool m_stop = false;
+};
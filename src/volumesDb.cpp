@@ -1,53 +1,187 @@
 #include "volumesDb.h"
 #include "ofxXmlSettings.h"
+#include "xmlPullParser.h"
+#include "asyncWriter.h"
+
+#include <unordered_map>
 
 using namespace std;
 
 void VolumesDb::getStoredSongVolumes(string songsRootDir, string songName, vector<pair<string, float>>& volumes)
 {
-	vector<pair<string, float>> result;
-	ofxXmlSettings settings;
-	if (settings.load(songsRootDir + songName + "/tracks.xml")) {
-		bool success = settings.pushTag("tracks");
-		if (!success)
+	// <tracks><track file="..." volume="100"/>..., read in one pass
+	Tonton::Utils::XmlPullParser parser;
+	if (!parser.loadFile(ofToDataPath(songsRootDir + songName + "/tracks.xml")))
+	{
+		ofLog() << "could not load song tracks file: tracks.xml";
+		return;
+	}
+	unordered_map<string, float> storedVolumes;
+	Tonton::Utils::XmlPullParser::Event event;
+	while ((event = parser.next()) != Tonton::Utils::XmlPullParser::Event::END_DOCUMENT)
+	{
+		if (event == Tonton::Utils::XmlPullParser::Event::ERROR)
+		{
+			ofLogError() << songName << "/tracks.xml: " << parser.getError();
+			return;
+		}
+		if (event != Tonton::Utils::XmlPullParser::Event::START_ELEMENT)
+		{
+			continue;
+		}
+		if (parser.getDepth() == 1 && parser.getName() != "tracks")
 		{
 			ofLog() << "could not load song from song tracks file: bad xml structure";
+			return;
+		}
+		string trackFile;
+		string volume = "100";
+		if (parser.getDepth() == 2 && parser.getName() == "track" && parser.getAttribute("file", trackFile))
+		{
+			parser.getAttribute("volume", volume);
+			long value;
+			if (Tonton::Utils::parseXmlInteger(volume, value))
+			{
+				storedVolumes[trackFile] = value / 100.0f;
+			}
+			else
+			{
+				ofLogWarning() << songName << "/tracks.xml: line " << parser.getLine() << ": volume '" << volume << "' is not an integer";
+			}
+		}
+	}
+	for (const auto& warning : parser.getWarnings())
+	{
+		ofLogWarning() << songName << "/tracks.xml: " << warning;
+	}
+
+	// the volume of each loaded file, by its own entry
+	for (auto& volume : volumes)
+	{
+		auto stored = storedVolumes.find(volume.first);
+		if (stored != storedVolumes.end())
+		{
+			volume.second = stored->second;
 		}
-        
-        int tracksCount = settings.getNumTags("track");
-        
-        for (int i = 0; i < tracksCount; i++) {
-            string trackFile = settings.getAttribute("track", "file", "", i);
-            
-            // find matching loaded file
-            for (int i = 0; i < volumes.size(); i++) {
-                if (volumes[i].first == trackFile)
-                {
-                    int volume = stoi(settings.getAttribute("track", "volume", "100", i));
-                    volumes[i].second = volume / 100.0;
-                }
-            }
-        }
-	}
-	else
-	{
-		ofLog() << "could not load sont tracks file: tracks.xml";
 	}
 }
 
-void VolumesDb::setStoredSongVolumes(string songsRootDir, string songName, vector<pair<std::string, float>>& volumes)
+namespace {
+	Tonton::Utils::AsyncWriter* loudnessWriter = nullptr;
+
+	string getLoudnessFilePath(const string& songsRootDir, const string& songName)
+	{
+		return ofToDataPath(songsRootDir + songName + "/loudness.xml", true);
+	}
+
+	void readLoudnessFile(const string& filePath, vector<TrackLoudness>& tracks, int& autoGain)
+	{
+		tracks.clear();
+		autoGain = -1;
+		ofxXmlSettings settings;
+		// a save still queued is newer than the file
+		string pending;
+		bool loaded = loudnessWriter != nullptr && loudnessWriter->getPending(filePath, pending)
+			? settings.loadFromBuffer(pending) : settings.load(filePath);
+		if (!loaded || !settings.tagExists("loudness"))
+		{
+			return;
+		}
+		autoGain = settings.getAttribute("loudness", "auto_gain", -1);
+		settings.pushTag("loudness");
+		int tracksCount = settings.getNumTags("track");
+		for (int i = 0; i < tracksCount; i++)
+		{
+			TrackLoudness track;
+			track.file = settings.getAttribute("track", "file", "", i);
+			track.fileSize = strtoull(settings.getAttribute("track", "size", "0", i).c_str(), nullptr, 10);
+			track.integratedLufs = settings.getAttribute("track", "lufs", -120.0, i);
+			track.truePeakDb = settings.getAttribute("track", "true_peak", -120.0, i);
+			track.measured = true;
+			tracks.push_back(track);
+		}
+		settings.popTag();
+	}
+
+	void writeLoudnessFile(const string& filePath, const vector<TrackLoudness>& tracks, int autoGain)
+	{
+		ofxXmlSettings settings;
+		settings.addTag("loudness");
+		if (autoGain >= 0)
+		{
+			settings.addAttribute("loudness", "auto_gain", autoGain, 0);
+		}
+		settings.pushTag("loudness");
+		int index = 0;
+		for (const auto& track : tracks)
+		{
+			if (!track.measured)
+			{
+				continue;
+			}
+			settings.addTag("track");
+			settings.addAttribute("track", "file", track.file, index);
+			settings.addAttribute("track", "size", ofToString(track.fileSize), index);
+			settings.addAttribute("track", "lufs", ofToString(track.integratedLufs, 2), index);
+			settings.addAttribute("track", "true_peak", ofToString(track.truePeakDb, 2), index);
+			index++;
+		}
+		settings.popTag();
+		if (loudnessWriter == nullptr)
+		{
+			settings.save(filePath);
+			return;
+		}
+		string content;
+		settings.copyXmlToString(content);
+		loudnessWriter->write(filePath, content);
+	}
+} // unnamed namespace
+
+void VolumesDb::setWriter(Tonton::Utils::AsyncWriter* writer)
 {
-	ofxXmlSettings settings;
-    settings.addTag("tracks");
-    settings.pushTag("tracks");
+	loudnessWriter = writer;
+}
 
-	for (int i = 0; i < volumes.size(); i++)
+void VolumesDb::getStoredLoudness(string songsRootDir, string songName, vector<TrackLoudness>& tracks)
+{
+	vector<TrackLoudness> stored;
+	int autoGain;
+	readLoudnessFile(getLoudnessFilePath(songsRootDir, songName), stored, autoGain);
+	for (auto& track : tracks)
 	{
-        settings.addTag("track");
-        settings.addAttribute("track", "file", volumes[i].first, i);
-        settings.addAttribute("track", "volume", to_string(int(100.0 * volumes[i].second)), i);
-    }
-    settings.popTag();
+		for (const auto& entry : stored)
+		{
+			if (entry.file == track.file && entry.fileSize == track.fileSize)
+			{
+				track = entry;
+			}
+		}
+	}
+}
+
+void VolumesDb::setStoredLoudness(string songsRootDir, string songName, const vector<TrackLoudness>& tracks)
+{
+	string filePath = getLoudnessFilePath(songsRootDir, songName);
+	vector<TrackLoudness> stored;
+	int autoGain;
+	readLoudnessFile(filePath, stored, autoGain);
+	writeLoudnessFile(filePath, tracks, autoGain);
+}
+
+int VolumesDb::getStoredAutoGain(string songsRootDir, string songName)
+{
+	vector<TrackLoudness> stored;
+	int autoGain;
+	readLoudnessFile(getLoudnessFilePath(songsRootDir, songName), stored, autoGain);
+	return autoGain;
+}
 
-	settings.save(songsRootDir + songName + "/tracks.xml");
+void VolumesDb::setStoredAutoGain(string songsRootDir, string songName, bool enabled)
+{
+	string filePath = getLoudnessFilePath(songsRootDir, songName);
+	vector<TrackLoudness> stored;
+	int autoGain;
+	readLoudnessFile(filePath, stored, autoGain);
+	writeLoudnessFile(filePath, stored, enabled ? 1 : 0);
 }
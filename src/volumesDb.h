@@ -1,12 +1,32 @@
 #pragma once
 
 #include "ofMain.h"
+#include "asyncWriter.h"
 
+#include <cstdint>
 #include <utility>
 #include <string>
 
+// loudness of a track file, cached in <song>/loudness.xml next to the volumes
+struct TrackLoudness {
+	std::string file;
+	uint64_t fileSize = 0;  // the track is analyzed again when its file changes
+	bool measured = false;
+	float integratedLufs = -120.0f;
+	float truePeakDb = -120.0f;
+};
+
 class VolumesDb {
 public:
+	// loudness.xml is then saved by the writer, on its thread. Null: saved before returning
+	static void setWriter(Tonton::Utils::AsyncWriter* writer);
+
 	static void getStoredSongVolumes(std::string songsRootDir, std::string songName, std::vector<std::pair<std::string, float>>& volumes);
-	static void setStoredSongVolumes(std::string songsRootDir, std::string songName, std::vector<std::pair<std::string, float>>& volumes);
+
+	// fills the tracks whose file and size match a stored analysis
+	static void getStoredLoudness(std::string songsRootDir, std::string songName, std::vector<TrackLoudness>& tracks);
+	static void setStoredLoudness(std::string songsRootDir, std::string songName, const std::vector<TrackLoudness>& tracks);
+	// auto gain mode of a song: 1 on, 0 off, -1 when the song uses the default of settings.xml
+	static int getStoredAutoGain(std::string songsRootDir, std::string songName);
+	static void setStoredAutoGain(std::string songsRootDir, std::string songName, bool enabled);
 };
@@ -0,0 +1,82 @@
+#include "wavWriter.h"
+
+#include "ofMain.h"
+
+namespace {
+    const uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+
+    template<typename T>
+    void writeValue(std::ofstream& stream, T value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+} // unnamed namespace
+
+WavWriter::WavWriter() {
+
+}
+
+WavWriter::~WavWriter() {
+    close();
+}
+
+bool WavWriter::open(const std::string& filePath, unsigned int sampleRate, unsigned int channels)
+{
+    close();
+    m_stream.open(ofToDataPath(filePath), std::ios::binary | std::ios::trunc);
+    if (!m_stream.is_open())
+    {
+        ofLogError() << "could not write wav file " << filePath;
+        return false;
+    }
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    m_frames = 0;
+    writeHeader();
+    return m_stream.good();
+}
+
+bool WavWriter::write(const float* samples, size_t frames)
+{
+    if (!m_stream.is_open())
+    {
+        return false;
+    }
+    m_stream.write(reinterpret_cast<const char*>(samples), frames * m_channels * sizeof(float));
+    m_frames += frames;
+    return m_stream.good();
+}
+
+void WavWriter::close()
+{
+    if (!m_stream.is_open())
+    {
+        return;
+    }
+    m_stream.seekp(0);
+    writeHeader();
+    m_stream.close();
+}
+
+bool WavWriter::isOpen() const
+{
+    return m_stream.is_open();
+}
+
+void WavWriter::writeHeader()
+{
+    uint32_t dataSize = static_cast<uint32_t>(m_frames * m_channels * sizeof(float));
+    m_stream.write("RIFF", 4);
+    writeValue<uint32_t>(m_stream, 36 + dataSize);
+    m_stream.write("WAVE", 4);
+    m_stream.write("fmt ", 4);
+    writeValue<uint32_t>(m_stream, 16);
+    writeValue<uint16_t>(m_stream, WAVE_FORMAT_IEEE_FLOAT);
+    writeValue<uint16_t>(m_stream, static_cast<uint16_t>(m_channels));
+    writeValue<uint32_t>(m_stream, m_sampleRate);
+    writeValue<uint32_t>(m_stream, m_sampleRate * m_channels * sizeof(float));
+    writeValue<uint16_t>(m_stream, static_cast<uint16_t>(m_channels * sizeof(float)));
+    writeValue<uint16_t>(m_stream, 32);
+    m_stream.write("data", 4);
+    writeValue<uint32_t>(m_stream, dataSize);
+}
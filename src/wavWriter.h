@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// 32-bit float wav file written block by block, the sizes are patched on close
+class WavWriter {
+public:
+    WavWriter();
+    virtual ~WavWriter();
+
+    bool open(const std::string& filePath, unsigned int sampleRate, unsigned int channels);
+    // interleaved frames
+    bool write(const float* samples, size_t frames);
+    void close();
+    bool isOpen() const;
+
+private:
+    void writeHeader();
+
+    std::ofstream m_stream;
+    unsigned int m_sampleRate = 0;
+    unsigned int m_channels = 0;
+    uint64_t m_frames = 0;
+};